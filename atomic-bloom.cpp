@@ -0,0 +1,164 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "atomic-bloom.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace carousel {
+
+namespace {
+
+/**
+ * \brief Sets a bit of a word unless it is already set
+ * \return Whether the bit was already set
+ */
+inline bool
+testAndSet(std::atomic<uint64_t>& word, uint64_t mask)
+{
+  // Only take the cache line exclusive if the bit actually needs to be set
+  return (word.load(std::memory_order_relaxed) & mask) != 0 ||
+         (word.fetch_or(mask, std::memory_order_relaxed) & mask) != 0;
+}
+
+inline uint64_t
+blockWordMask(uint32_t x, size_t i)
+{
+  return uint64_t(1) << ((x * detail::BLOCK_SALTS[i]) >> 26);
+}
+
+} // namespace
+
+AtomicBloom::AtomicBloom(const Bloom::Config& config, size_t nKeys)
+  : m_layout(config.layout)
+  , m_nHashes(std::max<size_t>(1, config.nHashes))
+{
+  size_t nBits = static_cast<size_t>(std::ceil(config.bitsPerKey * nKeys));
+  size_t nBitsRounded = 512;
+  while (nBitsRounded < nBits) {
+    nBitsRounded <<= 1;
+  }
+  m_mask = nBitsRounded - 1;
+  m_nWords = nBitsRounded / 64;
+  m_nLines = m_nWords / WORDS_PER_LINE;
+  m_words.reset(new std::atomic<uint64_t>[2 * m_nWords]);
+  reset(0);
+}
+
+bool
+AtomicBloom::testAndAdd(size_t buffer, uint64_t hash)
+{
+  std::atomic<uint64_t>* words = m_words.get() + buffer * m_nWords;
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  if (m_layout == Bloom::Layout::BLOCKED) {
+    return testAndAddBlocked(words, h1, h2);
+  }
+
+  bool wasEvidenced = true;
+  for (size_t i = 0; i < m_nHashes; i++) {
+    size_t bit = h1 & m_mask;
+    if (!testAndSet(words[bit >> 6], uint64_t(1) << (bit & 63))) {
+      wasEvidenced = false;
+    }
+    h1 += h2;
+  }
+  return wasEvidenced;
+}
+
+bool
+AtomicBloom::isEvidenced(size_t buffer, uint64_t hash) const
+{
+  const std::atomic<uint64_t>* words = m_words.get() + buffer * m_nWords;
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  if (m_layout == Bloom::Layout::BLOCKED) {
+    return isEvidencedBlocked(words, h1, h2);
+  }
+
+  for (size_t i = 0; i < m_nHashes; i++) {
+    size_t bit = h1 & m_mask;
+    if ((words[bit >> 6].load(std::memory_order_relaxed) & (uint64_t(1) << (bit & 63))) == 0) {
+      return false;
+    }
+    h1 += h2;
+  }
+  return true;
+}
+
+void
+AtomicBloom::prepare(size_t buffer)
+{
+  // Zero the lines the packet path has not gotten to yet
+  while (clearStep()) {
+  }
+  // Wait for lines claimed by other threads, each of which is at most a cache line away from done
+  while (m_linesCleared.load(std::memory_order_acquire) < m_nLines) {
+    std::this_thread::yield();
+  }
+
+  m_linesCleared.store(0, std::memory_order_relaxed);
+  m_clearCursor.store(buffer == 0 ? BUFFER_BIT : 0, std::memory_order_release);
+}
+
+void
+AtomicBloom::reset(size_t buffer)
+{
+  for (size_t i = 0; i < 2 * m_nWords; i++) {
+    m_words[i].store(0, std::memory_order_relaxed);
+  }
+  m_linesCleared.store(m_nLines, std::memory_order_relaxed);
+  m_clearCursor.store((buffer == 0 ? BUFFER_BIT : 0) | m_nLines, std::memory_order_release);
+}
+
+bool
+AtomicBloom::clearLine()
+{
+  uint64_t cursor = m_clearCursor.fetch_add(1, std::memory_order_acquire);
+  size_t line = cursor & LINE_MASK;
+  if (line >= m_nLines) {
+    return false;
+  }
+
+  size_t buffer = (cursor & BUFFER_BIT) != 0 ? 1 : 0;
+  std::atomic<uint64_t>* words = m_words.get() + buffer * m_nWords + line * WORDS_PER_LINE;
+  for (size_t i = 0; i < WORDS_PER_LINE; i++) {
+    words[i].store(0, std::memory_order_relaxed);
+  }
+  m_linesCleared.fetch_add(1, std::memory_order_release);
+  return true;
+}
+
+bool
+AtomicBloom::testAndAddBlocked(std::atomic<uint64_t>* words, uint64_t h1, uint64_t h2)
+{
+  // Blocks are cache lines, as are the units zeroed by clearStep
+  std::atomic<uint64_t>* block = words + (h1 & (m_nLines - 1)) * WORDS_PER_LINE;
+  uint32_t x = static_cast<uint32_t>(h2 >> 32);
+  bool wasEvidenced = true;
+  for (size_t i = 0; i < WORDS_PER_LINE; i++) {
+    if (!testAndSet(block[i], blockWordMask(x, i))) {
+      wasEvidenced = false;
+    }
+  }
+  return wasEvidenced;
+}
+
+bool
+AtomicBloom::isEvidencedBlocked(const std::atomic<uint64_t>* words, uint64_t h1, uint64_t h2) const
+{
+  const std::atomic<uint64_t>* block = words + (h1 & (m_nLines - 1)) * WORDS_PER_LINE;
+  uint32_t x = static_cast<uint32_t>(h2 >> 32);
+  for (size_t i = 0; i < WORDS_PER_LINE; i++) {
+    uint64_t mask = blockWordMask(x, i);
+    if ((block[i].load(std::memory_order_relaxed) & mask) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace carousel
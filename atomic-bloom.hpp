@@ -0,0 +1,117 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_ATOMIC_BLOOM_HPP
+#define CAROUSEL_ATOMIC_BLOOM_HPP
+
+#include "bloom.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace carousel {
+
+/**
+ * \brief Bloom filter whose bits can be tested and set by several threads at once
+ *
+ * The filter keeps two bit arrays, selected by the caller with a buffer index. While one array is
+ * in use, the other one is zeroed a cache line at a time by clearStep calls from any thread, so
+ * that switching arrays at a phase change does not require zeroing the filter.
+ */
+class AtomicBloom
+{
+public:
+  /**
+   * \brief Creates a bloom filter for the specified number of keys, with the layout and size of
+   *        the specified config (see Bloom::Config)
+   */
+  AtomicBloom(const Bloom::Config& config, size_t nKeys);
+
+  /**
+   * \brief Adds a key to the specified bit array, given its 64-bit hash (see hashKey)
+   * \return Whether the existence of the key was already evidenced by the bit array
+   */
+  bool
+  testAndAdd(size_t buffer, uint64_t hash);
+
+  /**
+   * \brief Checks whether the existence of a key is evidenced by the specified bit array
+   */
+  bool
+  isEvidenced(size_t buffer, uint64_t hash) const;
+
+  /**
+   * \brief Zeroes one cache line of the spare bit array, if any is left
+   * \return Whether a cache line was zeroed
+   */
+  bool
+  clearStep()
+  {
+    if ((m_clearCursor.load(std::memory_order_relaxed) & LINE_MASK) >= m_nLines) {
+      return false;
+    }
+    return clearLine();
+  }
+
+  /**
+   * \brief Prepares the specified bit array to be used and makes the other one the spare array
+   *
+   * Completes zeroing the specified array, which must be the current spare array. Must not be
+   * called by more than one thread at a time. Threads still adding to the array that becomes the
+   * spare one can only cause additional false positives.
+   */
+  void
+  prepare(size_t buffer);
+
+  /**
+   * \brief Zeroes both bit arrays and makes the specified array the one in use
+   *
+   * Must not be called concurrently with any other operation.
+   */
+  void
+  reset(size_t buffer);
+
+  /**
+   * \brief Returns the number of bits in each bit array
+   */
+  size_t
+  size() const
+  {
+    return m_mask + 1;
+  }
+
+  Bloom::Layout
+  layout() const
+  {
+    return m_layout;
+  }
+
+private:
+  bool
+  clearLine();
+
+  bool
+  testAndAddBlocked(std::atomic<uint64_t>* words, uint64_t h1, uint64_t h2);
+
+  bool
+  isEvidencedBlocked(const std::atomic<uint64_t>* words, uint64_t h1, uint64_t h2) const;
+
+private:
+  static const size_t WORDS_PER_LINE = 8;
+  static const uint64_t BUFFER_BIT = uint64_t(1) << 63;
+  static const uint64_t LINE_MASK = BUFFER_BIT - 1;
+
+  Bloom::Layout m_layout;
+  size_t m_nHashes;
+  size_t m_mask;
+  size_t m_nWords;
+  size_t m_nLines;
+  std::unique_ptr<std::atomic<uint64_t>[]> m_words; // both bit arrays
+  std::atomic<uint64_t> m_clearCursor; // spare array index in the top bit, next line to zero below
+  std::atomic<size_t> m_linesCleared; // number of lines of the spare array zeroed so far
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_ATOMIC_BLOOM_HPP
@@ -0,0 +1,86 @@
+/* Benchmark comparing Carousel::log with Carousel::logBatch
+ *
+ * The key population is sized so that every key matches the single partition and the bloom
+ * filter is probed for each of them, which is where the batched path hides memory latency.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using carousel::Bloom;
+using carousel::Carousel;
+
+namespace {
+
+const size_t N_LOGS = 8000000;
+// Keys per sample, a multiple of every batch size
+const size_t SAMPLE_SIZE = 256;
+
+void
+run(bench::Suite& suite, size_t memorySize, Bloom::Layout layout, size_t batchSize,
+    const std::vector<std::string>& keys)
+{
+  std::string name = "batch/" + std::to_string(memorySize) + "/" +
+                     (layout == Bloom::Layout::STANDARD ? "standard" : "blocked") + "/" +
+                     std::to_string(batchSize);
+  if (!suite.isEnabled(name)) {
+    return;
+  }
+  size_t nLogged = 0;
+  Carousel carousel([&nLogged] (const std::string&, const std::string&) { nLogged++; },
+                    memorySize, std::chrono::milliseconds(1000), true, layout);
+  carousel.setBatchCallback([&nLogged] (const std::string*, const std::string*,
+                                        const size_t*, size_t nAdmitted) {
+    nLogged += nAdmitted;
+  });
+
+  std::minstd_rand rng(1);
+  std::vector<std::string> batch(batchSize);
+  // Times are per key; a batch is logged once its last key is drawn
+  suite.run(name, N_LOGS, SAMPLE_SIZE, [&] (size_t i) {
+    if (batchSize == 1) {
+      const std::string& key = keys[rng() % keys.size()];
+      carousel.log(key, key);
+      return;
+    }
+    batch[i % batchSize] = keys[rng() % keys.size()];
+    if (i % batchSize == batchSize - 1) {
+      carousel.logBatch(batch.data(), batch.data(), batchSize);
+    }
+  });
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[SOURCES...]");
+  std::vector<size_t> sizes = {100000, 1000000};
+  if (!suite.args().empty()) {
+    sizes.clear();
+    for (const std::string& arg : suite.args()) {
+      sizes.push_back(std::strtoull(arg.c_str(), nullptr, 10));
+    }
+  }
+  const size_t batchSizes[] = {1, 32, 64, 256};
+
+  for (size_t memorySize : sizes) {
+    std::vector<std::string> keys(memorySize / 2);
+    for (size_t i = 0; i < keys.size(); i++) {
+      keys[i] = std::to_string(i);
+    }
+    for (size_t batchSize : batchSizes) {
+      run(suite, memorySize, Bloom::Layout::STANDARD, batchSize, keys);
+      run(suite, memorySize, Bloom::Layout::BLOCKED, batchSize, keys);
+    }
+  }
+  return suite.finish();
+}
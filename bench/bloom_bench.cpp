@@ -0,0 +1,100 @@
+/* Benchmark comparing the standard and cache-line-blocked bloom filter layouts
+ *
+ * For each filter size, the filter is sized the way Carousel sizes it (10 bits per source), filled
+ * with that many distinct keys and then probed with keys that were never inserted. Reported are
+ * the insertion and lookup costs and the measured false positive rate.
+ */
+
+#include "harness.hpp"
+
+#include "bloom.hpp"
+#include "hash.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using carousel::Bloom;
+using carousel::hashBytes;
+
+namespace {
+
+std::vector<uint64_t>
+makeHashes(size_t n, uint64_t base)
+{
+  std::vector<uint64_t> hashes(n);
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = base + i;
+    hashes[i] = hashBytes(&key, sizeof(key));
+  }
+  return hashes;
+}
+
+const size_t SAMPLE_SIZE = 1024;
+
+struct Accuracy
+{
+  size_t memorySize;
+  const char* layout;
+  size_t nBits;
+  double falsePositiveRate;
+};
+
+Accuracy
+run(bench::Suite& suite, size_t memorySize, Bloom::Layout layout, const char* name)
+{
+  Bloom bloom(memorySize * 10, layout);
+  std::vector<uint64_t> members = makeHashes(memorySize, 0);
+  std::vector<uint64_t> others = makeHashes(4 * memorySize, uint64_t(1) << 48);
+  std::string prefix = "bloom/" + std::to_string(memorySize) + "/" + name;
+
+  suite.runAlways(prefix + "/add", members.size(), SAMPLE_SIZE, [&] (size_t i) {
+    bloom.add(members[i]);
+  });
+
+  size_t hits = 0;
+  suite.run(prefix + "/hit", members.size(), SAMPLE_SIZE, [&] (size_t i) {
+    hits += bloom.isEvidenced(members[i]);
+  });
+  if (suite.isEnabled(prefix + "/hit") && hits != members.size()) {
+    std::fprintf(stderr, "false negative detected in %s layout\n", name);
+    std::exit(1);
+  }
+
+  size_t falsePositives = 0;
+  // The rate is reported even when the lookups are not timed
+  suite.runAlways(prefix + "/miss", others.size(), SAMPLE_SIZE, [&] (size_t i) {
+    falsePositives += bloom.isEvidenced(others[i]);
+  });
+  return Accuracy{memorySize, name, bloom.size(),
+                  static_cast<double>(falsePositives) / others.size()};
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[SOURCES...]");
+  std::vector<size_t> sizes = {10000, 100000, 1000000, 4000000};
+  if (!suite.args().empty()) {
+    sizes.clear();
+    for (const std::string& arg : suite.args()) {
+      sizes.push_back(std::strtoull(arg.c_str(), nullptr, 10));
+    }
+  }
+
+  std::vector<Accuracy> accuracies;
+  for (size_t memorySize : sizes) {
+    accuracies.push_back(run(suite, memorySize, Bloom::Layout::STANDARD, "standard"));
+    accuracies.push_back(run(suite, memorySize, Bloom::Layout::BLOCKED, "blocked"));
+  }
+
+  std::printf("\n%10s  %-8s %12s %11s\n", "sources", "layout", "bits", "FPR");
+  for (const Accuracy& a : accuracies) {
+    std::printf("%10zu  %-8s %12zu %10.4f%%\n", a.memorySize, a.layout, a.nBits,
+                100 * a.falsePositiveRate);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,72 @@
+/* Benchmark of the clocks that can drive Carousel phases
+ *
+ * Reports the cost of reading each clock, and the cost of Carousel::log on keys that are already
+ * logged in the current phase, for which the phase check is a large part of the work.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+#include "clock.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::ManualClock;
+using carousel::SteadyClock;
+using carousel::TscClock;
+
+namespace {
+
+const size_t N_READS = 10000000;
+const size_t N_LOGS = 10000000;
+const size_t MEMORY_SIZE = 1000;
+const size_t SAMPLE_SIZE = 1024;
+
+template<typename Clock>
+size_t
+run(bench::Suite& suite, const char* name, const Clock& clock)
+{
+  std::string prefix = std::string("clock/") + name;
+  uint64_t sum = 0;
+  suite.run(prefix + "/now", N_READS, SAMPLE_SIZE, [&] (size_t) {
+    sum += clock.now();
+  });
+  bench::doNotOptimize(sum);
+
+  size_t nLogged = 0;
+  BasicCarousel<carousel::LogCallback, Clock> carousel([&nLogged] (const std::string&, const std::string&) { nLogged++; },
+                                MEMORY_SIZE, std::chrono::milliseconds(1000), true,
+                                carousel::Bloom::Layout::STANDARD, clock);
+  std::vector<std::string> keys(MEMORY_SIZE / 2);
+  for (size_t i = 0; i < keys.size(); i++) {
+    keys[i] = std::to_string(i);
+  }
+
+  suite.run(prefix + "/log", N_LOGS, SAMPLE_SIZE, [&] (size_t i) {
+    const std::string& key = keys[i % keys.size()];
+    carousel.log(key, key);
+  });
+  return nLogged;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  const char* names[] = {"steady", "tsc", "manual"};
+  size_t nLogged[] = {run(suite, names[0], SteadyClock()), run(suite, names[1], TscClock()),
+                      run(suite, names[2], ManualClock())};
+
+  // Keys are logged once per phase, so these should match
+  std::printf("\n%-8s %10s\n", "clock", "logged");
+  for (size_t i = 0; i < 3; i++) {
+    std::printf("%-8s %10zu\n", names[i], nLogged[i]);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,119 @@
+/* Benchmark of Carousel throughput as the number of packet worker threads grows
+ *
+ * Every thread logs keys drawn from a shared key population, either into one ConcurrentCarousel
+ * or into one Carousel guarded by a mutex. Reported is the aggregate throughput.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+#include "concurrent-carousel.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using carousel::Carousel;
+using carousel::ConcurrentCarousel;
+
+namespace {
+
+const size_t MEMORY_SIZE = 100000;
+const size_t N_KEYS = 1000000;
+const size_t KEYS_PER_THREAD = 2000000;
+
+/**
+ * \brief Times nThreads threads logging KEYS_PER_THREAD keys each, reporting the time per key of
+ *        all of them together
+ */
+template<typename Log>
+void
+runThreads(bench::Suite& suite, const std::string& name, size_t nThreads,
+           const std::vector<std::string>& keys, Log log)
+{
+  if (!suite.isEnabled(name)) {
+    return;
+  }
+  std::vector<std::thread> threads;
+  std::atomic<bool> go(false);
+  for (size_t t = 0; t < nThreads; t++) {
+    threads.emplace_back([&, t] {
+      std::minstd_rand rng(t + 1);
+      while (!go.load()) {
+      }
+      for (size_t i = 0; i < KEYS_PER_THREAD; i++) {
+        const std::string& key = keys[rng() % keys.size()];
+        log(key);
+      }
+    });
+  }
+
+  bench::Stopwatch stopwatch;
+  go.store(true);
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  suite.report(name, nThreads * KEYS_PER_THREAD, stopwatch.elapsedNs());
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[MAX_THREADS]");
+  size_t maxThreads = std::max(4u, std::thread::hardware_concurrency());
+  if (!suite.args().empty()) {
+    maxThreads = std::strtoull(suite.args()[0].c_str(), nullptr, 10);
+  }
+
+  std::vector<std::string> keys(N_KEYS);
+  for (size_t i = 0; i < N_KEYS; i++) {
+    keys[i] = std::to_string(i);
+  }
+  const std::string entry = "entry";
+
+  // Keys logged by each Carousel for each number of threads, which should be about the same
+  struct Logged
+  {
+    size_t nThreads;
+    size_t nSerial;
+    size_t nConcurrent;
+  };
+  std::vector<Logged> logged;
+  // Powers of two, then maxThreads itself
+  for (size_t nThreads = 1; nThreads <= maxThreads;
+       nThreads = nThreads < maxThreads ? std::min(2 * nThreads, maxThreads) : 2 * nThreads) {
+    std::mutex mutex;
+    std::atomic<size_t> nLogged(0);
+    auto callback = [&nLogged] (const std::string&, const std::string&) { nLogged++; };
+
+    Carousel serial(callback, MEMORY_SIZE, std::chrono::milliseconds(1));
+    runThreads(suite, "concurrent/mutex/" + std::to_string(nThreads), nThreads, keys,
+               [&] (const std::string& key) {
+                 std::lock_guard<std::mutex> lock(mutex);
+                 serial.log(key, entry);
+               });
+    size_t nSerialLogged = nLogged.exchange(0);
+
+    ConcurrentCarousel concurrent(callback, MEMORY_SIZE, std::chrono::milliseconds(1));
+    runThreads(suite, "concurrent/concurrent/" + std::to_string(nThreads), nThreads, keys,
+               [&] (const std::string& key) {
+                 concurrent.log(key, entry);
+               });
+    logged.push_back(Logged{nThreads, nSerialLogged, nLogged.load()});
+  }
+
+  std::printf("\n%8s %12s %12s\n", "threads", "mutex", "concurrent");
+  for (const Logged& l : logged) {
+    std::printf("%8zu %12zu %12zu\n", l.nThreads, l.nSerial, l.nConcurrent);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,82 @@
+/* Benchmark of the rate at which Logger drains its queue
+ *
+ * A producer keeps the queue of a Logger full with distinct keys for a fixed time, and the number
+ * of recorded keys is compared with the rate the collection interval calls for.
+ */
+
+#include "harness.hpp"
+
+#include "logger.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using carousel::Logger;
+
+namespace {
+
+const size_t MEMORY_SIZE = 100000;
+const std::chrono::milliseconds DURATION(1000);
+
+struct Rate
+{
+  long long intervalNs;
+  size_t burstSize;
+  double target;
+  double achieved;
+};
+
+/**
+ * \brief Reports the time per recorded key, and returns the rate achieved
+ */
+Rate
+run(bench::Suite& suite, std::chrono::nanoseconds interval, size_t burstSize)
+{
+  Logger logger(MEMORY_SIZE, interval, burstSize);
+  std::atomic<bool> stop(false);
+  std::thread producer([&] {
+    const std::string entry = "entry";
+    for (size_t i = 0; !stop.load(std::memory_order_relaxed); i++) {
+      logger.log(std::to_string(i), entry);
+    }
+  });
+
+  bench::Stopwatch stopwatch;
+  logger.run();
+  std::this_thread::sleep_for(DURATION);
+  size_t nRecorded = logger.numRecordedKeys();
+  double elapsedNs = stopwatch.elapsedNs();
+  logger.stop();
+  stop = true;
+  producer.join();
+
+  long long intervalNs = interval.count();
+  suite.report("drain/" + std::to_string(intervalNs) + "ns/burst-" + std::to_string(burstSize),
+               nRecorded, elapsedNs);
+  return Rate{intervalNs, burstSize, 1e9 / intervalNs, nRecorded / elapsedNs * 1e9};
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  std::vector<Rate> rates = {run(suite, std::chrono::milliseconds(1), 0),
+                             run(suite, std::chrono::microseconds(100), 0),
+                             run(suite, std::chrono::microseconds(10), 0),
+                             run(suite, std::chrono::microseconds(10), 1),
+                             run(suite, std::chrono::microseconds(1), 0)};
+
+  std::printf("\n%12s %8s %14s %14s %9s\n", "interval ns", "burst", "target /s", "achieved /s",
+              "ratio");
+  for (const Rate& r : rates) {
+    std::printf("%12lld %8zu %14.0f %14.0f %8.1f%%\n", r.intervalNs, r.burstSize, r.target,
+                r.achieved, 100.0 * r.achieved / r.target);
+  }
+  return suite.finish();
+}
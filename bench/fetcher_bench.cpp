@@ -0,0 +1,232 @@
+/* Benchmark of the dataset fetchers of the frontend
+ *
+ * Replays a dataset, by default test-data/data4.csv concatenated to itself to about 100 MB, with
+ * the iostream-based DatasetLogFetcher and with MappedDatasetLogFetcher, fetching keys one by one
+ * as strings, in batches of strings and in batches of views into the mapping. A binary trace of
+ * that dataset, as written by trace_convert, can be passed as second argument to compare
+ * TraceLogFetcher, and to compare replaying it into Carousel as carousel_test -t does, with and
+ * without the hashes stored in the trace.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+#include "log-fetcher.hpp"
+#include "trace-log-fetcher.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using carousel::Carousel;
+using carousel::DatasetLogFetcher;
+using carousel::KeyView;
+using carousel::LogFetcher;
+using carousel::MappedDatasetLogFetcher;
+using carousel::TraceLogFetcher;
+using carousel::TraceRecord;
+
+namespace {
+
+const size_t TARGET_SIZE = 100 << 20;
+const size_t BATCH_SIZE = 64;
+const size_t MEMORY_SIZE = 1000;
+
+/**
+ * \brief Writes copies of a dataset to a temporary file until it reaches TARGET_SIZE
+ * \return Number of lines written
+ */
+size_t
+makeDataset(const char* source, const char* path)
+{
+  std::ifstream ifs(source, std::ios::binary);
+  std::stringstream contents;
+  contents << ifs.rdbuf();
+  std::string data = contents.str();
+  if (data.empty()) {
+    std::fprintf(stderr, "Cannot read %s\n", source);
+    std::exit(1);
+  }
+
+  std::ofstream ofs(path, std::ios::binary);
+  size_t nLines = 0;
+  size_t linesPerCopy = 0;
+  for (char c : data) {
+    linesPerCopy += c == '\n';
+  }
+  for (size_t size = 0; size < TARGET_SIZE; size += data.size()) {
+    ofs << data;
+    nLines += linesPerCopy;
+  }
+  return nLines;
+}
+
+/**
+ * \brief Keys read by a fetcher, and their total size, to check that fetchers agree
+ */
+struct Fetched
+{
+  std::string name;
+  size_t nKeys;
+  size_t nBytes;
+};
+
+template<typename Fetch>
+void
+run(bench::Suite& suite, const std::string& name, LogFetcher& fetcher, size_t nLines, Fetch fetch,
+    std::vector<Fetched>& fetched)
+{
+  if (!suite.isEnabled(name)) {
+    return;
+  }
+  if (!fetcher.prepare()) {
+    std::exit(1);
+  }
+  size_t checksum = 0;
+  bench::Stopwatch stopwatch;
+  size_t n = fetch(fetcher, nLines, checksum);
+  suite.report(name, n, stopwatch.elapsedNs());
+  fetched.push_back(Fetched{name, n, checksum});
+}
+
+/**
+ * \brief Replays a trace into Carousel in batches, passing it the hashes stored in the trace if
+ *        isHashed, or letting it hash the keys again otherwise
+ * \return Number of records replayed
+ */
+size_t
+replayTrace(TraceLogFetcher& trace, bool isHashed, size_t& checksum)
+{
+  Carousel carousel([] (const std::string&, const std::string&) {}, MEMORY_SIZE,
+                    std::chrono::milliseconds(1));
+  std::vector<TraceRecord> records(BATCH_SIZE);
+  std::vector<std::string> keys(BATCH_SIZE);
+  std::vector<uint64_t> hashes(BATCH_SIZE);
+  size_t total = 0;
+  size_t n;
+  while ((n = trace.fetchBatch(records.data(), records.size())) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      keys[i].assign(records[i].key.data, records[i].key.size);
+      hashes[i] = records[i].hash;
+      checksum += records[i].key.size;
+    }
+    if (isHashed) {
+      carousel.logBatchHashed(hashes.data(), keys.data(), keys.data(), n);
+    }
+    else {
+      carousel.logBatch(keys.data(), keys.data(), n);
+    }
+    total += n;
+  }
+  return total;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[DATASET [TRACE]]");
+  const std::vector<std::string>& args = suite.args();
+  std::string source = args.size() > 0 ? args[0] : "../test-data/data4.csv";
+  char path[] = "/tmp/fetcher_bench.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    std::perror("mkstemp");
+    return 1;
+  }
+  close(fd);
+  size_t nLines = makeDataset(source.c_str(), path);
+  std::vector<Fetched> fetched;
+
+  DatasetLogFetcher stream(path, 0);
+  run(suite, "fetcher/iostream/fetch", stream, nLines,
+      [] (LogFetcher& f, size_t n, size_t& checksum) {
+        for (size_t i = 0; i < n; i++) {
+          checksum += f.fetch().size();
+        }
+        return n;
+      }, fetched);
+
+  MappedDatasetLogFetcher mappedFetch(path, 0);
+  run(suite, "fetcher/mmap/fetch", mappedFetch, nLines,
+      [] (LogFetcher& f, size_t n, size_t& checksum) {
+        for (size_t i = 0; i < n; i++) {
+          checksum += f.fetch().size();
+        }
+        return n;
+      }, fetched);
+
+  MappedDatasetLogFetcher mappedStrings(path, 0);
+  run(suite, "fetcher/mmap/fetchBatch-string", mappedStrings, nLines,
+      [] (LogFetcher& f, size_t, size_t& checksum) {
+        std::vector<std::string> keys(BATCH_SIZE);
+        size_t total = 0;
+        size_t n;
+        while ((n = f.fetchBatch(keys.data(), keys.size())) > 0) {
+          for (size_t i = 0; i < n; i++) {
+            checksum += keys[i].size();
+          }
+          total += n;
+        }
+        return total;
+      }, fetched);
+
+  MappedDatasetLogFetcher mappedViews(path, 0);
+  run(suite, "fetcher/mmap/fetchBatch-view", mappedViews, nLines,
+      [&] (LogFetcher&, size_t, size_t& checksum) {
+        std::vector<KeyView> keys(BATCH_SIZE);
+        size_t total = 0;
+        size_t n;
+        while ((n = mappedViews.fetchBatch(keys.data(), keys.size())) > 0) {
+          for (size_t i = 0; i < n; i++) {
+            checksum += keys[i].size;
+          }
+          total += n;
+        }
+        return total;
+      }, fetched);
+
+  unlink(path);
+
+  if (args.size() > 1) {
+    TraceLogFetcher trace(args[1].c_str());
+    run(suite, "fetcher/trace/fetchBatch-record", trace, 0,
+        [&] (LogFetcher&, size_t, size_t& checksum) {
+          std::vector<TraceRecord> records(BATCH_SIZE);
+          size_t total = 0;
+          size_t n;
+          while ((n = trace.fetchBatch(records.data(), records.size())) > 0) {
+            for (size_t i = 0; i < n; i++) {
+              checksum += records[i].key.size;
+            }
+            total += n;
+          }
+          return total;
+        }, fetched);
+
+    TraceLogFetcher rehashed(args[1].c_str());
+    run(suite, "fetcher/trace/replay-rehash", rehashed, 0,
+        [&] (LogFetcher&, size_t, size_t& checksum) {
+          return replayTrace(rehashed, false, checksum);
+        }, fetched);
+
+    TraceLogFetcher hashed(args[1].c_str());
+    run(suite, "fetcher/trace/replay-hashed", hashed, 0,
+        [&] (LogFetcher&, size_t, size_t& checksum) {
+          return replayTrace(hashed, true, checksum);
+        }, fetched);
+  }
+
+  std::printf("\n%-40s %12s %14s\n", "fetcher", "keys", "key bytes");
+  for (const Fetched& f : fetched) {
+    std::printf("%-40s %12zu %14zu\n", f.name.c_str(), f.nKeys, f.nBytes);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,194 @@
+/* Benchmark comparing the duplicate filters Carousel can be instantiated with
+ *
+ * Each filter is sized for a number of keys the way Carousel sizes it for its memory size: bloom
+ * filters at 10 bits per key in both layouts and for a 0.1% false positive rate, and the cuckoo
+ * filter at its default load factor. Each is filled with that many distinct keys and probed with
+ * keys that were never inserted. Reported are the insertion and lookup costs, the memory used,
+ * including the spare array of O(1) resets, and the measured false positive rate. Then, Carousel
+ * is run in virtual time with each filter over a universe of keys logged in random order, and the
+ * time until 99% and 100% of the keys were logged at least once is reported, in collection
+ * intervals.
+ */
+
+#include "harness.hpp"
+
+#include "bloom.hpp"
+#include "carousel.hpp"
+#include "cuckoo-filter.hpp"
+#include "hash.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::Bloom;
+using carousel::CuckooFilter;
+using carousel::ManualClock;
+using carousel::hashBytes;
+
+namespace {
+
+std::vector<uint64_t>
+makeHashes(size_t n, uint64_t base)
+{
+  std::vector<uint64_t> hashes(n);
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = base + i;
+    hashes[i] = hashBytes(&key, sizeof(key));
+  }
+  return hashes;
+}
+
+const size_t SAMPLE_SIZE = 1024;
+
+struct Accuracy
+{
+  size_t nKeys;
+  const char* filter;
+  size_t nBytes;
+  double falsePositiveRate;
+  double expectedFalsePositiveRate;
+  size_t nLost;
+};
+
+/**
+ * \brief Times insertions and lookups, which are made even if they are filtered out, as the
+ *        accuracy is reported for every filter
+ */
+template<typename Filter>
+Accuracy
+runFilter(bench::Suite& suite, size_t nKeys, const typename Filter::Config& config,
+          const char* name)
+{
+  Filter filter(config, nKeys);
+  std::vector<uint64_t> members = makeHashes(nKeys, 0);
+  std::vector<uint64_t> others = makeHashes(4 * nKeys, uint64_t(1) << 48);
+  std::string prefix = "filter/" + std::to_string(nKeys) + "/" + name;
+
+  suite.runAlways(prefix + "/add", members.size(), SAMPLE_SIZE, [&] (size_t i) {
+    filter.add(members[i]);
+  });
+  size_t hits = 0;
+  suite.runAlways(prefix + "/hit", members.size(), SAMPLE_SIZE, [&] (size_t i) {
+    hits += filter.isEvidenced(members[i]);
+  });
+  size_t falsePositives = 0;
+  suite.runAlways(prefix + "/miss", others.size(), SAMPLE_SIZE, [&] (size_t i) {
+    falsePositives += filter.isEvidenced(others[i]);
+  });
+
+  return Accuracy{nKeys, name, filter.memoryBytes(),
+                  static_cast<double>(falsePositives) / others.size(),
+                  filter.expectedFalsePositiveRate(nKeys), members.size() - hits};
+}
+
+struct CountingSink
+{
+  void
+  operator()(const std::string& keyString, const std::string&)
+  {
+    size_t key = std::stoul(keyString);
+    if (!(*seen)[key]) {
+      (*seen)[key] = true;
+      (*nSeen)++;
+    }
+  }
+
+  std::vector<bool>* seen;
+  size_t* nSeen;
+};
+
+/**
+ * \brief Logs random keys out of a universe four times the memory size, sixteen per collection
+ *        interval, and prints when 99% and then all of them were logged at least once
+ *
+ * Keys then arrive about four times each per phase once Carousel has settled on four partitions,
+ * so that a key is mostly missed because of a false positive or because it did not arrive.
+ */
+template<typename Filter>
+void
+runCoverage(size_t memorySize, const typename Filter::Config& config, const char* name)
+{
+  const size_t N_KEYS = 4 * memorySize;
+  const std::chrono::milliseconds interval(1);
+  const std::chrono::microseconds tick(1000 / 16);
+  const uint64_t MAX_TICKS = 1000 * 16 * uint64_t(memorySize);
+
+  std::vector<bool> seen(N_KEYS);
+  size_t nSeen = 0;
+  ManualClock clock;
+  BasicCarousel<CountingSink, ManualClock, Filter> carousel(CountingSink{&seen, &nSeen},
+                                                            memorySize, interval, true,
+                                                            config, clock);
+  carousel.setFalsePositiveSampling(true);
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<uint64_t> keys(0, N_KEYS - 1);
+
+  const std::string entry;
+  uint64_t ticks99 = 0;
+  uint64_t t = 0;
+  for (; t < MAX_TICKS && nSeen < N_KEYS; t++) {
+    carousel.log(keys(generator), entry);
+    clock.advance(tick);
+    if (ticks99 == 0 && nSeen * 100 >= N_KEYS * 99) {
+      ticks99 = t + 1;
+    }
+  }
+
+  // Times are in collection intervals, i.e., in entries the sink could have taken by then
+  std::printf("%10zu  %-16s %12.0f %12.0f %12.4f\n", memorySize, name,
+              ticks99 != 0 ? ticks99 / 16.0 : -1.0, nSeen == N_KEYS ? t / 16.0 : -1.0,
+              carousel.stats().falsePositiveRate());
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[KEYS]");
+  std::vector<size_t> sizes = {10000, 100000, 1000000, 4000000};
+  if (!suite.args().empty()) {
+    sizes.assign(1, std::strtoul(suite.args()[0].c_str(), nullptr, 10));
+  }
+
+  Bloom::Config standard(Bloom::Layout::STANDARD);
+  Bloom::Config blocked(Bloom::Layout::BLOCKED);
+  Bloom::Config lowRate = Bloom::Config::forFalsePositiveRate(0.001);
+  CuckooFilter::Config cuckoo;
+
+  std::vector<Accuracy> accuracies;
+  for (size_t nKeys : sizes) {
+    accuracies.push_back(runFilter<Bloom>(suite, nKeys, standard, "bloom/standard"));
+    accuracies.push_back(runFilter<Bloom>(suite, nKeys, blocked, "bloom/blocked"));
+    accuracies.push_back(runFilter<Bloom>(suite, nKeys, lowRate, "bloom/fpr-0.1%"));
+    accuracies.push_back(runFilter<CuckooFilter>(suite, nKeys, cuckoo, "cuckoo"));
+  }
+
+  std::printf("\n%10s  %-16s %12s %8s %10s %10s %8s\n", "keys", "filter", "bytes", "bits/key",
+              "fpr", "expected", "lost");
+  for (const Accuracy& a : accuracies) {
+    std::printf("%10zu  %-16s %12zu %8.1f %9.4f%% %9.4f%% %8zu\n", a.nKeys, a.filter, a.nBytes,
+                8.0 * a.nBytes / a.nKeys, 100 * a.falsePositiveRate,
+                100 * a.expectedFalsePositiveRate, a.nLost);
+  }
+
+  // Coverage runs log hundreds of keys per key of memory size, so they are limited to the smaller
+  // sizes
+  std::printf("\n%10s  %-16s %12s %12s %12s\n", "memory", "filter", "99%", "100%",
+              "sampled fpr");
+  for (size_t memorySize : sizes) {
+    if (memorySize > 100000) {
+      continue;
+    }
+    runCoverage<Bloom>(memorySize, standard, "bloom/standard");
+    runCoverage<Bloom>(memorySize, blocked, "bloom/blocked");
+    runCoverage<Bloom>(memorySize, lowRate, "bloom/fpr-0.1%");
+    runCoverage<CuckooFilter>(memorySize, cuckoo, "cuckoo");
+  }
+  return suite.finish();
+}
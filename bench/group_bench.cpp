@@ -0,0 +1,150 @@
+/* Benchmark comparing many separate Carousel instances with one CarouselGroup
+ *
+ * For each number of instances, keys of random instances are logged, either into one Carousel
+ * per instance, each with its own std::function callback, bloom filter allocation and clock
+ * check, or into a CarouselGroup holding as many instances. Both read the time stamp counter.
+ * Reported are the time per key and the heap memory per instance, measured with mallinfo2 where
+ * glibc provides it.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+#include "carousel-group.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+using carousel::BasicCarousel;
+using carousel::BasicCarouselGroup;
+using carousel::GroupLogCallback;
+using carousel::LogCallback;
+using carousel::TscClock;
+
+namespace {
+
+const size_t MEMORY_SIZE = 1000;
+const size_t KEYS_PER_INSTANCE = 4 * MEMORY_SIZE;
+const size_t N_OPS = 1 << 22;
+const size_t SAMPLE_SIZE = 1024;
+
+/**
+ * \brief Returns the number of bytes allocated on the heap, or 0 if unknown
+ */
+size_t
+heapBytes()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+#else
+  return 0;
+#endif
+}
+
+struct Op
+{
+  size_t instance;
+  uint64_t key;
+};
+
+std::vector<Op>
+makeOps(size_t nInstances)
+{
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<size_t> instances(0, nInstances - 1);
+  std::uniform_int_distribution<uint64_t> keys(0, KEYS_PER_INSTANCE - 1);
+  std::vector<Op> ops(N_OPS);
+  for (Op& op : ops) {
+    op.instance = instances(generator);
+    op.key = keys(generator);
+  }
+  return ops;
+}
+
+struct Footprint
+{
+  size_t nInstances;
+  const char* variant;
+  size_t nBytes;
+  size_t nLogged;
+};
+
+Footprint
+runSeparate(bench::Suite& suite, size_t nInstances, const std::vector<Op>& ops)
+{
+  size_t nLogged = 0;
+  LogCallback callback = [&nLogged] (const std::string&, const std::string&) { nLogged++; };
+  typedef BasicCarousel<LogCallback, TscClock> Instance;
+
+  size_t heapBefore = heapBytes();
+  std::vector<std::unique_ptr<Instance>> instances;
+  for (size_t i = 0; i < nInstances; i++) {
+    instances.emplace_back(new Instance(callback, MEMORY_SIZE, std::chrono::milliseconds(1)));
+  }
+  size_t bytes = heapBytes() - heapBefore;
+
+  const std::string entry = "entry";
+  suite.run("group/" + std::to_string(nInstances) + "/separate", ops.size(), SAMPLE_SIZE,
+            [&] (size_t i) {
+              instances[ops[i].instance]->log(ops[i].key, entry);
+            });
+  return Footprint{nInstances, "separate", bytes, nLogged};
+}
+
+Footprint
+runGroup(bench::Suite& suite, size_t nInstances, const std::vector<Op>& ops)
+{
+  size_t nLogged = 0;
+  GroupLogCallback callback = [&nLogged] (size_t, const std::string&, const std::string&) {
+    nLogged++;
+  };
+
+  size_t heapBefore = heapBytes();
+  std::unique_ptr<BasicCarouselGroup<GroupLogCallback, TscClock>> group(
+    new BasicCarouselGroup<GroupLogCallback, TscClock>(callback, nInstances, MEMORY_SIZE,
+                                                       std::chrono::milliseconds(1)));
+  size_t bytes = heapBytes() - heapBefore;
+
+  const std::string entry = "entry";
+  suite.run("group/" + std::to_string(nInstances) + "/group", ops.size(), SAMPLE_SIZE,
+            [&] (size_t i) {
+              group->log(ops[i].instance, ops[i].key, entry);
+            });
+  return Footprint{nInstances, "group", bytes, nLogged};
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[INSTANCES]");
+  std::vector<size_t> counts = {16, 1024, 8192};
+  if (!suite.args().empty()) {
+    counts.assign(1, std::strtoul(suite.args()[0].c_str(), nullptr, 10));
+  }
+
+  std::vector<Footprint> footprints;
+  for (size_t nInstances : counts) {
+    std::vector<Op> ops = makeOps(nInstances);
+    footprints.push_back(runSeparate(suite, nInstances, ops));
+    footprints.push_back(runGroup(suite, nInstances, ops));
+  }
+
+  std::printf("\n%10s  %-10s %14s %14s\n", "instances", "variant", "bytes/instance", "logged");
+  for (const Footprint& f : footprints) {
+    std::printf("%10zu  %-10s %14.0f %14zu\n", f.nInstances, f.variant,
+                static_cast<double>(f.nBytes) / f.nInstances, f.nLogged);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,335 @@
+/* Harness shared by the benchmarks
+ *
+ * A Suite times operations in samples of a fixed number of operations, and reports for each
+ * benchmark the mean time per operation, the operation rate and percentiles of the time per
+ * operation across samples. Results can be written to a JSON file, and compared against a JSON
+ * file written by an earlier version to catch regressions. The comparison is on the median time
+ * per operation, which is less sensitive than the mean to interrupts and other outliers.
+ *
+ * Operations that cannot be timed one sample at a time, such as those spread over threads, are
+ * timed with a Stopwatch and passed to Suite::report. Measurements other than time, e.g., false
+ * positive rates or coverage, are printed by each benchmark in a table of its own.
+ *
+ * Command line options understood by Suite, which leaves the other arguments to the benchmark:
+ *   --filter TEXT      only run benchmarks whose name contains TEXT
+ *   --json FILE        write the results to FILE
+ *   --baseline FILE    compare the results with those in FILE
+ *   --threshold PCT    slowdown over the baseline reported as a regression (default: 10)
+ */
+
+#ifndef CAROUSEL_BENCH_HARNESS_HPP
+#define CAROUSEL_BENCH_HARNESS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+struct Result
+{
+  std::string name;
+  uint64_t nOps;
+  double nsPerOp;
+  double p50;
+  double p90;
+  double p99;
+  double p999;
+  double max;
+};
+
+/**
+ * \brief Returns the value below which the specified share of the sorted values fall
+ */
+template<typename T>
+inline double
+percentile(const std::vector<T>& sorted, double p)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+/**
+ * \brief Measures the time elapsed since it was created or last restarted
+ */
+class Stopwatch
+{
+public:
+  Stopwatch()
+    : m_start(std::chrono::steady_clock::now())
+  {
+  }
+
+  void
+  restart()
+  {
+    m_start = std::chrono::steady_clock::now();
+  }
+
+  double
+  elapsedNs() const
+  {
+    auto elapsed = std::chrono::steady_clock::now() - m_start;
+    return std::chrono::duration<double, std::nano>(elapsed).count();
+  }
+
+private:
+  std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * \brief Prevents the compiler from optimizing away the computation of a value
+ */
+template<typename T>
+inline void
+doNotOptimize(const T& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Suite
+{
+public:
+  /**
+   * \param argsUsage Usage of the arguments of the benchmark itself, if any
+   */
+  Suite(int argc, char* argv[], const char* argsUsage = "")
+  {
+    for (int i = 1; i < argc; i++) {
+      std::string arg = argv[i];
+      if (arg.compare(0, 2, "--") != 0) {
+        m_args.push_back(arg);
+      }
+      else if (i + 1 < argc && arg == "--filter") {
+        m_filter = argv[++i];
+      }
+      else if (i + 1 < argc && arg == "--json") {
+        m_jsonPath = argv[++i];
+      }
+      else if (i + 1 < argc && arg == "--baseline") {
+        m_baselinePath = argv[++i];
+      }
+      else if (i + 1 < argc && arg == "--threshold") {
+        m_threshold = std::atof(argv[++i]) / 100;
+      }
+      else {
+        std::fprintf(stderr, "usage: %s [--filter TEXT] [--json FILE] [--baseline FILE] "
+                     "[--threshold PCT]%s%s\n", argv[0], *argsUsage != '\0' ? " " : "", argsUsage);
+        std::exit(1);
+      }
+    }
+    // The baseline is read up front, as it may be the file the results are written to
+    if (!m_baselinePath.empty()) {
+      m_baseline = readBaseline();
+    }
+  }
+
+  /**
+   * \brief Returns the arguments that are not options of the suite
+   */
+  const std::vector<std::string>&
+  args() const
+  {
+    return m_args;
+  }
+
+  bool
+  isEnabled(const std::string& name) const
+  {
+    return name.find(m_filter) != std::string::npos;
+  }
+
+  /**
+   * \brief Times op(i) for i from 0 to nOps - 1, in samples of batchSize operations
+   *
+   * Percentiles are those of the mean time per operation of each sample, so a batchSize of 1
+   * yields the latency distribution of individual operations, at the price of timing overhead.
+   */
+  template<typename Op>
+  void
+  run(const std::string& name, size_t nOps, size_t batchSize, Op op)
+  {
+    if (!isEnabled(name)) {
+      return;
+    }
+    std::vector<double> samples;
+    samples.reserve(nOps / batchSize + 1);
+    auto start = std::chrono::steady_clock::now();
+    auto sampleStart = start;
+    for (size_t i = 0; i < nOps; ) {
+      size_t end = std::min(nOps, i + batchSize);
+      size_t n = end - i;
+      for (; i < end; i++) {
+        op(i);
+      }
+      auto now = std::chrono::steady_clock::now();
+      samples.push_back(std::chrono::duration<double, std::nano>(now - sampleStart).count() / n);
+      sampleStart = now;
+    }
+    double total = std::chrono::duration<double, std::nano>(sampleStart - start).count();
+    report(name, nOps, total, samples);
+  }
+
+  /**
+   * \brief As run, but calls op(i) for every i even if the benchmark is filtered out, for
+   *        operations whose effects later ones depend on
+   */
+  template<typename Op>
+  void
+  runAlways(const std::string& name, size_t nOps, size_t batchSize, Op op)
+  {
+    if (isEnabled(name)) {
+      run(name, nOps, batchSize, op);
+      return;
+    }
+    for (size_t i = 0; i < nOps; i++) {
+      op(i);
+    }
+  }
+
+  /**
+   * \brief Records a benchmark timed by the caller
+   * \param samples Mean time per operation of each sample, in nanoseconds
+   */
+  template<typename T>
+  void
+  report(const std::string& name, uint64_t nOps, double totalNs, std::vector<T> samples)
+  {
+    if (!isEnabled(name)) {
+      return;
+    }
+    if (m_results.empty()) {
+      std::printf("%-40s %12s %14s %9s %9s %9s %9s %9s\n", "benchmark", "ns/op", "ops/s",
+                  "p50", "p90", "p99", "p99.9", "max");
+    }
+    std::sort(samples.begin(), samples.end());
+    Result result = {name, nOps, totalNs / nOps, percentile(samples, 0.5), percentile(samples, 0.9),
+                     percentile(samples, 0.99), percentile(samples, 0.999),
+                     samples.empty() ? 0 : static_cast<double>(samples.back())};
+    m_results.push_back(result);
+    std::printf("%-40s %12.2f %14.0f %9.1f %9.1f %9.1f %9.1f %9.1f\n", name.c_str(),
+                result.nsPerOp, 1e9 / result.nsPerOp, result.p50, result.p90, result.p99,
+                result.p999, result.max);
+    std::fflush(stdout);
+  }
+
+  /**
+   * \brief Records a benchmark timed by the caller as a whole, for which there are no samples
+   */
+  void
+  report(const std::string& name, uint64_t nOps, double totalNs)
+  {
+    report(name, nOps, totalNs, std::vector<double>(1, totalNs / nOps));
+  }
+
+  /**
+   * \brief Writes the results and compares them with the baseline, as requested
+   * \return Exit status of the program, non-zero if a regression was found
+   */
+  int
+  finish()
+  {
+    if (!m_jsonPath.empty() && !writeJson()) {
+      std::fprintf(stderr, "Cannot write %s\n", m_jsonPath.c_str());
+      return 1;
+    }
+    if (!m_baselinePath.empty()) {
+      return compare();
+    }
+    return 0;
+  }
+
+private:
+  bool
+  writeJson() const
+  {
+    FILE* file = std::fopen(m_jsonPath.c_str(), "w");
+    if (file == nullptr) {
+      return false;
+    }
+    // One benchmark per line, which is what readBaseline expects
+    std::fprintf(file, "{\"version\": 1, \"benchmarks\": [\n");
+    for (size_t i = 0; i < m_results.size(); i++) {
+      const Result& r = m_results[i];
+      std::fprintf(file, "  {\"name\": \"%s\", \"ops\": %llu, \"ns_per_op\": %.3f, "
+                   "\"ops_per_s\": %.1f, \"p50_ns\": %.3f, \"p90_ns\": %.3f, \"p99_ns\": %.3f, "
+                   "\"p999_ns\": %.3f, \"max_ns\": %.3f}%s\n", r.name.c_str(),
+                   static_cast<unsigned long long>(r.nOps), r.nsPerOp, 1e9 / r.nsPerOp, r.p50, r.p90,
+                   r.p99, r.p999, r.max,
+                   i + 1 < m_results.size() ? "," : "");
+    }
+    std::fprintf(file, "]}\n");
+    return std::fclose(file) == 0;
+  }
+
+  std::map<std::string, double>
+  readBaseline() const
+  {
+    std::map<std::string, double> baseline;
+    std::ifstream ifs(m_baselinePath);
+    if (!ifs.is_open()) {
+      std::fprintf(stderr, "Cannot open %s\n", m_baselinePath.c_str());
+      std::exit(1);
+    }
+    std::string line;
+    while (std::getline(ifs, line)) {
+      const char nameField[] = "\"name\": \"";
+      const char nsField[] = "\"p50_ns\": ";
+      size_t name = line.find(nameField);
+      size_t ns = line.find(nsField);
+      if (name == std::string::npos || ns == std::string::npos) {
+        continue;
+      }
+      name += sizeof(nameField) - 1;
+      size_t nameEnd = line.find('"', name);
+      baseline[line.substr(name, nameEnd - name)] = std::atof(line.c_str() + ns + sizeof(nsField) - 1);
+    }
+    return baseline;
+  }
+
+  int
+  compare() const
+  {
+    const std::map<std::string, double>& baseline = m_baseline;
+    size_t nRegressions = 0;
+    std::printf("\n%-40s %12s %12s %9s\n", "benchmark", "baseline p50", "p50", "change");
+    for (const Result& r : m_results) {
+      auto it = baseline.find(r.name);
+      if (it == baseline.end()) {
+        std::printf("%-40s %12s %12.2f\n", r.name.c_str(), "-", r.p50);
+        continue;
+      }
+      double change = r.p50 / it->second - 1;
+      bool isRegression = change > m_threshold;
+      nRegressions += isRegression;
+      std::printf("%-40s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), it->second, r.p50,
+                  100 * change, isRegression ? "  REGRESSION" : "");
+    }
+    if (nRegressions > 0) {
+      std::printf("\n%zu regressions over %.0f%%\n", nRegressions, 100 * m_threshold);
+      return 1;
+    }
+    return 0;
+  }
+
+private:
+  std::string m_filter;
+  std::string m_jsonPath;
+  std::string m_baselinePath;
+  double m_threshold = 0.1;
+  std::map<std::string, double> m_baseline;
+  std::vector<std::string> m_args;
+  std::vector<Result> m_results;
+};
+
+} // namespace bench
+
+#endif // CAROUSEL_BENCH_HARNESS_HPP
@@ -0,0 +1,82 @@
+/* Benchmark of the key types accepted by Carousel::log
+ *
+ * Logs a stream of IPv4 source addresses, either formatted as strings, passed as raw bytes or
+ * passed as integers. Most keys fall outside the current partition, so the cost is dominated by
+ * producing and hashing the key.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using carousel::Carousel;
+
+namespace {
+
+const size_t N_LOGS = 10000000;
+const size_t N_SOURCES = 1000000;
+const size_t MEMORY_SIZE = 10000;
+const size_t SAMPLE_SIZE = 1024;
+
+std::string
+formatAddress(uint32_t address)
+{
+  return std::to_string(address >> 24) + '.' + std::to_string((address >> 16) & 0xff) + '.' +
+         std::to_string((address >> 8) & 0xff) + '.' + std::to_string(address & 0xff);
+}
+
+template<typename Log>
+size_t
+run(bench::Suite& suite, const char* name, const std::vector<uint32_t>& addresses, Log log)
+{
+  size_t nLogged = 0;
+  Carousel carousel([&nLogged] (const std::string&, const std::string&) { nLogged++; },
+                    MEMORY_SIZE, std::chrono::milliseconds(1000));
+  const std::string entry = "alert";
+
+  suite.run(std::string("key/") + name, N_LOGS, SAMPLE_SIZE, [&] (size_t i) {
+    log(carousel, addresses[i % addresses.size()], entry);
+  });
+  return nLogged;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  std::minstd_rand rng(1);
+  std::vector<uint32_t> addresses(N_SOURCES);
+  for (uint32_t& address : addresses) {
+    address = (uint32_t(172) << 24) | (rng() & 0xffffff);
+  }
+
+  // The key types hash differently, so they log different sources, but about as many
+  size_t nLogged[3];
+  nLogged[0] = run(suite, "string", addresses,
+                   [] (Carousel& c, uint32_t address, const std::string& entry) {
+                     c.log(formatAddress(address), entry);
+                   });
+  nLogged[1] = run(suite, "bytes", addresses,
+                   [] (Carousel& c, uint32_t address, const std::string& entry) {
+                     c.log(reinterpret_cast<const char*>(&address), sizeof(address), entry);
+                   });
+  nLogged[2] = run(suite, "uint32", addresses,
+                   [] (Carousel& c, uint32_t address, const std::string& entry) {
+                     c.log(address, entry);
+                   });
+
+  const char* names[] = {"string", "bytes", "uint32"};
+  std::printf("\n%-10s %10s\n", "key", "logged");
+  for (size_t i = 0; i < 3; i++) {
+    std::printf("%-10s %10zu\n", names[i], nLogged[i]);
+  }
+  return suite.finish();
+}
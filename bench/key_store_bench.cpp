@@ -0,0 +1,108 @@
+/* Benchmark of the key set recording distinct keys in the frontend Logger
+ *
+ * Inserts distinct IPv4 addresses and IPv4 5-tuples into the flat KeyStore and into the
+ * std::unordered_set<std::string> it replaced, and reports inserts per second and bytes per key.
+ * Memory is measured as the growth of the heap in use, as reported by glibc.
+ */
+
+#include "harness.hpp"
+
+#include "key-store.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <malloc.h>
+
+using carousel::KeyStore;
+
+namespace {
+
+/**
+ * \brief Returns the number of heap bytes in use, including allocator overhead
+ */
+size_t
+heapInUse()
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+} // namespace
+
+namespace {
+
+std::string
+formatAddress(uint32_t address)
+{
+  return std::to_string(address >> 24) + '.' + std::to_string((address >> 16) & 0xff) + '.' +
+         std::to_string((address >> 8) & 0xff) + '.' + std::to_string(address & 0xff);
+}
+
+const size_t SAMPLE_SIZE = 1024;
+
+struct Footprint
+{
+  const char* set;
+  const char* keyKind;
+  size_t size;
+  size_t nBytes;
+};
+
+/**
+ * \brief Times inserting the keys, which are inserted even if this is filtered out, as the memory
+ *        per key is reported for every set
+ */
+template<typename Set>
+Footprint
+run(bench::Suite& suite, const char* name, const char* keyKind,
+    const std::vector<std::string>& keys)
+{
+  size_t heapBefore = heapInUse();
+  Set* set = new Set;
+  suite.runAlways(std::string("key-store/") + keyKind + "/" + name, keys.size(), SAMPLE_SIZE,
+                  [&] (size_t i) {
+                    set->insert(keys[i]);
+                  });
+  size_t allocated = heapInUse() - heapBefore;
+  Footprint footprint{name, keyKind, set->size(), allocated};
+  delete set;
+  return footprint;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[KEYS]");
+  size_t nKeys = suite.args().empty() ? 2000000
+                                      : std::strtoull(suite.args()[0].c_str(), nullptr, 10);
+  std::minstd_rand rng(1);
+  std::vector<std::string> addresses;
+  std::vector<std::string> tuples;
+  for (size_t i = 0; i < nKeys; i++) {
+    uint32_t address = (uint32_t(10) << 24) + static_cast<uint32_t>(i);
+    addresses.push_back(formatAddress(address));
+    tuples.push_back(formatAddress(address) + ':' + std::to_string(1024 + rng() % 60000) +
+                     "->172.31.64.106:443/6");
+  }
+
+  std::vector<Footprint> footprints = {
+    run<std::unordered_set<std::string>>(suite, "unordered_set", "ipv4", addresses),
+    run<KeyStore>(suite, "KeyStore", "ipv4", addresses),
+    run<std::unordered_set<std::string>>(suite, "unordered_set", "5-tuple", tuples),
+    run<KeyStore>(suite, "KeyStore", "5-tuple", tuples),
+  };
+
+  std::printf("\n%-14s %-8s %10s %12s\n", "set", "keys", "size", "bytes/key");
+  for (const Footprint& f : footprints) {
+    std::printf("%-14s %-8s %10zu %12.1f\n", f.set, f.keyKind, f.size,
+                static_cast<double>(f.nBytes) / f.size);
+  }
+  return suite.finish();
+}
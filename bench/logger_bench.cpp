@@ -0,0 +1,140 @@
+/* Benchmark of the latency producers see when submitting entries to a saturated Logger
+ *
+ * The logger drains one entry per millisecond, so its queue is full nearly all the time and
+ * most entries are dropped, which is the situation the packet path must not be slowed down by.
+ * The lock-free Logger is compared with the mutex-guarded deque it replaced.
+ */
+
+#include "harness.hpp"
+
+#include "logger.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using carousel::Logger;
+
+namespace {
+
+const size_t MEMORY_SIZE = 1024;
+const size_t LOGS_PER_THREAD = 1000000;
+
+/**
+ * \brief Producer side of the former Logger queue
+ */
+class LockedQueue
+{
+public:
+  void
+  log(const std::string& key, const std::string&)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    bool wasEmpty = m_queue.empty();
+    if (m_queue.size() < MEMORY_SIZE) {
+      m_queue.push_back(key);
+      if (wasEmpty) {
+        m_cond.notify_one();
+      }
+    }
+  }
+
+  void
+  drainOne()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_queue.empty()) {
+      m_queue.pop_front();
+    }
+  }
+
+private:
+  std::deque<std::string> m_queue;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+};
+
+/**
+ * \brief Times every log call of nThreads threads, reporting the wall clock time per call of all
+ *        of them together and the distribution of the latency of individual calls
+ */
+template<typename Log>
+void
+run(bench::Suite& suite, const std::string& name, size_t nThreads, Log log)
+{
+  if (!suite.isEnabled(name)) {
+    return;
+  }
+  std::vector<std::vector<float>> latencies(nThreads, std::vector<float>(LOGS_PER_THREAD));
+  std::vector<std::thread> threads;
+  bench::Stopwatch total;
+  for (size_t t = 0; t < nThreads; t++) {
+    threads.emplace_back([&, t] {
+      std::string key = "10.0.0." + std::to_string(t);
+      const std::string entry = "entry";
+      bench::Stopwatch stopwatch;
+      for (size_t i = 0; i < LOGS_PER_THREAD; i++) {
+        stopwatch.restart();
+        log(key, entry);
+        latencies[t][i] = stopwatch.elapsedNs();
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  double totalNs = total.elapsedNs();
+
+  std::vector<float> all;
+  for (const std::vector<float>& l : latencies) {
+    all.insert(all.end(), l.begin(), l.end());
+  }
+  suite.report(name, all.size(), totalNs, all);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[MAX_THREADS]");
+  size_t maxThreads = std::max(4u, std::thread::hardware_concurrency());
+  if (!suite.args().empty()) {
+    maxThreads = std::strtoull(suite.args()[0].c_str(), nullptr, 10);
+  }
+
+  // Powers of two, then maxThreads itself
+  for (size_t nThreads = 1; nThreads <= maxThreads;
+       nThreads = nThreads < maxThreads ? std::min(2 * nThreads, maxThreads) : 2 * nThreads) {
+    LockedQueue locked;
+    std::atomic<bool> stop(false);
+    std::thread drain([&] {
+      while (!stop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        locked.drainOne();
+      }
+    });
+    run(suite, "logger/locked/" + std::to_string(nThreads), nThreads,
+        [&] (const std::string& key, const std::string& entry) {
+          locked.log(key, entry);
+        });
+    stop = true;
+    drain.join();
+
+    Logger logger(MEMORY_SIZE, std::chrono::milliseconds(1));
+    logger.run();
+    run(suite, "logger/ring/" + std::to_string(nThreads), nThreads,
+        [&] (const std::string& key, const std::string& entry) {
+          logger.log(key, entry);
+        });
+    logger.stop();
+  }
+  return suite.finish();
+}
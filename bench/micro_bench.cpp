@@ -0,0 +1,203 @@
+/* Microbenchmark suite of the bloom filter, Carousel and the frontend Logger
+ *
+ * Covers Bloom::add and Bloom::isEvidenced at several filter sizes and both layouts, the paths of
+ * Carousel::log (admitted, duplicate within the phase, and outside the current partition, also
+ * with latency tracking enabled), phase transitions, and the enqueue and drain sides of Logger. See harness.hpp for the options, e.g.:
+ *
+ *   ./micro_bench --json new.json --baseline old.json
+ */
+
+#include "harness.hpp"
+
+#include "bloom.hpp"
+#include "carousel.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::Bloom;
+using carousel::Logger;
+using carousel::ManualClock;
+
+namespace {
+
+const size_t N_HASHES = 1 << 20;
+
+struct FlagSink
+{
+  void
+  operator()(const std::string&, const std::string&)
+  {
+    *admitted = true;
+  }
+
+  bool* admitted;
+};
+
+typedef BasicCarousel<FlagSink, ManualClock> BenchCarousel;
+
+std::vector<uint64_t>
+randomHashes(size_t n)
+{
+  std::mt19937_64 generator(42);
+  std::vector<uint64_t> hashes(n);
+  for (uint64_t& hash : hashes) {
+    hash = generator();
+  }
+  return hashes;
+}
+
+void
+benchBloom(bench::Suite& suite, const std::vector<uint64_t>& hashes)
+{
+  const size_t N_OPS = 4 << 20;
+  const size_t mask = hashes.size() - 1;
+  const char* sizeNames[] = {"64K", "1M", "16M", "128M"};
+  const size_t sizes[] = {64 << 10, 1 << 20, 16 << 20, 128 << 20};
+  for (Bloom::Layout layout : {Bloom::Layout::STANDARD, Bloom::Layout::BLOCKED}) {
+    const char* layoutName = layout == Bloom::Layout::STANDARD ? "standard" : "blocked";
+    for (size_t s = 0; s < 4; s++) {
+      std::string suffix = std::string("/") + layoutName + "/" + sizeNames[s];
+      Bloom bloom(sizes[s], layout);
+      // Only half of the hashes are added, so that half of the lookups are for absent keys
+      suite.run("bloom/add" + suffix, N_OPS, 64, [&] (size_t i) {
+        bloom.add(hashes[(i & mask) & ~size_t(1)]);
+      });
+      size_t nEvidenced = 0;
+      suite.run("bloom/isEvidenced" + suffix, N_OPS, 64, [&] (size_t i) {
+        nEvidenced += bloom.isEvidenced(hashes[i & mask]);
+      });
+      bench::doNotOptimize(nEvidenced);
+    }
+  }
+}
+
+void
+benchCarousel(bench::Suite& suite)
+{
+  const size_t N_OPS = 1 << 20;
+  const std::string entry = "entry";
+  bool admitted = false;
+
+  {
+    // A filter large enough that every distinct key is admitted
+    ManualClock clock;
+    BenchCarousel carousel(FlagSink{&admitted}, N_OPS * 2, std::chrono::milliseconds(1000),
+                           true, Bloom::Layout::STANDARD, clock);
+    suite.run("carousel/log/admitted", N_OPS, 1, [&] (size_t i) {
+      carousel.log(static_cast<uint64_t>(i), entry);
+    });
+    suite.run("carousel/log/duplicate", N_OPS, 1, [&] (size_t i) {
+      carousel.log(static_cast<uint64_t>(i), entry);
+    });
+  }
+
+  {
+    // A small filter overflows until each partition holds a small share of the keys; keys that
+    // are then not admitted fall outside the current partition, which does not change as long as
+    // the clock stands still and the filter does not overflow again
+    const size_t MEMORY_SIZE = 1000;
+    ManualClock clock;
+    BenchCarousel carousel(FlagSink{&admitted}, MEMORY_SIZE, std::chrono::milliseconds(1000),
+                           true, Bloom::Layout::STANDARD, clock);
+    uint64_t key = 0;
+    for (; key < N_OPS; key++) {
+      carousel.log(key, entry);
+    }
+    std::vector<uint64_t> missKeys;
+    while (missKeys.size() < N_OPS / 16) {
+      admitted = false;
+      carousel.log(key, entry);
+      if (!admitted) {
+        missKeys.push_back(key);
+      }
+      key++;
+    }
+    suite.run("carousel/log/miss", N_OPS, 1, [&] (size_t i) {
+      carousel.log(missKeys[i % missKeys.size()], entry);
+    });
+    carousel.setLatencyTracking(true);
+    suite.run("carousel/log/miss/latency-tracking", N_OPS, 1, [&] (size_t i) {
+      carousel.log(missKeys[i % missKeys.size()], entry);
+    });
+  }
+
+  {
+    const size_t MEMORY_SIZE = 1000;
+    const std::chrono::milliseconds interval(1);
+    ManualClock clock;
+    BenchCarousel carousel(FlagSink{&admitted}, MEMORY_SIZE, interval,
+                           true, Bloom::Layout::STANDARD, clock);
+    suite.run("carousel/log/phase-transition", N_OPS / 16, 1, [&] (size_t i) {
+      clock.advance(interval * MEMORY_SIZE);
+      carousel.log(static_cast<uint64_t>(i), entry);
+    });
+  }
+}
+
+void
+benchLogger(bench::Suite& suite)
+{
+  const size_t N_OPS = 1 << 18;
+  std::vector<std::string> keys(N_OPS);
+  for (size_t i = 0; i < N_OPS; i++) {
+    keys[i] = "192.168." + std::to_string(i >> 8) + "." + std::to_string(i & 0xff);
+  }
+  const std::string entry = "entry";
+
+  {
+    // The queue is not drained, and large enough to hold every entry
+    Logger logger(N_OPS, std::chrono::seconds(1));
+    suite.run("logger/enqueue", N_OPS, 1, [&] (size_t i) {
+      logger.log(keys[i], entry);
+    });
+  }
+
+  if (suite.isEnabled("logger/drain")) {
+    // The queue is filled and then drained without a rate limit; progress is sampled every
+    // DRAIN_SAMPLE entries by polling the number of recorded keys
+    const size_t DRAIN_SAMPLE = 1024;
+    Logger logger(N_OPS, std::chrono::nanoseconds(1));
+    for (size_t i = 0; i < N_OPS; i++) {
+      logger.log(keys[i], entry);
+    }
+    std::vector<double> samples;
+    auto start = std::chrono::steady_clock::now();
+    auto sampleStart = start;
+    size_t sampled = 0;
+    logger.run();
+    while (sampled < N_OPS) {
+      size_t recorded = logger.numRecordedKeys();
+      if (recorded - sampled >= DRAIN_SAMPLE || recorded == N_OPS) {
+        auto now = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::nano>(now - sampleStart).count() /
+                          (recorded - sampled));
+        sampleStart = now;
+        sampled = recorded;
+      }
+      else {
+        std::this_thread::yield();
+      }
+    }
+    logger.stop();
+    suite.report("logger/drain", N_OPS,
+                 std::chrono::duration<double, std::nano>(sampleStart - start).count(), samples);
+  }
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  benchBloom(suite, randomHashes(N_HASHES));
+  benchCarousel(suite);
+  benchLogger(suite);
+  return suite.finish();
+}
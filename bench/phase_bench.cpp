@@ -0,0 +1,112 @@
+/* Benchmark of the latency Carousel adds to the packet path across phase transitions
+ *
+ * The first part compares Bloom::reset against zeroing the same number of bits in place, which
+ * is what a phase change cost before resets were made incremental. The second part feeds
+ * Carousel a stream of distinct keys, so that its bloom filter overflows and the partitions are
+ * repeatedly redrawn, and reports the latency distribution of individual log() calls.
+ */
+
+#include "harness.hpp"
+
+#include "bloom.hpp"
+#include "carousel.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using carousel::Bloom;
+using carousel::Carousel;
+
+namespace {
+
+void
+benchReset(bench::Suite& suite, size_t memorySize)
+{
+  const size_t N_RESETS = 20;
+  Bloom bloom(memorySize * 10);
+  std::vector<uint64_t> zeroed(bloom.size() / 64);
+
+  std::vector<double> resetTimes;
+  std::vector<double> zeroTimes;
+  bench::Stopwatch stopwatch;
+  for (size_t i = 0; i < N_RESETS; i++) {
+    for (size_t j = 0; j < bloom.size() / 512; j++) {
+      bloom.clearStep();
+    }
+    stopwatch.restart();
+    bloom.reset();
+    resetTimes.push_back(stopwatch.elapsedNs());
+
+    stopwatch.restart();
+    std::memset(zeroed.data(), 0, zeroed.size() * sizeof(uint64_t));
+    zeroTimes.push_back(stopwatch.elapsedNs());
+  }
+  std::string prefix = "phase/" + std::to_string(memorySize);
+  double resetTotal = 0;
+  double zeroTotal = 0;
+  for (size_t i = 0; i < N_RESETS; i++) {
+    resetTotal += resetTimes[i];
+    zeroTotal += zeroTimes[i];
+  }
+  suite.report(prefix + "/reset", N_RESETS, resetTotal, resetTimes);
+  suite.report(prefix + "/zero", N_RESETS, zeroTotal, zeroTimes);
+}
+
+/**
+ * \brief Returns the number of keys admitted
+ */
+size_t
+benchLog(bench::Suite& suite, size_t memorySize, size_t nKeys)
+{
+  size_t nAdmitted = 0;
+  Carousel carousel([&nAdmitted] (const std::string&, const std::string&) { nAdmitted++; },
+                    memorySize, std::chrono::milliseconds(1000));
+
+  std::vector<float> latencies(nKeys);
+  double total = 0;
+  std::string entry = "entry";
+  bench::Stopwatch stopwatch;
+  for (size_t i = 0; i < nKeys; i++) {
+    std::string key = std::to_string(i);
+    stopwatch.restart();
+    carousel.log(key, entry);
+    latencies[i] = stopwatch.elapsedNs();
+    total += latencies[i];
+  }
+  suite.report("phase/" + std::to_string(memorySize) + "/log", nKeys, total, latencies);
+  return nAdmitted;
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[SOURCES...]");
+  std::vector<size_t> sizes = {10000, 100000, 1000000, 4000000};
+  if (!suite.args().empty()) {
+    sizes.clear();
+    for (const std::string& arg : suite.args()) {
+      sizes.push_back(std::strtoull(arg.c_str(), nullptr, 10));
+    }
+  }
+
+  for (size_t memorySize : sizes) {
+    benchReset(suite, memorySize);
+  }
+
+  std::vector<size_t> nAdmitted;
+  for (size_t memorySize : sizes) {
+    nAdmitted.push_back(benchLog(suite, memorySize, 8 * memorySize));
+  }
+
+  std::printf("\n%10s %10s %10s\n", "sources", "keys", "admitted");
+  for (size_t i = 0; i < sizes.size(); i++) {
+    std::printf("%10zu %10zu %10zu\n", sizes[i], 8 * sizes[i], nAdmitted[i]);
+  }
+  return suite.finish();
+}
@@ -0,0 +1,175 @@
+/* Benchmark comparing how fast Carousel follows a surge of new keys when choosing k stepwise and
+ * from a sketch of the number of distinct keys
+ *
+ * Carousel runs in virtual time, one millisecond per tick, with the enhanced behavior, a memory
+ * size of 1024 and a collection interval of 1 ms. Its sink is a queue of 1024 entries recording one entry per
+ * millisecond and dropping entries while full, like the frontend Logger. The trace logs 16 keys
+ * per tick out of 512 steady sources throughout; after 20 s, a scan adds 256 keys per tick out of
+ * 2^16 new sources (or 2^N, given N as argument) for 300 s, so that each of them arrives about four
+ * times per phase. Reported are the times after the scan started at which 50%, 90% and 99% of its
+ * sources were recorded, the overflows and entries dropped by the sink during the scan, and the
+ * time after the scan ended until k is back to its value before the scan.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::ManualClock;
+
+namespace {
+
+const size_t MEMORY_SIZE = 1024;
+const size_t STEADY_SOURCES = 512;
+const size_t STEADY_RATE = 16; // keys per tick
+const size_t SCAN_RATE = 256; // keys per tick
+const uint64_t SCAN_BASE = 1 << 20; // first key of the scan, above the steady sources
+const uint64_t SCAN_START = 20000; // in ticks
+const uint64_t SCAN_DURATION = 300000;
+const uint64_t COOLDOWN = 30000;
+
+/**
+ * \brief Bounded queue recording one entry per tick, and which scan sources it recorded
+ */
+struct QueueSink
+{
+  void
+  operator()(const std::string& key, const std::string&)
+  {
+    if (queue->size() >= MEMORY_SIZE) {
+      (*nDropped)++;
+      return;
+    }
+    queue->push_back(std::stoull(key));
+  }
+
+  std::deque<uint64_t>* queue;
+  size_t* nDropped;
+};
+
+struct Result
+{
+  double coverageTimes[3] = {-1, -1, -1}; // in seconds after the scan started
+  uint64_t nOverflows = 0;
+  size_t nDropped = 0;
+  size_t kBefore = 0;
+  size_t kPeak = 0;
+  double settleTime = -1; // in seconds after the scan ended
+};
+
+/**
+ * \brief Runs the trace, reporting the wall clock time per key logged, which includes the
+ *        simulated sink
+ */
+Result
+run(bench::Suite& suite, size_t scanSources, bool isSketched)
+{
+  const double COVERAGE_TARGETS[3] = {0.5, 0.9, 0.99};
+
+  std::deque<uint64_t> queue;
+  size_t nDropped = 0;
+  ManualClock clock;
+  BasicCarousel<QueueSink, ManualClock> carousel(QueueSink{&queue, &nDropped}, MEMORY_SIZE,
+                                                 std::chrono::milliseconds(1), false,
+                                                 carousel::Bloom::Config(), clock);
+  carousel.setCardinalityRepartitioning(isSketched);
+
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<uint64_t> steady(0, STEADY_SOURCES - 1);
+  std::uniform_int_distribution<uint64_t> scan(0, scanSources - 1);
+  std::vector<bool> seen(scanSources);
+  size_t nSeen = 0;
+  size_t nextTarget = 0;
+
+  Result result;
+  uint64_t overflowsBefore = 0;
+  size_t droppedBefore = 0;
+  const std::string entry;
+  const uint64_t end = SCAN_START + SCAN_DURATION + COOLDOWN;
+  bench::Stopwatch stopwatch;
+  for (uint64_t t = 0; t < end; t++) {
+    bool isScanning = t >= SCAN_START && t < SCAN_START + SCAN_DURATION;
+    if (t == SCAN_START) {
+      result.kBefore = carousel.stats().k;
+      overflowsBefore = carousel.stats().nOverflows;
+      droppedBefore = nDropped;
+    }
+    if (t == SCAN_START + SCAN_DURATION) {
+      result.nOverflows = carousel.stats().nOverflows - overflowsBefore;
+      result.nDropped = nDropped - droppedBefore;
+    }
+
+    for (size_t i = 0; i < STEADY_RATE; i++) {
+      carousel.log(steady(generator), entry);
+    }
+    if (isScanning) {
+      for (size_t i = 0; i < SCAN_RATE; i++) {
+        carousel.log(SCAN_BASE + scan(generator), entry);
+      }
+      result.kPeak = std::max(result.kPeak, carousel.stats().k);
+    }
+
+    // The sink records one entry per tick
+    if (!queue.empty()) {
+      uint64_t key = queue.front();
+      queue.pop_front();
+      if (key >= SCAN_BASE && !seen[key - SCAN_BASE]) {
+        seen[key - SCAN_BASE] = true;
+        nSeen++;
+        while (nextTarget < 3 && nSeen >= COVERAGE_TARGETS[nextTarget] * scanSources) {
+          result.coverageTimes[nextTarget++] = (t - SCAN_START) / 1000.0;
+        }
+      }
+    }
+
+    if (t >= SCAN_START + SCAN_DURATION && result.settleTime < 0 &&
+        carousel.stats().k <= result.kBefore) {
+      result.settleTime = (t - SCAN_START - SCAN_DURATION) / 1000.0;
+    }
+    clock.advance(std::chrono::milliseconds(1));
+  }
+  suite.report(std::string("repartition/") + (isSketched ? "sketch" : "stepwise"),
+               end * STEADY_RATE + SCAN_DURATION * SCAN_RATE, stopwatch.elapsedNs());
+  return result;
+}
+
+void
+report(const char* name, const Result& result)
+{
+  std::printf("%-10s %8.1f %8.1f %8.1f %10zu %10zu %8zu %8zu %10.1f\n", name,
+              result.coverageTimes[0], result.coverageTimes[1], result.coverageTimes[2],
+              static_cast<size_t>(result.nOverflows), result.nDropped, result.kBefore,
+              result.kPeak, result.settleTime);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[SCAN_BITS]");
+  unsigned scanBits = 16;
+  if (!suite.args().empty()) {
+    scanBits = std::strtoul(suite.args()[0].c_str(), nullptr, 10);
+  }
+  size_t scanSources = size_t(1) << scanBits;
+
+  Result stepwise = run(suite, scanSources, false);
+  Result sketch = run(suite, scanSources, true);
+
+  // Times are in seconds; -1 if never reached
+  std::printf("\nscan of %zu sources\n", scanSources);
+  std::printf("%-10s %8s %8s %8s %10s %10s %8s %8s %10s\n", "variant", "50%", "90%", "99%",
+              "overflows", "dropped", "k before", "k peak", "settle");
+  report("stepwise", stepwise);
+  report("sketch", sketch);
+  return suite.finish();
+}
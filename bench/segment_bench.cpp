@@ -0,0 +1,178 @@
+/* Benchmark of the durable segment sink
+ *
+ * Appends entries of several sizes to a SegmentSink as fast as possible and reports the rate of
+ * appends and bytes, with group commits running in the background. Then feeds a Carousel logging
+ * into a SegmentSink with distinct keys, and compares the rate of records on disk with the rate
+ * the collection interval calls for. Each run is read back with SegmentReader.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+#include "segment-sink.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <unistd.h>
+
+using carousel::Carousel;
+using carousel::SegmentReader;
+using carousel::SegmentRecord;
+using carousel::SegmentSink;
+
+namespace {
+
+const std::chrono::milliseconds DURATION(1000);
+const size_t SEGMENT_SIZE = 64 << 20;
+
+std::string
+makeDirectory()
+{
+  char path[] = "/tmp/segment_bench.XXXXXX";
+  if (mkdtemp(path) == nullptr) {
+    std::perror("mkdtemp");
+    std::exit(1);
+  }
+  return path;
+}
+
+void
+removeDirectory(const std::string& directory)
+{
+  DIR* dir = opendir(directory.c_str());
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.') {
+      unlink((directory + "/" + entry->d_name).c_str());
+    }
+  }
+  closedir(dir);
+  rmdir(directory.c_str());
+}
+
+struct Throughput
+{
+  const char* run;
+  size_t entrySize;
+  double recordsPerSecond;
+  double writeBytesPerSecond;
+  double readBytesPerSecond;
+};
+
+/**
+ * \brief Reads back all records of a directory, reporting the time per record, and returns the
+ *        rate at which their bytes were read
+ */
+double
+readBack(bench::Suite& suite, const std::string& name, const std::string& directory,
+         uint64_t expectedRecords)
+{
+  bench::Stopwatch stopwatch;
+  SegmentReader reader(directory);
+  SegmentRecord record;
+  uint64_t nRecords = 0;
+  uint64_t nBytes = 0;
+  while (reader.next(record)) {
+    nRecords++;
+    nBytes += record.keyLength + record.entryLength;
+  }
+  double elapsedNs = stopwatch.elapsedNs();
+  if (nRecords != expectedRecords || reader.numDamagedSegments() != 0) {
+    std::fprintf(stderr, "read back %llu records out of %llu, %zu damaged segments\n",
+                 static_cast<unsigned long long>(nRecords),
+                 static_cast<unsigned long long>(expectedRecords), reader.numDamagedSegments());
+    std::exit(1);
+  }
+  suite.report(name, nRecords, elapsedNs);
+  return nBytes / elapsedNs * 1e9;
+}
+
+/**
+ * \brief Reports the time per append, including the final sync
+ */
+Throughput
+runAppend(bench::Suite& suite, size_t entrySize)
+{
+  std::string directory = makeDirectory();
+  const std::string entry(entrySize, 'x');
+  uint64_t nRecords;
+  double bytesPerSecond;
+  bench::Stopwatch stopwatch;
+  {
+    SegmentSink sink(directory, SEGMENT_SIZE);
+    for (size_t i = 0; stopwatch.elapsedNs() < DURATION.count() * 1e6; i++) {
+      for (size_t j = 0; j < 1000; j++) {
+        sink.append(std::to_string(i * 1000 + j), entry);
+      }
+    }
+    sink.sync();
+    nRecords = sink.numRecords();
+    bytesPerSecond = sink.bytesPerSecond();
+  }
+  double elapsedNs = stopwatch.elapsedNs();
+  std::string prefix = "segment/" + std::to_string(entrySize);
+  suite.report(prefix + "/append", nRecords, elapsedNs);
+  double readRate = readBack(suite, prefix + "/read", directory, nRecords);
+  removeDirectory(directory);
+  return Throughput{"append", entrySize, nRecords / elapsedNs * 1e9, bytesPerSecond, readRate};
+}
+
+/**
+ * \brief Reports the time per key logged into Carousel, most of which are not passed to the sink
+ */
+Throughput
+runCarousel(bench::Suite& suite, size_t memorySize, std::chrono::milliseconds interval)
+{
+  std::string directory = makeDirectory();
+  const std::string entry(200, 'x');
+  uint64_t nLogs = 0;
+  uint64_t nRecords;
+  double bytesPerSecond;
+  double elapsedNs;
+  {
+    SegmentSink sink(directory, SEGMENT_SIZE);
+    Carousel carousel(std::ref(sink), memorySize, interval);
+    bench::Stopwatch stopwatch;
+    for (size_t i = 0; stopwatch.elapsedNs() < DURATION.count() * 1e6; i++) {
+      for (size_t j = 0; j < 1000; j++) {
+        carousel.log(std::to_string(i * 1000 + j), entry);
+      }
+      nLogs += 1000;
+    }
+    sink.sync();
+    elapsedNs = stopwatch.elapsedNs();
+    nRecords = sink.numRecords();
+    bytesPerSecond = sink.bytesPerSecond();
+  }
+  suite.report("segment/carousel/log", nLogs, elapsedNs);
+  double readRate = readBack(suite, "segment/carousel/read", directory, nRecords);
+  removeDirectory(directory);
+  return Throughput{"carousel", entry.size(), nRecords / elapsedNs * 1e9, bytesPerSecond,
+                    readRate};
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  const std::chrono::milliseconds interval(1);
+  std::vector<Throughput> throughputs = {runAppend(suite, 32), runAppend(suite, 256),
+                                         runAppend(suite, 4096),
+                                         runCarousel(suite, 1000, interval)};
+
+  std::printf("\n%-10s %8s %14s %12s %12s\n", "run", "entry B", "records/s", "write MB/s",
+              "read MB/s");
+  for (const Throughput& t : throughputs) {
+    std::printf("%-10s %8zu %14.0f %12.3f %12.1f\n", t.run, t.entrySize, t.recordsPerSecond,
+                t.writeBytesPerSecond / 1e6, t.readBytesPerSecond / 1e6);
+  }
+  std::printf("Carousel targets %.0f records/s\n", 1e3 / interval.count());
+  return suite.finish();
+}
@@ -0,0 +1,101 @@
+/* Benchmark of eager and lazy entry formatting with type-erased and inlined sinks
+ *
+ * Each packet carries an alert record that is formatted into an entry. The eager variants format
+ * it for every packet, as the entry is an argument of log; the lazy ones only format it for the
+ * packets Carousel admits.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::Carousel;
+
+namespace {
+
+const size_t N_LOGS = 5000000;
+const size_t N_SOURCES = 1000000;
+const size_t MEMORY_SIZE = 10000;
+const size_t SAMPLE_SIZE = 1024;
+
+struct CountingSink
+{
+  void
+  operator()(const std::string&, const std::string& entry)
+  {
+    nLogged++;
+    nBytes += entry.size();
+  }
+
+  size_t nLogged = 0;
+  size_t nBytes = 0;
+};
+
+std::string
+formatAlert(uint32_t source, size_t sequence)
+{
+  char buf[128];
+  int len = std::snprintf(buf, sizeof(buf),
+                          "alert seq=%zu src=%u.%u.%u.%u sig=ET SCAN Potential SSH Scan sev=2",
+                          sequence, source >> 24, (source >> 16) & 0xff, (source >> 8) & 0xff,
+                          source & 0xff);
+  return std::string(buf, len);
+}
+
+template<typename C, typename Log>
+void
+run(bench::Suite& suite, const char* name, C& carousel, const std::vector<uint32_t>& sources,
+    Log log)
+{
+  suite.run(std::string("sink/") + name, N_LOGS, SAMPLE_SIZE, [&] (size_t i) {
+    log(carousel, sources[i % sources.size()], i);
+  });
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv);
+  std::minstd_rand rng(1);
+  std::vector<uint32_t> sources(N_SOURCES);
+  for (uint32_t& source : sources) {
+    source = (uint32_t(10) << 24) | (rng() & 0xffffff);
+  }
+  const std::chrono::milliseconds interval(1000);
+
+  CountingSink erasedSink;
+  Carousel erased(std::ref(erasedSink), MEMORY_SIZE, interval);
+  run(suite, "function/eager", erased, sources,
+      [] (Carousel& c, uint32_t source, size_t seq) {
+        c.log(source, formatAlert(source, seq));
+      });
+
+  Carousel erasedLazy(std::ref(erasedSink), MEMORY_SIZE, interval);
+  run(suite, "function/lazy", erasedLazy, sources,
+      [] (Carousel& c, uint32_t source, size_t seq) {
+        c.log(source, [=] { return formatAlert(source, seq); });
+      });
+
+  typedef BasicCarousel<CountingSink> InlineCarousel;
+  InlineCarousel inlined(CountingSink(), MEMORY_SIZE, interval);
+  run(suite, "inline/eager", inlined, sources,
+      [] (InlineCarousel& c, uint32_t source, size_t seq) {
+        c.log(source, formatAlert(source, seq));
+      });
+
+  InlineCarousel inlinedLazy(CountingSink(), MEMORY_SIZE, interval);
+  run(suite, "inline/lazy", inlinedLazy, sources,
+      [] (InlineCarousel& c, uint32_t source, size_t seq) {
+        c.log(source, [=] { return formatAlert(source, seq); });
+      });
+  return suite.finish();
+}
@@ -0,0 +1,178 @@
+/* Benchmark of saving and restoring Carousel snapshots, and of the coverage they preserve across
+ * a restart
+ *
+ * The first part fills the filter of a Carousel of several memory sizes, and reports the time to
+ * save a snapshot, the time to restore it while the file is in the page cache, and its size. The
+ * second part runs Carousel in virtual time, one millisecond per tick, on 2^16 keys logged 256
+ * times per tick, with a memory size of 1024 and a collection interval of 1 ms. After 30 s, it
+ * restarts Carousel, either cold or from a snapshot taken at that time, and keeps logging for
+ * 10 s. Reported for both are the overflows after the restart, the entries logged for keys which
+ * had been logged less than a phase duration before, which a running instance would have
+ * suppressed, and the entries logged in the first phase duration after the restart.
+ */
+
+#include "harness.hpp"
+
+#include "carousel.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using carousel::BasicCarousel;
+using carousel::ManualClock;
+using carousel::SnapshotResult;
+
+namespace {
+
+const char SNAPSHOT_PATH[] = "snapshot_bench.snap";
+const size_t N_SAVES = 10;
+
+struct SnapshotSize
+{
+  size_t memorySize;
+  size_t nBytes;
+  bool isRestored;
+};
+
+/**
+ * \brief Times saving the snapshot of a full filter, and restoring it while the file is in the page
+ *        cache
+ */
+SnapshotSize
+benchSaveRestore(bench::Suite& suite, size_t memorySize)
+{
+  size_t nLogged = 0;
+  carousel::LogCallback sink = [&nLogged] (const std::string&, const std::string&) { nLogged++; };
+  carousel::Carousel source(sink, memorySize, std::chrono::milliseconds(1000));
+  const std::string entry;
+  for (uint64_t key = 0; key < memorySize; key++) {
+    source.log(key, entry);
+  }
+
+  std::string prefix = "snapshot/" + std::to_string(memorySize);
+  // The restores need a snapshot, whether or not saving it is timed
+  suite.runAlways(prefix + "/save", N_SAVES, 1, [&] (size_t) {
+    source.saveSnapshot(SNAPSHOT_PATH);
+  });
+
+  carousel::Carousel restored(sink, memorySize, std::chrono::milliseconds(1000));
+  bool isRestored = true;
+  suite.runAlways(prefix + "/restore", N_SAVES, 1, [&] (size_t) {
+    isRestored &= restored.restoreSnapshot(SNAPSHOT_PATH) == SnapshotResult::RESTORED;
+  });
+
+  struct stat st;
+  size_t bytes = stat(SNAPSHOT_PATH, &st) == 0 ? st.st_size : 0;
+  return SnapshotSize{memorySize, bytes, isRestored};
+}
+
+const size_t MEMORY_SIZE = 1024;
+const size_t N_KEYS = 1 << 16;
+const size_t RATE = 256; // keys per tick
+const uint64_t RESTART = 30000; // in ticks
+const uint64_t AFTER_RESTART = 10000;
+
+struct TimedSink
+{
+  void
+  operator()(const std::string& key, const std::string&)
+  {
+    uint64_t id = std::stoull(key);
+    if (*now >= RESTART) {
+      (*nAfterRestart)++;
+      if (*now < RESTART + MEMORY_SIZE) {
+        (*nFirstPhase)++;
+      }
+      if ((*lastLogged)[id] != 0 && *now - (*lastLogged)[id] < MEMORY_SIZE) {
+        (*nPremature)++;
+      }
+    }
+    (*lastLogged)[id] = *now;
+  }
+
+  const uint64_t* now;
+  std::vector<uint64_t>* lastLogged;
+  size_t* nAfterRestart;
+  size_t* nFirstPhase;
+  size_t* nPremature;
+};
+
+typedef BasicCarousel<TimedSink, ManualClock> Instance;
+
+void
+runRestart(bool isWarm)
+{
+  uint64_t now = 1; // ticks start at 1 so that 0 marks keys never logged
+  std::vector<uint64_t> lastLogged(N_KEYS);
+  size_t nAfterRestart = 0;
+  size_t nFirstPhase = 0;
+  size_t nPremature = 0;
+  TimedSink sink{&now, &lastLogged, &nAfterRestart, &nFirstPhase, &nPremature};
+
+  ManualClock clock;
+  std::unique_ptr<Instance> instance(new Instance(sink, MEMORY_SIZE, std::chrono::milliseconds(1),
+                                                  false, carousel::Bloom::Config(), clock));
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<uint64_t> keys(0, N_KEYS - 1);
+  const std::string entry;
+  uint64_t overflowsAtRestart = 0;
+  for (; now < RESTART + AFTER_RESTART; now++) {
+    if (now == RESTART) {
+      if (isWarm) {
+        instance->saveSnapshot(SNAPSHOT_PATH);
+      }
+      // The new process has a clock of its own
+      clock = ManualClock();
+      instance.reset(new Instance(sink, MEMORY_SIZE, std::chrono::milliseconds(1), false,
+                                  carousel::Bloom::Config(), clock));
+      if (isWarm && instance->restoreSnapshot(SNAPSHOT_PATH) != SnapshotResult::RESTORED) {
+        std::printf("restore failed\n");
+      }
+      overflowsAtRestart = instance->stats().nOverflows;
+    }
+    for (size_t i = 0; i < RATE; i++) {
+      instance->log(keys(generator), entry);
+    }
+    clock.advance(std::chrono::milliseconds(1));
+  }
+
+  std::printf("%-8s %10zu %10zu %12zu %12zu\n", isWarm ? "warm" : "cold",
+              static_cast<size_t>(instance->stats().nOverflows - overflowsAtRestart),
+              nPremature, nFirstPhase, nAfterRestart);
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+  bench::Suite suite(argc, argv, "[MEMORY_SIZE]");
+  std::vector<size_t> sizes = {10000, 100000, 1000000};
+  if (!suite.args().empty()) {
+    sizes.assign(1, std::strtoul(suite.args()[0].c_str(), nullptr, 10));
+  }
+
+  std::vector<SnapshotSize> snapshotSizes;
+  for (size_t memorySize : sizes) {
+    snapshotSizes.push_back(benchSaveRestore(suite, memorySize));
+  }
+  std::printf("\n%10s %12s %10s\n", "memory", "bytes", "restored");
+  for (const SnapshotSize& s : snapshotSizes) {
+    std::printf("%10zu %12zu %10s\n", s.memorySize, s.nBytes, s.isRestored ? "yes" : "no");
+  }
+
+  std::printf("\n%-8s %10s %10s %12s %12s\n", "restart", "overflows", "premature",
+              "first phase", "logged");
+  runRestart(false);
+  runRestart(true);
+  unlink(SNAPSHOT_PATH);
+  return suite.finish();
+}
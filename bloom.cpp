@@ -2,187 +2,397 @@
  */
 
 #include "bloom.hpp"
+#include "hash.hpp"
 
-#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace carousel {
 
-Bloom::Bloom(size_t nBits)
-  : m_nBits(nBits)
-  , m_bits(nBits, false)
+namespace {
+
+const size_t CACHE_LINE_SIZE = 64;
+
+size_t
+roundUpToPowerOfTwo(size_t n)
+{
+  size_t p = 512;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+size_t
+nBitsFor(const Bloom::Config& config, size_t nKeys)
+{
+  return static_cast<size_t>(std::ceil(config.bitsPerKey * nKeys));
+}
+
+inline void
+setProbes(uint64_t* words, size_t mask, uint64_t hash, size_t nHashes)
+{
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  for (size_t i = 0; i < nHashes; i++) {
+    size_t bit = h1 & mask;
+    words[bit >> 6] |= uint64_t(1) << (bit & 63);
+    h1 += h2;
+  }
+}
+
+inline bool
+testProbes(const uint64_t* words, size_t mask, uint64_t hash, size_t nHashes)
+{
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  for (size_t i = 0; i < nHashes; i++) {
+    size_t bit = h1 & mask;
+    if ((words[bit >> 6] & (uint64_t(1) << (bit & 63))) == 0) {
+      return false;
+    }
+    h1 += h2;
+  }
+  return true;
+}
+
+#if defined(__AVX2__)
+
+/**
+ * \brief Computes the masks selecting one bit in each 64-bit word of a block
+ */
+inline void
+blockMask(uint32_t x, __m256i& lo, __m256i& hi)
+{
+  const __m256i salts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(detail::BLOCK_SALTS));
+  __m256i pos = _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_set1_epi32(x), salts), 26);
+  const __m256i one = _mm256_set1_epi64x(1);
+  lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(pos)));
+  hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(pos, 1)));
+}
+
+#elif defined(__SSE2__)
+
+inline uint64_t
+laneMask(uint32_t x, size_t i)
+{
+  return uint64_t(1) << ((x * detail::BLOCK_SALTS[i]) >> 26);
+}
+
+/**
+ * \brief Computes the masks selecting one bit in each 64-bit word of a block
+ */
+inline void
+blockMask(uint32_t x, __m128i* mask)
+{
+  for (size_t i = 0; i < 4; i++) {
+    mask[i] = _mm_set_epi64x(laneMask(x, 2 * i + 1), laneMask(x, 2 * i));
+  }
+}
+
+#else
+
+inline void
+blockMask(uint32_t x, uint64_t* mask)
 {
+  for (size_t i = 0; i < 8; i++) {
+    mask[i] = uint64_t(1) << ((x * detail::BLOCK_SALTS[i]) >> 26);
+  }
+}
+
+#endif
+
+} // namespace
+
+void
+Bloom::FreeDeleter::operator()(uint64_t* p) const
+{
+  std::free(p);
+}
+
+Bloom::Config
+Bloom::Config::forFalsePositiveRate(double rate, Layout layout)
+{
+  if (!(rate > 0 && rate < 1)) {
+    throw std::invalid_argument("bloom filter false positive rate must be between 0 and 1");
+  }
+  const double ln2 = std::log(2.0);
+  if (layout == Layout::STANDARD) {
+    // Optimal size of a standard bloom filter, m / n = -ln(p) / ln(2)^2
+    return forBitsPerKey(-std::log(rate) / (ln2 * ln2), layout);
+  }
+
+  // There is no closed form for the blocked layout, which needs more bits for the same rate, so
+  // the size is found by bisection on the expected rate of a large filter
+  const size_t N_KEYS = 1 << 20;
+  double low = 1;
+  double high = 256;
+  for (int i = 0; i < 40; i++) {
+    double middle = (low + high) / 2;
+    size_t nBits = static_cast<size_t>(middle * N_KEYS);
+    if (expectedFalsePositiveRate(nBits, layout, WORDS_PER_BLOCK, N_KEYS) > rate) {
+      low = middle;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return forBitsPerKey(high, layout);
+}
+
+Bloom::Config
+Bloom::Config::forBitsPerKey(double bitsPerKey, Layout layout)
+{
+  if (!(bitsPerKey > 0 && std::isfinite(bitsPerKey))) {
+    throw std::invalid_argument("bloom filter bits per key must be positive");
+  }
+  Config config(layout);
+  config.bitsPerKey = bitsPerKey;
+  // Optimal number of hashes, k = m / n * ln(2)
+  double nHashes = std::round(bitsPerKey * std::log(2.0));
+  config.nHashes = static_cast<size_t>(std::min(32.0, std::max(1.0, nHashes)));
+  return config;
+}
+
+Bloom::Bloom(const Config& config, size_t nKeys)
+  : Bloom(nBitsFor(config, nKeys), config.layout, config.nHashes, nullptr)
+{
+}
+
+Bloom::Bloom(const Config& config, size_t nKeys, uint64_t* storage)
+  : Bloom(nBitsFor(config, nKeys), config.layout, config.nHashes, storage)
+{
+}
+
+Bloom::Bloom(size_t nBits, Layout layout, size_t nHashes)
+  : Bloom(nBits, layout, nHashes, nullptr)
+{
+}
+
+Bloom::Bloom(size_t nBits, Layout layout, size_t nHashes, uint64_t* storage)
+  : m_layout(layout)
+  , m_nHashes(std::max<size_t>(1, nHashes))
+  , m_mask(roundUpToPowerOfTwo(nBits) - 1)
+  , m_blockMask((m_mask + 1) / (WORDS_PER_BLOCK * 64) - 1)
+  , m_nWords((m_mask + 1) / 64)
+{
+  if (storage == nullptr) {
+    void* p = nullptr;
+    if (posix_memalign(&p, CACHE_LINE_SIZE, 2 * m_nWords * sizeof(uint64_t)) != 0) {
+      throw std::bad_alloc();
+    }
+    m_storage.reset(static_cast<uint64_t*>(p));
+    std::memset(m_storage.get(), 0, 2 * m_nWords * sizeof(uint64_t));
+    storage = m_storage.get();
+  }
+  m_words = storage;
+  m_retired = storage + m_nWords;
+  m_clearCursor = m_nWords;
+}
+
+size_t
+Bloom::storageWords(const Config& config, size_t nKeys)
+{
+  return 2 * roundUpToPowerOfTwo(nBitsFor(config, nKeys)) / 64;
 }
 
 void
 Bloom::add(const std::string& key)
 {
-  m_bits[hash1(key)] = true;
-  m_bits[hash2(key)] = true;
-  m_bits[hash3(key)] = true;
-  m_bits[hash4(key)] = true;
-  m_bits[hash5(key)] = true;
+  add(hashKey(key));
+}
+
+void
+Bloom::add(uint64_t hash)
+{
+  if (m_layout == Layout::BLOCKED) {
+    addBlocked(hash);
+    return;
+  }
+
+  // The default number of hashes is passed as a constant, so that its loop can be unrolled
+  if (m_nHashes == DEFAULT_N_HASHES) {
+    setProbes(m_words, m_mask, hash, DEFAULT_N_HASHES);
+  }
+  else {
+    setProbes(m_words, m_mask, hash, m_nHashes);
+  }
 }
 
 bool
 Bloom::isEvidenced(const std::string& key) const
 {
-  return m_bits[hash1(key)] &&
-         m_bits[hash2(key)] &&
-         m_bits[hash3(key)] &&
-         m_bits[hash4(key)] &&
-         m_bits[hash5(key)];
+  return isEvidenced(hashKey(key));
+}
+
+bool
+Bloom::isEvidenced(uint64_t hash) const
+{
+  if (m_layout == Layout::BLOCKED) {
+    return isEvidencedBlocked(hash);
+  }
+
+  if (m_nHashes == DEFAULT_N_HASHES) {
+    return testProbes(m_words, m_mask, hash, DEFAULT_N_HASHES);
+  }
+  return testProbes(m_words, m_mask, hash, m_nHashes);
+}
+
+void
+Bloom::prefetch(uint64_t hash) const
+{
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  if (m_layout == Layout::BLOCKED) {
+    __builtin_prefetch(m_words + (h1 & m_blockMask) * WORDS_PER_BLOCK);
+    return;
+  }
+
+  for (size_t i = 0; i < m_nHashes; i++) {
+    __builtin_prefetch(m_words + ((h1 & m_mask) >> 6));
+    h1 += h2;
+  }
 }
 
 void
 Bloom::reset()
 {
-  m_bits.clear();
-  m_bits.assign(m_nBits, false);
+  if (m_clearCursor < m_nWords) {
+    std::memset(m_retired + m_clearCursor, 0, (m_nWords - m_clearCursor) * sizeof(uint64_t));
+  }
+  std::swap(m_words, m_retired);
+  m_clearCursor = 0;
 }
 
-size_t
-Bloom::hash1(const std::string& key) const
-{
-  // Implementation of SDBM hash function derived from http://www.partow.net/programming/hashfunctions/
-  // Copyright 2002 Arash Partow
-  //
-  // Permission is hereby granted, free of charge, to any person obtaining a copy of this software
-  // and associated documentation files (the "Software"), to deal in the Software without
-  // restriction, including without limitation the rights to use, copy, modify, merge, publish,
-  // distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
-  // Software is furnished to do so, subject to the following conditions:
-  //
-  // The above copyright notice and this permission notice shall be included in all copies or
-  // substantial portions of the Software.
-  //
-  // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
-  // BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-  // NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
-  // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-  // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-  size_t hash = 0;
-  for (size_t i = 0; i < key.size(); i++)
-  {
-    hash = static_cast<uint8_t>(key[i]) + (hash << 6) + (hash << 16) - hash;
-  }
-  return hash % m_nBits;
+void
+Bloom::loadWords(const uint64_t* words)
+{
+  std::memcpy(m_words, words, m_nWords * sizeof(uint64_t));
 }
 
-size_t
-Bloom::hash2(const std::string& key) const
-{
-  // Implementation of DJP hash function derived from http://www.partow.net/programming/hashfunctions/
-  // Copyright 2002 Arash Partow
-  //
-  // Permission is hereby granted, free of charge, to any person obtaining a copy of this software
-  // and associated documentation files (the "Software"), to deal in the Software without
-  // restriction, including without limitation the rights to use, copy, modify, merge, publish,
-  // distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
-  // Software is furnished to do so, subject to the following conditions:
-  //
-  // The above copyright notice and this permission notice shall be included in all copies or
-  // substantial portions of the Software.
-  //
-  // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
-  // BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-  // NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
-  // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-  // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-  size_t hash = 5381;
-  for (size_t i = 0; i < key.size(); i++) {
-    hash = ((hash << 5) + hash) + static_cast<uint8_t>(key[i]);
-  }
-  return hash % m_nBits;
+double
+Bloom::expectedFalsePositiveRate(size_t nKeys) const
+{
+  return expectedFalsePositiveRate(size(), m_layout, m_nHashes, nKeys);
 }
 
-size_t
-Bloom::hash3(const std::string& key) const
-{
-  // Implementation of DEK hash function derived from http://www.partow.net/programming/hashfunctions/
-  // Copyright 2002 Arash Partow
-  //
-  // Permission is hereby granted, free of charge, to any person obtaining a copy of this software
-  // and associated documentation files (the "Software"), to deal in the Software without
-  // restriction, including without limitation the rights to use, copy, modify, merge, publish,
-  // distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
-  // Software is furnished to do so, subject to the following conditions:
-  //
-  // The above copyright notice and this permission notice shall be included in all copies or
-  // substantial portions of the Software.
-  //
-  // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
-  // BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-  // NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
-  // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-  // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-  size_t hash = key.size();
-  for (size_t i = 0; i < key.size(); i++) {
-    hash = ((hash << 5) ^ (hash >> 27)) ^ static_cast<uint8_t>(key[i]);
-  }
-  return hash % m_nBits;
+double
+Bloom::expectedFalsePositiveRate(size_t nBits, Layout layout, size_t nHashes, size_t nKeys)
+{
+  if (layout == Layout::STANDARD) {
+    // (1 - e^(-kn/m))^k
+    double k = static_cast<double>(std::max<size_t>(1, nHashes));
+    return std::pow(1 - std::exp(-k * nKeys / nBits), k);
+  }
+
+  // Keys spread over blocks following a Poisson distribution, and within a block of load i,
+  // each of the 8 words has a given bit set with probability 1 - (1 - 1/64)^i
+  const double bitsPerBlock = WORDS_PER_BLOCK * 64;
+  double lambda = nKeys * bitsPerBlock / nBits;
+  if (lambda == 0) {
+    return 0;
+  }
+  // Loads more than 10 standard deviations away from the mean are negligible
+  double spread = 10 * std::sqrt(lambda) + 20;
+  double rate = 0;
+  for (double i = std::max(0.0, std::floor(lambda - spread)); i <= lambda + spread; i++) {
+    double probability = std::exp(i * std::log(lambda) - lambda - std::lgamma(i + 1));
+    rate += probability * std::pow(1 - std::pow(1 - 1.0 / 64, i),
+                                   static_cast<double>(WORDS_PER_BLOCK));
+  }
+  return rate;
 }
 
 size_t
-Bloom::hash4(const std::string& key) const
-{
-  // Implementation of JS hash function derived from http://www.partow.net/programming/hashfunctions/
-  // Copyright 2002 Arash Partow
-  //
-  // Permission is hereby granted, free of charge, to any person obtaining a copy of this software
-  // and associated documentation files (the "Software"), to deal in the Software without
-  // restriction, including without limitation the rights to use, copy, modify, merge, publish,
-  // distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
-  // Software is furnished to do so, subject to the following conditions:
-  //
-  // The above copyright notice and this permission notice shall be included in all copies or
-  // substantial portions of the Software.
-  //
-  // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
-  // BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-  // NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
-  // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-  // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-  size_t hash = 1315423911;
-  for (size_t i = 0; i < key.size(); i++) {
-    hash ^= ((hash << 5) + static_cast<uint8_t>(key[i]) + (hash >> 2));
-  }
-  return hash % m_nBits;
+Bloom::countSetBits() const
+{
+  size_t n = 0;
+  for (size_t i = 0; i < m_nWords; i++) {
+    n += __builtin_popcountll(m_words[i]);
+  }
+  return n;
 }
 
-size_t
-Bloom::hash5(const std::string& key) const
-{
-  // Implementation of PJW hash function derived from http://www.partow.net/programming/hashfunctions/
-  // Copyright 2002 Arash Partow
-  //
-  // Permission is hereby granted, free of charge, to any person obtaining a copy of this software
-  // and associated documentation files (the "Software"), to deal in the Software without
-  // restriction, including without limitation the rights to use, copy, modify, merge, publish,
-  // distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
-  // Software is furnished to do so, subject to the following conditions:
-  //
-  // The above copyright notice and this permission notice shall be included in all copies or
-  // substantial portions of the Software.
-  //
-  // THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
-  // BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
-  // NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
-  // DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
-  // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-  const size_t BitsInUnsignedInt = sizeof(size_t) * 8;
-  const size_t ThreeQuarters = (BitsInUnsignedInt  * 3) / 4;
-  const size_t OneEighth = BitsInUnsignedInt / 8;
-  const size_t HighBits = static_cast<size_t>(0xFFFFFFFF) << (BitsInUnsignedInt - OneEighth);
-
-  size_t hash = 0;
-  size_t test = 0;
-  for (size_t i = 0; i < key.size(); i++) {
-    hash = (hash << OneEighth) + static_cast<uint8_t>(key[i]);
-    if ((test = hash & HighBits) != 0) {
-      hash = ((hash ^ (test >> ThreeQuarters)) & (~HighBits));
-    }
+void
+Bloom::clearRetiredSlice()
+{
+  std::memset(m_retired + m_clearCursor, 0, WORDS_PER_BLOCK * sizeof(uint64_t));
+  m_clearCursor += WORDS_PER_BLOCK;
+}
+
+void
+Bloom::addBlocked(uint64_t hash)
+{
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  uint64_t* block = m_words + (h1 & m_blockMask) * WORDS_PER_BLOCK;
+  uint32_t x = static_cast<uint32_t>(h2 >> 32);
+
+#if defined(__AVX2__)
+  __m256i lo, hi;
+  blockMask(x, lo, hi);
+  __m256i* v = reinterpret_cast<__m256i*>(block);
+  _mm256_store_si256(v, _mm256_or_si256(_mm256_load_si256(v), lo));
+  _mm256_store_si256(v + 1, _mm256_or_si256(_mm256_load_si256(v + 1), hi));
+#elif defined(__SSE2__)
+  __m128i mask[4];
+  blockMask(x, mask);
+  __m128i* v = reinterpret_cast<__m128i*>(block);
+  for (size_t i = 0; i < 4; i++) {
+    _mm_store_si128(v + i, _mm_or_si128(_mm_load_si128(v + i), mask[i]));
+  }
+#else
+  uint64_t mask[8];
+  blockMask(x, mask);
+  for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+    block[i] |= mask[i];
+  }
+#endif
+}
+
+bool
+Bloom::isEvidencedBlocked(uint64_t hash) const
+{
+  uint64_t h1, h2;
+  deriveProbes(hash, h1, h2);
+  const uint64_t* block = m_words + (h1 & m_blockMask) * WORDS_PER_BLOCK;
+  uint32_t x = static_cast<uint32_t>(h2 >> 32);
+
+#if defined(__AVX2__)
+  __m256i lo, hi;
+  blockMask(x, lo, hi);
+  const __m256i* v = reinterpret_cast<const __m256i*>(block);
+  return _mm256_testc_si256(_mm256_load_si256(v), lo) &&
+         _mm256_testc_si256(_mm256_load_si256(v + 1), hi);
+#elif defined(__SSE2__)
+  __m128i mask[4];
+  blockMask(x, mask);
+  const __m128i* v = reinterpret_cast<const __m128i*>(block);
+  __m128i missing = _mm_setzero_si128();
+  for (size_t i = 0; i < 4; i++) {
+    missing = _mm_or_si128(missing, _mm_andnot_si128(_mm_load_si128(v + i), mask[i]));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+  uint64_t mask[8];
+  blockMask(x, mask);
+  uint64_t missing = 0;
+  for (size_t i = 0; i < WORDS_PER_BLOCK; i++) {
+    missing |= ~block[i] & mask[i];
   }
-  return hash % m_nBits;
+  return missing == 0;
+#endif
 }
 
 } // namespace carousel
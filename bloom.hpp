@@ -4,8 +4,9 @@
 #ifndef CAROUSEL_BLOOM_HPP
 #define CAROUSEL_BLOOM_HPP
 
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <vector>
 
 namespace carousel {
 
@@ -13,9 +14,84 @@ class Bloom
 {
 public:
   /**
-   * \brief Creates a bloom filter with the given number of bits
+   * \brief Arrangement of the probe positions of a key within the filter
    */
-  Bloom(size_t nBits);
+  enum class Layout {
+    /// Each probe may land anywhere in the filter
+    STANDARD,
+    /// All probes of a key land in a single 64-byte block, i.e., one cache line
+    BLOCKED,
+  };
+
+  static const size_t DEFAULT_N_HASHES = 5;
+
+  /**
+   * \brief Layout and size of a bloom filter, relative to the number of keys it is meant to hold
+   *
+   * A Layout converts implicitly to a Config with the default of 10 bits per key and 5 hashes.
+   */
+  struct Config
+  {
+    Config(Layout layout = Layout::STANDARD)
+      : layout(layout)
+    {
+    }
+
+    /**
+     * \brief Returns the smallest config whose false positive rate, when holding as many keys as
+     *        it is sized for, is at most the specified rate
+     *
+     * Throws std::invalid_argument unless the rate is strictly between 0 and 1.
+     */
+    static Config
+    forFalsePositiveRate(double rate, Layout layout = Layout::STANDARD);
+
+    /**
+     * \brief Returns the config using the specified memory budget per key, with the number of
+     *        hashes minimizing the false positive rate
+     *
+     * Throws std::invalid_argument unless the budget is positive and finite.
+     */
+    static Config
+    forBitsPerKey(double bitsPerKey, Layout layout = Layout::STANDARD);
+
+    Layout layout;
+    double bitsPerKey = 10;
+    /// Number of probes per key of the STANDARD layout; BLOCKED always sets one bit per word
+    size_t nHashes = DEFAULT_N_HASHES;
+  };
+
+public:
+  /**
+   * \brief Creates a bloom filter with at least the given number of bits
+   *
+   * The number of bits is rounded up to a power of two so that probe positions can be masked
+   * instead of reduced with a modulo.
+   */
+  Bloom(size_t nBits, Layout layout = Layout::STANDARD, size_t nHashes = DEFAULT_N_HASHES);
+
+  /**
+   * \brief Creates a bloom filter for the specified number of keys
+   */
+  Bloom(const Config& config, size_t nKeys);
+
+  /**
+   * \brief Creates a bloom filter for the specified number of keys, in memory owned by the caller
+   *
+   * storage must hold storageWords(config, nKeys) zeroed words, be aligned to a cache line and
+   * outlive the filter, so that many filters can be carved out of a single allocation.
+   */
+  Bloom(const Config& config, size_t nKeys, uint64_t* storage);
+
+  /**
+   * \brief Returns the number of words used by a filter for the specified number of keys,
+   *        including its spare bit array
+   */
+  static size_t
+  storageWords(const Config& config, size_t nKeys);
+
+  Bloom(Bloom&&) = default;
+  Bloom& operator=(Bloom&&) = default;
 
   /**
    * \brief Adds a key to the bloom filter
@@ -23,37 +99,176 @@ public:
   void
   add(const std::string& key);
 
+  /**
+   * \brief Adds a key to the bloom filter, given its 64-bit hash (see hashKey)
+   */
+  void
+  add(uint64_t hash);
+
   /**
    * \brief Checks whether the existence of the specified key is evidenced by the bloom filter
    */
   bool
   isEvidenced(const std::string& key) const;
 
+  /**
+   * \brief Checks whether the existence of a key is evidenced by the bloom filter, given its
+   *        64-bit hash (see hashKey)
+   */
+  bool
+  isEvidenced(uint64_t hash) const;
+
+  /**
+   * \brief Prefetches the cache lines probed for a key, given its 64-bit hash (see hashKey)
+   */
+  void
+  prefetch(uint64_t hash) const;
+
   /**
    * \brief Resets all bits stored in the bloom filter
+   *
+   * The filter keeps two bit arrays. Resetting swaps in the spare array, which has been zeroed by
+   * clearStep calls since the previous reset, and retires the current one to be zeroed in turn.
+   * This makes reset O(1) as long as clearStep was called at least size() / 512 times since the
+   * previous reset; otherwise, the remaining part of the spare array is zeroed here.
    */
   void
   reset();
 
-private:
+  /**
+   * \brief Zeroes one cache line of the bit array retired by the last reset, if any is left
+   */
+  void
+  clearStep()
+  {
+    if (m_clearCursor < m_nWords) {
+      clearRetiredSlice();
+    }
+  }
+
+  /**
+   * \brief Returns the number of bits in the bloom filter
+   */
   size_t
-  hash1(const std::string& key) const;
+  size() const
+  {
+    return m_mask + 1;
+  }
 
+  /**
+   * \brief Returns the number of bits set, by scanning the whole filter
+   */
   size_t
-  hash2(const std::string& key) const;
+  countSetBits() const;
+
+  /**
+   * \brief Returns the share of bits set, by scanning the whole filter
+   */
+  double
+  fillRatio() const
+  {
+    return static_cast<double>(countSetBits()) / size();
+  }
 
+  /**
+   * \brief Returns the number of bytes allocated, including the spare bit array
+   */
   size_t
-  hash3(const std::string& key) const;
+  memoryBytes() const
+  {
+    return 2 * m_nWords * sizeof(uint64_t);
+  }
+
+  Layout
+  layout() const
+  {
+    return m_layout;
+  }
+
+  /**
+   * \brief Returns the bit array in use, of nWords() words, e.g., to save it (see loadWords)
+   */
+  const uint64_t*
+  words() const
+  {
+    return m_words;
+  }
 
   size_t
-  hash4(const std::string& key) const;
+  nWords() const
+  {
+    return m_nWords;
+  }
+
+  /**
+   * \brief Replaces the bits in use with nWords() words saved from a filter of the same size and
+   *        format tag
+   */
+  void
+  loadWords(const uint64_t* words);
+
+  /**
+   * \brief Returns a value identifying how keys map to bits, which differs between filters whose
+   *        saved words cannot be loaded into each other even at the same size
+   */
+  uint64_t
+  formatTag() const
+  {
+    return (static_cast<uint64_t>(m_layout) << 8) | nHashes();
+  }
 
+  /**
+   * \brief Returns the number of bits set per added key
+   */
   size_t
-  hash5(const std::string& key) const;
+  nHashes() const
+  {
+    return m_layout == Layout::BLOCKED ? WORDS_PER_BLOCK : m_nHashes;
+  }
+
+  /**
+   * \brief Returns the probability that a key which was not added is evidenced, once the
+   *        specified number of distinct keys were added
+   */
+  double
+  expectedFalsePositiveRate(size_t nKeys) const;
+
+  /**
+   * \brief Same as above, for a filter of exactly the specified number of bits, layout and hashes
+   */
+  static double
+  expectedFalsePositiveRate(size_t nBits, Layout layout, size_t nHashes, size_t nKeys);
 
 private:
-  size_t m_nBits;
-  std::vector<bool> m_bits;
+  Bloom(size_t nBits, Layout layout, size_t nHashes, uint64_t* storage);
+
+  void
+  clearRetiredSlice();
+
+  void
+  addBlocked(uint64_t hash);
+
+  bool
+  isEvidencedBlocked(uint64_t hash) const;
+
+private:
+  struct FreeDeleter
+  {
+    void
+    operator()(uint64_t* p) const;
+  };
+
+  static const size_t WORDS_PER_BLOCK = 8;
+
+  Layout m_layout;
+  size_t m_nHashes;
+  size_t m_mask;
+  size_t m_blockMask;
+  size_t m_nWords;
+  std::unique_ptr<uint64_t[], FreeDeleter> m_storage; // both bit arrays, unless owned by the caller
+  uint64_t* m_words; // bit array in use
+  uint64_t* m_retired; // bit array being zeroed by clearStep
+  size_t m_clearCursor; // number of words of m_retired zeroed so far
 };
 
 } // namespace carousel
@@ -0,0 +1,12 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "carousel-group.hpp"
+
+namespace carousel {
+
+template class BasicCarouselGroup<GroupLogCallback, SteadyClock>;
+template class BasicCarouselGroup<GroupLogCallback, TscClock>;
+template class BasicCarouselGroup<GroupLogCallback, ManualClock>;
+
+} // namespace carousel
@@ -0,0 +1,461 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_CAROUSEL_GROUP_HPP
+#define CAROUSEL_CAROUSEL_GROUP_HPP
+
+#include "bloom.hpp"
+#include "clock.hpp"
+#include "hash.hpp"
+#include "stats.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace carousel {
+
+/**
+ * \brief Callback receiving the entries logged by a CarouselGroup, along with the index of the
+ *        instance that logged them
+ */
+typedef std::function<void(size_t instance, const std::string& key,
+                           const std::string& entry)> GroupLogCallback;
+
+/**
+ * \brief Set of independent Carousel instances of the same size, sharing a sink and a clock
+ *
+ * Each instance behaves as a BasicCarousel with its own partition state, bloom filter and
+ * counters, e.g., one per sensor interface or tenant. Instead of one object per instance, the
+ * state is kept in structure-of-arrays form: the partition mask and current partition of all
+ * instances are in two arrays, which are all that log reads for a key outside the current phase,
+ * and the bloom filters of all instances are carved out of a single allocation.
+ * The clock is read once per log call and compared with the earliest deadline of all instances,
+ * kept at the top of a min-heap of the instances by deadline. When it passes, the next phase of
+ * every instance whose phase has ended is started, including instances that received no keys in
+ * the meantime, at a cost logarithmic in the number of instances rather than linear.
+ *
+ * The sink is any type callable as sink(instance, key, entry). This template is instantiated in
+ * the library for GroupLogCallback with SteadyClock, TscClock and ManualClock.
+ */
+template<typename Sink = GroupLogCallback, typename Clock = SteadyClock>
+class BasicCarouselGroup
+{
+public:
+  /**
+   * \brief Creates a group of Carousel instances that output to the specified sink
+   * \param nInstances Number of instances, indexed from 0
+   * \param memorySize Number of sources that can be logged, per instance
+   * \param collectionInterval Interval at which logger can accept log entries, per instance
+   * \param original Whether to use the original behavior in the paper or our proposed new one
+   * \param bloomConfig Layout and size of the bloom filter of each instance
+   * \param clock Clock deciding when phases end
+   */
+  BasicCarouselGroup(const Sink& sink,
+                     size_t nInstances,
+                     size_t memorySize,
+                     std::chrono::milliseconds collectionInterval,
+                     bool original = true,
+                     const Bloom::Config& bloomConfig = Bloom::Config(),
+                     const Clock& clock = Clock());
+
+  /**
+   * \brief Submit the specified entry to the specified instance, which must be less than size()
+   */
+  void
+  log(size_t instance, const std::string& key, const std::string& entry)
+  {
+    logHash(instance, hashKey(key), [&key] () -> const std::string& { return key; }, entry);
+  }
+
+  /**
+   * \brief Submit the specified entry to the specified instance, for a fixed-width integer key
+   */
+  void
+  log(size_t instance, uint64_t key, const std::string& entry)
+  {
+    logHash(instance, hashKey(key), [key] { return std::to_string(key); }, entry);
+  }
+
+  /**
+   * \brief Submit the specified entry to the specified instance, for a key whose hash is already
+   *        known (see hashKey)
+   */
+  void
+  logHashed(size_t instance, uint64_t hash, const std::string& key, const std::string& entry)
+  {
+    logHash(instance, hash, [&key] () -> const std::string& { return key; }, entry);
+  }
+
+  /**
+   * \brief Returns a snapshot of the counters of the specified instance
+   *
+   * As for BasicCarousel::stats, this may be called from any thread. The false positive rate is
+   * not sampled by the group, so the sampled counters are zero.
+   */
+  CarouselStats
+  stats(size_t instance) const;
+
+  /**
+   * \brief Reset the specified instance
+   */
+  void
+  reset(size_t instance);
+
+  size_t
+  size() const
+  {
+    return m_filters.size();
+  }
+
+  /**
+   * \brief Returns the number of bytes allocated for the state of all instances
+   */
+  size_t
+  memoryBytes() const;
+
+private:
+  template<typename MakeKey>
+  void
+  logHash(size_t instance, uint64_t hash, const MakeKey& makeKey, const std::string& entry);
+
+  /**
+   * \brief Starts the next phase of every instance whose phase has ended, and updates the earliest
+   *        deadline
+   */
+  void
+  startExpiredPhases(uint64_t now);
+
+  /**
+   * \brief Sets the deadline of the specified instance, and moves it within the deadline heap
+   */
+  void
+  setDeadline(size_t instance, uint64_t deadline);
+
+  void
+  siftUp(size_t position);
+
+  void
+  siftDown(size_t position);
+
+  void
+  startNextPhase(size_t instance, uint64_t now);
+
+  void
+  repartitionOverflow(size_t instance, uint64_t now);
+
+  /**
+   * \brief Advances v, and the partition matched by the current phase
+   */
+  void
+  advancePartition(size_t instance);
+
+private:
+  struct FreeDeleter
+  {
+    void
+    operator()(uint64_t* p) const
+    {
+      std::free(p);
+    }
+  };
+
+  Sink m_sink;
+  Clock m_clock;
+  const double m_x = 2.3;
+
+  const size_t m_memorySize;
+  const std::chrono::nanoseconds m_phaseDuration;
+  const uint64_t m_phaseDurationTicks;
+  const bool m_original;
+  uint64_t m_earliestDeadline = 0; // in clock ticks
+
+  // Per-instance state, indexed by instance; the first two arrays are read by every log call
+  std::vector<uint64_t> m_kMasks;
+  std::vector<uint64_t> m_partitions; // partition matched by the current phase
+  std::vector<size_t> m_nMatchingThisPhase;
+  std::vector<uint64_t> m_deadlines; // in clock ticks
+  std::vector<size_t> m_deadlineHeap; // instances, as a binary min-heap on their deadline
+  std::vector<size_t> m_heapPositions; // position of each instance in m_deadlineHeap
+  std::vector<Bloom> m_filters;
+  std::unique_ptr<uint64_t[], FreeDeleter> m_arena; // bit arrays of all filters
+
+  // Per-instance statistics, readable from any thread through stats()
+  std::unique_ptr<StatCounter[]> m_k;
+  std::unique_ptr<StatCounter[]> m_v;
+  std::unique_ptr<StatCounter[]> m_nAdmitted;
+  std::unique_ptr<StatCounter[]> m_nDuplicates;
+  std::unique_ptr<StatCounter[]> m_nOutsidePhase;
+  std::unique_ptr<StatCounter[]> m_nPhases;
+  std::unique_ptr<StatCounter[]> m_nOverflows;
+  std::unique_ptr<StatCounter[]> m_nUnderflows;
+};
+
+template<typename Sink, typename Clock>
+BasicCarouselGroup<Sink, Clock>::BasicCarouselGroup(const Sink& sink,
+                                                    size_t nInstances,
+                                                    size_t memorySize,
+                                                    std::chrono::milliseconds collectionInterval,
+                                                    bool original,
+                                                    const Bloom::Config& bloomConfig,
+                                                    const Clock& clock)
+  : m_sink(sink)
+  , m_clock(clock)
+  , m_memorySize(memorySize)
+  , m_phaseDuration(std::chrono::milliseconds(memorySize * collectionInterval.count()))
+  , m_phaseDurationTicks(m_clock.toTicks(m_phaseDuration))
+  , m_original(original)
+  , m_kMasks(nInstances, 0)
+  , m_partitions(nInstances, 0)
+  , m_nMatchingThisPhase(nInstances, 0)
+  , m_deadlines(nInstances, 0)
+  , m_deadlineHeap(nInstances)
+  , m_heapPositions(nInstances)
+  , m_k(new StatCounter[nInstances])
+  , m_v(new StatCounter[nInstances])
+  , m_nAdmitted(new StatCounter[nInstances])
+  , m_nDuplicates(new StatCounter[nInstances])
+  , m_nOutsidePhase(new StatCounter[nInstances])
+  , m_nPhases(new StatCounter[nInstances])
+  , m_nOverflows(new StatCounter[nInstances])
+  , m_nUnderflows(new StatCounter[nInstances])
+{
+  // Filter sizes are multiples of a cache line, so every filter of the arena is aligned to one
+  size_t words = Bloom::storageWords(bloomConfig, memorySize);
+  void* p = nullptr;
+  if (posix_memalign(&p, 64, nInstances * words * sizeof(uint64_t)) != 0) {
+    throw std::bad_alloc();
+  }
+  m_arena.reset(static_cast<uint64_t*>(p));
+  std::memset(m_arena.get(), 0, nInstances * words * sizeof(uint64_t));
+
+  m_filters.reserve(nInstances);
+  for (size_t i = 0; i < nInstances; i++) {
+    m_filters.emplace_back(bloomConfig, memorySize, m_arena.get() + i * words);
+    // All deadlines are equal, so instances in index order already form a heap
+    m_deadlineHeap[i] = i;
+    m_heapPositions[i] = i;
+  }
+}
+
+template<typename Sink, typename Clock>
+template<typename MakeKey>
+void
+BasicCarouselGroup<Sink, Clock>::logHash(size_t instance, uint64_t hash, const MakeKey& makeKey,
+                                         const std::string& entry)
+{
+  // Spread zeroing the bloom filter retired at the last phase change over the packet path of the
+  // instance, as BasicCarousel does
+  Bloom& filter = m_filters[instance];
+  filter.clearStep();
+
+  uint64_t now = m_clock.now();
+  if (now >= m_earliestDeadline) {
+    startExpiredPhases(now);
+  }
+
+  if ((hash & m_kMasks[instance]) != m_partitions[instance]) {
+    m_nOutsidePhase[instance].increment();
+    return;
+  }
+
+  if (filter.isEvidenced(hash)) {
+    m_nDuplicates[instance].increment();
+    return;
+  }
+
+  filter.add(hash);
+  m_nAdmitted[instance].increment();
+  if (++m_nMatchingThisPhase[instance] > m_memorySize) {
+    repartitionOverflow(instance, now);
+  }
+
+  m_sink(instance, makeKey(), entry);
+}
+
+template<typename Sink, typename Clock>
+CarouselStats
+BasicCarouselGroup<Sink, Clock>::stats(size_t instance) const
+{
+  CarouselStats stats;
+  stats.k = m_k[instance].load();
+  stats.v = m_v[instance].load();
+  stats.phaseDuration = m_phaseDuration;
+  stats.phaseCapacity = m_memorySize;
+  stats.nEstimatedKeys = 0;
+  stats.nPhases = m_nPhases[instance].load();
+  stats.nOverflows = m_nOverflows[instance].load();
+  stats.nUnderflows = m_nUnderflows[instance].load();
+  stats.nAdmitted = m_nAdmitted[instance].load();
+  stats.nDuplicates = m_nDuplicates[instance].load();
+  stats.nOutsidePhase = m_nOutsidePhase[instance].load();
+  // The group sink cannot report backpressure
+  stats.nRejected = 0;
+  stats.nSkipped = 0;
+  // Not tracked per phase by the group
+  stats.nAdmittedThisPhase = 0;
+  stats.nSampledNew = 0;
+  stats.nSampledFalsePositives = 0;
+  return stats;
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::reset(size_t instance)
+{
+  m_filters[instance].reset();
+  m_k[instance].store(0);
+  m_v[instance].store(0);
+  m_kMasks[instance] = 0;
+  m_partitions[instance] = 0;
+  m_nMatchingThisPhase[instance] = 0;
+  setDeadline(instance, m_clock.now() + m_phaseDurationTicks);
+  m_earliestDeadline = m_deadlines[m_deadlineHeap.front()];
+}
+
+template<typename Sink, typename Clock>
+size_t
+BasicCarouselGroup<Sink, Clock>::memoryBytes() const
+{
+  size_t perInstance = 4 * sizeof(uint64_t) + 2 * sizeof(size_t) + sizeof(Bloom) +
+                       8 * sizeof(StatCounter);
+  size_t filterBytes = m_filters.empty() ? 0 : m_filters.front().memoryBytes();
+  return size() * (perInstance + filterBytes);
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::startExpiredPhases(uint64_t now)
+{
+  // Each started phase moves its instance down the heap, behind the deadlines not yet passed, so
+  // that every instance starts at most one phase here
+  for (size_t i = 0; i < size() && now >= m_deadlines[m_deadlineHeap.front()]; i++) {
+    startNextPhase(m_deadlineHeap.front(), now);
+  }
+  m_earliestDeadline = m_deadlines[m_deadlineHeap.front()];
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::setDeadline(size_t instance, uint64_t deadline)
+{
+  uint64_t previous = m_deadlines[instance];
+  m_deadlines[instance] = deadline;
+  if (deadline < previous) {
+    siftUp(m_heapPositions[instance]);
+  }
+  else {
+    siftDown(m_heapPositions[instance]);
+  }
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::siftUp(size_t position)
+{
+  size_t instance = m_deadlineHeap[position];
+  while (position > 0) {
+    size_t parent = (position - 1) / 2;
+    if (m_deadlines[m_deadlineHeap[parent]] <= m_deadlines[instance]) {
+      break;
+    }
+    m_deadlineHeap[position] = m_deadlineHeap[parent];
+    m_heapPositions[m_deadlineHeap[position]] = position;
+    position = parent;
+  }
+  m_deadlineHeap[position] = instance;
+  m_heapPositions[instance] = position;
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::siftDown(size_t position)
+{
+  size_t instance = m_deadlineHeap[position];
+  size_t n = m_deadlineHeap.size();
+  while (2 * position + 1 < n) {
+    size_t child = 2 * position + 1;
+    if (child + 1 < n &&
+        m_deadlines[m_deadlineHeap[child + 1]] < m_deadlines[m_deadlineHeap[child]]) {
+      child++;
+    }
+    if (m_deadlines[instance] <= m_deadlines[m_deadlineHeap[child]]) {
+      break;
+    }
+    m_deadlineHeap[position] = m_deadlineHeap[child];
+    m_heapPositions[m_deadlineHeap[position]] = position;
+    position = child;
+  }
+  m_deadlineHeap[position] = instance;
+  m_heapPositions[instance] = position;
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::startNextPhase(size_t instance, uint64_t now)
+{
+  // The deadline is only zero before the first phase starts, at the first key
+  if (m_deadlines[instance] != 0) {
+    m_nPhases[instance].increment();
+  }
+
+  // Check for bloom filter underflow
+  size_t k = m_k[instance].load();
+  if (k > 0 && m_nMatchingThisPhase[instance] < m_memorySize / m_x) {
+    k--;
+    m_k[instance].store(k);
+    m_kMasks[instance] = (uint64_t(1) << k) - 1;
+    m_nUnderflows[instance].increment();
+  }
+
+  m_filters[instance].reset();
+  advancePartition(instance);
+  setDeadline(instance, now + m_phaseDurationTicks);
+  m_nMatchingThisPhase[instance] = 0;
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::repartitionOverflow(size_t instance, uint64_t now)
+{
+  m_nPhases[instance].increment();
+  m_nOverflows[instance].increment();
+
+  size_t k = m_k[instance].load() + 1;
+  m_k[instance].store(k);
+  m_kMasks[instance] = (uint64_t(1) << k) - 1;
+
+  m_filters[instance].reset();
+  advancePartition(instance);
+  setDeadline(instance, now + m_phaseDurationTicks);
+  m_earliestDeadline = m_deadlines[m_deadlineHeap.front()];
+  m_nMatchingThisPhase[instance] = 0;
+}
+
+template<typename Sink, typename Clock>
+void
+BasicCarouselGroup<Sink, Clock>::advancePartition(size_t instance)
+{
+  uint64_t kMask = m_kMasks[instance];
+  uint64_t v = m_v[instance].load() + 1;
+  if (m_original) {
+    v &= kMask;
+  }
+  m_v[instance].store(v);
+  m_partitions[instance] = v & kMask;
+}
+
+extern template class BasicCarouselGroup<GroupLogCallback, SteadyClock>;
+extern template class BasicCarouselGroup<GroupLogCallback, TscClock>;
+extern template class BasicCarouselGroup<GroupLogCallback, ManualClock>;
+
+typedef BasicCarouselGroup<GroupLogCallback, SteadyClock> CarouselGroup;
+
+} // namespace carousel
+
+#endif // CAROUSEL_CAROUSEL_GROUP_HPP
@@ -5,29 +5,130 @@
 #define CAROUSEL_CAROUSEL_HPP
 
 #include "bloom.hpp"
+#include "clock.hpp"
+#include "cuckoo-filter.hpp"
+#include "hash.hpp"
+#include "hyperloglog.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstring>
 #include <functional>
+#include <memory>
+#include <ostream>
 #include <string>
+#include <type_traits>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace carousel {
 
-class Carousel
+typedef std::function<void(const std::string&, const std::string&)> LogCallback;
+
+/**
+ * \brief Outcome of passing an entry to a sink that reports backpressure
+ */
+enum class SinkResult {
+  /// The entry was taken, so its key counts as logged for the phase
+  ACCEPTED,
+  /// The entry was not taken, but the sink can take further entries
+  REJECTED,
+  /// The entry was not taken, and the sink cannot take entries for now
+  FULL,
+};
+
+/**
+ * \brief Log callback reporting whether it took the entry (see SinkResult)
+ */
+typedef std::function<SinkResult(const std::string&, const std::string&)> BackpressureLogCallback;
+
+namespace detail {
+
+/**
+ * \brief Passes an entry to a sink returning a SinkResult
+ */
+template<typename Sink>
+inline auto
+invokeSink(Sink& sink, const std::string& key, const std::string& entry, int)
+  -> typename std::enable_if<std::is_same<decltype(sink(key, entry)), SinkResult>::value,
+                             SinkResult>::type
+{
+  return sink(key, entry);
+}
+
+/**
+ * \brief Passes an entry to a sink returning anything else, which always takes it
+ */
+template<typename Sink>
+inline SinkResult
+invokeSink(Sink& sink, const std::string& key, const std::string& entry, long)
+{
+  sink(key, entry);
+  return SinkResult::ACCEPTED;
+}
+
+} // namespace detail
+
+/**
+ * \brief Callback receiving the entries admitted from one batch
+ *
+ * keys and entries are the arrays passed to logBatch; admitted lists the indices, in increasing
+ * order, of the nAdmitted entries that were logged.
+ */
+typedef std::function<void(const std::string* keys, const std::string* entries,
+                           const size_t* admitted, size_t nAdmitted)> BatchLogCallback;
+
+/**
+ * \brief Carousel logging front-end, outputting to the specified sink and driven by the
+ *        specified clock (see clock.hpp), suppressing duplicates with the specified filter
+ *
+ * The sink is any type callable as sink(key, entry). Using a function object type instead of
+ * the default LogCallback lets the compiler inline the sink into log. The clock is read once per
+ * log or logBatch call and compared with the cached end of the current phase.
+ *
+ * A sink returning a SinkResult, such as BackpressureLogCallback, is called before its key is
+ * added to the filter, and the key only counts as logged in the phase if the sink accepted the
+ * entry; a dropped entry thus leaves the key free to be logged again when it next arrives. Once
+ * the sink reports FULL, keys are neither hashed nor passed to the sink for a fraction of the
+ * collection interval. Sinks returning anything else are assumed to take every entry.
+ *
+ * The filter holds the keys logged in the current phase. It is Bloom or CuckooFilter, or any type
+ * with a Config type, a constructor taking a Config and a number of keys, and the add,
+ * isEvidenced, prefetch, reset, clearStep, fillRatio and expectedFalsePositiveRate members of
+ * these. This template is instantiated in the library for LogCallback with SteadyClock, TscClock
+ * and ManualClock, with SteadyClock and CuckooFilter, and for BackpressureLogCallback with
+ * SteadyClock.
+ */
+template<typename Sink = LogCallback, typename Clock = SteadyClock, typename Filter = Bloom>
+class BasicCarousel
 {
 public:
-  typedef std::function<void(const std::string&, const std::string&)> LogCallback;
+  typedef carousel::LogCallback LogCallback;
+  typedef carousel::BatchLogCallback BatchLogCallback;
 
 public:
   /**
-   * \brief Creates an instance of Carousel that outputs to the specified callback
+   * \brief Creates an instance of Carousel that outputs to the specified sink
    * \param memorySize Number of sources that can be logged
    * \param collectionInterval Interval at which logger can accept log entries
    * \param original Whether to use the original behavior in the paper or our proposed new one
+   * \param filterConfig Layout and size of the filter used to suppress duplicates within a
+   *        phase, which holds up to memorySize keys (see Bloom::Config)
+   * \param clock Clock deciding when phases end
    */
-  Carousel(const LogCallback& callback,
-           size_t memorySize,
-           std::chrono::milliseconds collectionInterval,
-           bool original = true);
+  BasicCarousel(const Sink& sink,
+                size_t memorySize,
+                std::chrono::milliseconds collectionInterval,
+                bool original = true,
+                const typename Filter::Config& filterConfig = typename Filter::Config(),
+                const Clock& clock = Clock());
 
   /**
    * \brief Submit the specified entry to Carousel
@@ -39,46 +140,1248 @@ public:
   void
   log(const std::string& key, const std::string& entry);
 
+  /**
+   * \brief Submit the specified entry to Carousel, for a key given as raw bytes
+   *
+   * The key is only copied into a std::string for the callback if the entry is logged.
+   */
+  void
+  log(const char* key, size_t keyLength, const std::string& entry);
+
+  /**
+   * \brief Submit the specified entry to Carousel, for a fixed-width integer key
+   *
+   * The key is hashed with hashKey(uint32_t) or hashKey(uint64_t) and is only converted to its
+   * decimal representation for the callback if the entry is logged.
+   */
+  void
+  log(uint32_t key, const std::string& entry);
+
+  void
+  log(uint64_t key, const std::string& entry);
+
+  /**
+   * \brief Submit the specified entry to Carousel, for a key whose hash is already known
+   * \param hash Hash of the key, as computed by hashKey
+   * \param key Logging key, only passed on to the callback
+   * \param entry Entry for log for the given key
+   */
+  void
+  logHashed(uint64_t hash, const std::string& key, const std::string& entry);
+
+  /**
+   * \brief Submit an entry to Carousel, producing it only if it is logged
+   * \param key Logging key
+   * \param produceEntry Function object called without arguments to produce the entry
+   *
+   * Most keys are rejected because they fall outside the current phase or were already logged in
+   * it. This overload avoids formatting an entry for them.
+   */
+  template<typename Producer>
+  auto
+  log(const std::string& key, Producer&& produceEntry)
+    -> decltype(static_cast<void>(produceEntry()))
+  {
+    logHash([&key] { return hashKey(key); }, [&key] () -> const std::string& { return key; },
+            produceEntry);
+  }
+
+  template<typename Producer>
+  auto
+  log(uint32_t key, Producer&& produceEntry)
+    -> decltype(static_cast<void>(produceEntry()))
+  {
+    logHash([key] { return hashKey(key); }, [key] { return std::to_string(key); }, produceEntry);
+  }
+
+  template<typename Producer>
+  auto
+  log(uint64_t key, Producer&& produceEntry)
+    -> decltype(static_cast<void>(produceEntry()))
+  {
+    logHash([key] { return hashKey(key); }, [key] { return std::to_string(key); }, produceEntry);
+  }
+
+#if __cplusplus >= 201703L
+  void
+  log(std::string_view key, const std::string& entry)
+  {
+    log(key.data(), key.size(), entry);
+  }
+
+  void
+  log(const char* key, const std::string& entry)
+  {
+    log(key, std::strlen(key), entry);
+  }
+#endif
+
+  /**
+   * \brief Submit a batch of entries to Carousel
+   * \param keys Logging keys
+   * \param entries Entries for log for the given keys
+   * \param n Number of keys and entries
+   *
+   * Equivalent to calling log on each key in order, except that the phase deadline is only
+   * checked once per batch. All keys are hashed and the bloom filter lines of those that match the
+   * current phase are prefetched before any of them is tested, so that the cache misses of the
+   * batch overlap. Admitted entries are passed to the batch callback in a single call if one is
+   * set, or to the log callback one by one otherwise. The batch callback cannot report
+   * backpressure, so the entries passed to it count as logged whether or not it drops them.
+   */
+  void
+  logBatch(const std::string* keys, const std::string* entries, size_t n);
+
+  /**
+   * \brief Submit a batch of entries to Carousel, for keys whose hashes are already known
+   * \param hashes Hashes of the keys, as computed by hashKey
+   *
+   * Equivalent to logBatch, without hashing the keys, e.g., when replaying a trace that stores
+   * them (see trace_convert).
+   */
+  void
+  logBatchHashed(const uint64_t* hashes, const std::string* keys, const std::string* entries,
+                 size_t n);
+
+  /**
+   * \brief Sets the callback receiving the entries admitted by logBatch
+   */
+  void
+  setBatchCallback(const BatchLogCallback& callback);
+
+  /**
+   * \brief Sets the callback receiving the summary of each phase as it ends
+   *
+   * The callback is invoked from log or logBatch, before the next phase starts. Summarizing a
+   * phase measures the fill ratio of the filter, which takes a scan of the filter, so this
+   * is only done while a callback is set.
+   */
+  void
+  setPhaseCallback(const PhaseCallback& callback);
+
+  /**
+   * \brief Reports the state of the sink, so that phases track its actual capacity
+   * \param drainRate Entries per second the sink records while it has entries waiting, or 0 if
+   *        unknown, e.g., because the sink was idle
+   * \param queueDepth Entries admitted but not yet recorded by the sink
+   *
+   * The phase duration, memorySize * collectionInterval, assumes that the sink records one entry
+   * per collection interval. Once a drain rate is reported, each phase instead lasts the time the
+   * sink takes to record memorySize entries at that rate, smoothed over the reports. Besides, a
+   * phase ends as soon as a report shows that the sink is about to run out of entries, provided
+   * that the phase filled the sink before or admitted fewer keys than the sink recorded since the
+   * previous report: its keys have then mostly been logged, and the next phase feeds the sink new
+   * keys instead of leaving it idle. Such a phase does not count as an underflow.
+   * This may be called from any thread, at any rate; each report is applied once, by the next log
+   * or logBatch call.
+   */
+  void
+  reportSinkState(double drainRate, size_t queueDepth);
+
+  /**
+   * \brief Starts or stops choosing k from an estimate of the number of distinct keys
+   *
+   * By default, k grows by one when a phase overflows and shrinks by one when a phase ends below
+   * capacity / 2.3, so that following a surge of new keys, or its end, takes one phase and one
+   * filter reset per step. While enabled, every key hashed is also added to a HyperLogLog sketch
+   * estimating the distinct keys arriving within one phase duration. Each phase ending at its
+   * deadline is then followed by the smallest k whose partitions hold at most the phase capacity
+   * of those keys. An overflow sets k to at least one more, projecting the keys seen since the
+   * sketch window started over the whole window once half of it has passed. This costs a register
+   * update per key and 4 KiB.
+   * This must not be called concurrently with log or logBatch.
+   */
+  void
+  setCardinalityRepartitioning(bool isEnabled);
+
+  /**
+   * \brief Saves k, v, the timing of the current phase and the keys the filter holds to a
+   *        snapshot file (see snapshot.hpp), so that a restarted instance can resume from them
+   *
+   * Throws std::system_error if the snapshot cannot be written. This must not be called
+   * concurrently with log or logBatch.
+   */
+  void
+  saveSnapshot(const std::string& path) const;
+
+  /**
+   * \brief Resumes from a snapshot saved by an instance of the same memory size, mode and filter
+   *
+   * The snapshot is mapped and its filter words copied into the filter, so that restoring costs
+   * about as much as reading the file from the page cache. Snapshots of another format version or
+   * instance, or which are damaged, are ignored, leaving this instance as it was. The saved phase
+   * resumes with the time it had left, less the time elapsed on the system clock since it was
+   * saved; if none is left, the next phase starts at the next key. Counters are not saved, and
+   * false positives are only sampled again from the next phase. This must not be called
+   * concurrently with log or logBatch.
+   */
+  SnapshotResult
+  restoreSnapshot(const std::string& path);
+
+  /**
+   * \brief Returns a snapshot of the counters of this instance
+   *
+   * Counters are updated with relaxed atomic stores by the thread logging into this instance, so
+   * that this may be called from any thread, e.g., to export them periodically.
+   */
+  CarouselStats
+  stats() const;
+
+  /**
+   * \brief Starts or stops timing log calls into one latency histogram per path (see LogPath)
+   *
+   * Calls are timed with the time stamp counter (see TscClock). While disabled, which is the
+   * default, timing costs a single branch per call. This must not be called concurrently with
+   * log or logBatch; enabling again keeps the counts recorded so far.
+   */
+  void
+  setLatencyTracking(bool isEnabled);
+
+  /**
+   * \brief Starts or stops measuring the false positive rate of the filter (see
+   *        CarouselStats::falsePositiveRate)
+   *
+   * About one in 64 keys matching their phase is then checked against a table of the keys sampled
+   * in the phase, allocated when sampling is first enabled and cleared in constant time when a
+   * phase starts. Sampling begins with the next phase, as the keys logged earlier in the current
+   * one are not in the table. While disabled, which is the default, sampling costs a single branch
+   * per key. This must not be called concurrently with log or logBatch.
+   */
+  void
+  setFalsePositiveSampling(bool isEnabled);
+
+  /**
+   * \brief Returns the latency histogram of the specified path, or nullptr if latency tracking
+   *        was never enabled
+   *
+   * The histogram may be read from any thread while log is being called.
+   */
+  const LatencyHistogram*
+  latencyHistogram(LogPath path) const;
+
+  /**
+   * \brief Writes one line per path taken so far with the count, mean and percentiles of its
+   *        latency
+   */
+  void
+  printLatency(std::ostream& os) const;
+
   /**
    * \brief Reset Carousel
    */
   void
   reset();
 
+  /// Ratio between the collection interval and the time keys are skipped once the sink reported
+  /// FULL; a sink draining in bursts may free slots well before one interval has passed
+  static const size_t SINK_RETRY_DIVISOR = 16;
+
 private:
+  /**
+   * \brief Processes a key, calling makeHash to hash it unless the sink is full, and makeKey and
+   *        makeEntry to obtain the key and entry for the sink if it is logged
+   */
+  template<typename MakeHash, typename MakeKey, typename MakeEntry>
+  void
+  logHash(const MakeHash& makeHash, const MakeKey& makeKey, const MakeEntry& makeEntry);
+
+  /**
+   * \brief Implements logHash, returning the path taken
+   */
+  template<typename MakeHash, typename MakeKey, typename MakeEntry>
+  LogPath
+  processHash(const MakeHash& makeHash, const MakeKey& makeKey, const MakeEntry& makeEntry);
+
+  /**
+   * \brief Processes a batch for logBatch or logBatchHashed, recording its latency if tracked
+   */
+  void
+  timeBatch(const uint64_t* hashes, const std::string* keys, const std::string* entries, size_t n);
+
+  /**
+   * \brief Implements timeBatch, hashing the keys unless hashes is non-null
+   */
+  void
+  processBatch(const uint64_t* hashes, const std::string* keys, const std::string* entries,
+               size_t n);
+
   void
   startNextPhase();
 
+  /**
+   * \brief Summarizes the current phase to the phase callback and updates the phase counters
+   */
+  void
+  endPhase(PhaseSummary::End end);
+
   void
   repartitionOverflow();
 
   void
   repartitionUnderflow();
 
+  /**
+   * \brief Adds a key to the sketch of distinct keys, starting a new window at its end
+   */
+  void
+  observeKey(uint64_t hash, uint64_t now)
+  {
+    if (now >= m_sketchDeadline) {
+      startSketchWindow(now);
+    }
+    m_sketch->add(hash);
+  }
+
+  void
+  startSketchWindow(uint64_t now);
+
+  /**
+   * \brief Returns the smallest k whose partitions hold at most the phase capacity of the
+   *        distinct keys estimated per phase duration, projected over the whole sketch window if
+   *        isOverflow
+   */
+  size_t
+  estimateK(bool isOverflow);
+
+  /**
+   * \brief Applies the sink state reported since the last call, if any, ending the current phase
+   *        if the sink is about to run out of entries
+   */
+  void
+  applySinkReport(uint64_t now);
+
+  /**
+   * \brief Sets the duration of the phase about to start from the drain rate of the sink, if known
+   */
+  void
+  adaptToSink();
+
   bool
   isBloomFilterOverflowed();
 
   bool
   isBloomFilterUnderflowed();
 
+  /**
+   * \brief Checks the bloom filter answer for a sample of the keys matching the current phase
+   *        against an exact set, to measure its false positive rate
+   */
+  void
+  sampleFalsePositive(uint64_t hash, bool isEvidenced)
+  {
+    // About one key in 64, chosen by bits independent of the partition and of the probes
+    uint64_t mixed = hash * 0xd6e8feb86659fd93ULL;
+    if (!m_isSamplingPhase || (mixed >> 58) != 0) {
+      return;
+    }
+    size_t mask = m_samples.size() - 1;
+    for (size_t i = (mixed >> 26) & mask; ; i = (i + 1) & mask) {
+      Sample& sample = m_samples[i];
+      if (sample.generation != m_sampleGeneration) {
+        if (2 * m_nSamplesThisPhase >= m_samples.size()) {
+          // Far more keys than the phase should hold; stop sampling until the next one
+          return;
+        }
+        sample.hash = hash;
+        sample.generation = m_sampleGeneration;
+        m_nSamplesThisPhase++;
+        break;
+      }
+      if (sample.hash == hash) {
+        // Already seen in this phase, so not a key that the filter should reject
+        return;
+      }
+    }
+    m_nSampledNew.increment();
+    if (isEvidenced) {
+      m_nSampledFalsePositives.increment();
+    }
+  }
+
+  /**
+   * \brief Empties the table of sampled keys, for a phase starting with an empty filter
+   */
+  void
+  clearSamples();
+
+  /**
+   * \brief Counts an entry the sink did not accept, and stops passing entries to the sink for a
+   *        while if it is full
+   *
+   * The partition holds more keys than the sink takes, so refused keys count towards the capacity
+   * of the phase, but only once each: the filter also records the refusal under a remix of the
+   * hash, which keeps the key itself free to be logged when it next arrives. Keys refused and
+   * admitted thus take at most the capacity of the phase from the filter.
+   */
+  void
+  onSinkRefused(SinkResult result, uint64_t hash, uint64_t now)
+  {
+    m_nRejected.increment();
+    if (result == SinkResult::FULL) {
+      m_sinkFullUntil = now + m_retryTicks;
+    }
+    uint64_t refusal = detail::wyMix(hash, detail::WY_SECRET[2]);
+    if (!m_filter.isEvidenced(refusal)) {
+      m_filter.add(refusal);
+      m_nMatchingThisPhase++;
+    }
+  }
+
 private:
-  LogCallback m_callback;
-  Bloom m_bloom;
+  Sink m_sink;
+  BatchLogCallback m_batchCallback;
+  Filter m_filter;
+  Clock m_clock;
   const double m_x = 2.3;
 
   const size_t m_memorySize;
   const std::chrono::milliseconds m_collectionInterval;
-  const std::chrono::milliseconds m_phaseDuration;
+  const std::chrono::nanoseconds m_nominalPhaseDuration;
+  std::chrono::nanoseconds m_phaseDuration;
+  uint64_t m_phaseDurationTicks;
+  size_t m_phaseCapacity; // keys admitted before the phase overflows, at most m_memorySize
+  const double m_ticksPerSecond;
+  const uint64_t m_retryTicks; // wait after the sink reported FULL (see SINK_RETRY_DIVISOR)
+  uint64_t m_sinkFullUntil = 0; // in clock ticks
+
+  // Latest state reported by the sink (see reportSinkState), pending until it is applied
+  std::atomic<bool> m_isSinkReported{false};
+  std::atomic<double> m_sinkDrainRate{0.0};
+  std::atomic<size_t> m_sinkQueueDepth{0};
+  double m_drainRate = 0; // smoothed drain rate, in entries per second
+  bool m_hasSinkReport = false; // whether a report was applied before
+  uint64_t m_lastSinkReport = 0; // in clock ticks, when the last report was applied
+  uint64_t m_sinkReportAdmitted = 0; // keys admitted when the last report was applied
+  bool m_isSinkBacklogged = false; // whether the sink had a backlog during the current phase
+  bool m_isSinkStarved = false; // whether the current phase ends as the sink is about to idle
 
   size_t m_k = 0;
   size_t m_kMask = 0;
   size_t m_v = 0;
-  std::chrono::steady_clock::time_point m_phaseStartTime;
+  uint64_t m_phaseStart = 0; // in clock ticks
+  uint64_t m_phaseDeadline = 0; // in clock ticks
   size_t m_nMatchingThisPhase = 0;
 
+  // Distinct keys per phase duration (see setCardinalityRepartitioning)
+  std::unique_ptr<HyperLogLog> m_sketch; // null while disabled
+  uint64_t m_sketchWindowStart = 0; // in clock ticks
+  uint64_t m_sketchDeadline = 0; // in clock ticks
+  double m_lastWindowEstimate = 0; // distinct keys of the window before the current one
+
   const bool m_original;
+
+  // Scratch space of logBatch, kept to avoid allocating on every batch
+  std::vector<uint64_t> m_batchHashes;
+  std::vector<size_t> m_batchMatches;
+  std::vector<size_t> m_batchAdmitted;
+
+  // Statistics, written by the logging thread and readable from any thread through stats()
+  PhaseCallback m_phaseCallback;
+  StatCounter m_nAdmitted;
+  StatCounter m_nDuplicates;
+  StatCounter m_nOutsidePhase;
+  StatCounter m_nRejected;
+  StatCounter m_nSkipped;
+  StatCounter m_nPhases;
+  StatCounter m_nOverflows;
+  StatCounter m_nUnderflows;
+  StatCounter m_nSampledNew;
+  StatCounter m_nSampledFalsePositives;
+  StatCounter m_statK;
+  StatCounter m_statV;
+  StatCounter m_statPhaseDuration; // in nanoseconds
+  StatCounter m_statPhaseCapacity;
+  StatCounter m_statEstimatedKeys;
+  // Counters when the current phase started
+  StatCounter m_phaseStartAdmitted;
+  uint64_t m_phaseStartDuplicates = 0;
+  uint64_t m_phaseStartOutsidePhase = 0;
+  uint64_t m_phaseStartSampledNew = 0;
+  uint64_t m_phaseStartSampledFalsePositives = 0;
+  // Sampled keys of the current phase (see sampleFalsePositive), in an open addressing table whose
+  // slots are empty unless stamped with the generation of the phase
+  struct Sample
+  {
+    uint64_t hash;
+    uint64_t generation;
+  };
+  std::vector<Sample> m_samples;
+  uint64_t m_sampleGeneration = 1;
+  size_t m_nSamplesThisPhase = 0;
+  bool m_isSampling = false;
+  bool m_isSamplingPhase = false; // whether the table holds the sampled keys of the whole phase
+
+  // Latency histograms, allocated when latency tracking is first enabled
+  struct Latency
+  {
+    TscClock clock;
+    LatencyHistogram histograms[N_LOG_PATHS];
+  };
+  std::unique_ptr<Latency> m_latencyStorage;
+  Latency* m_latency = nullptr; // null while latency tracking is disabled
 };
 
+template<typename Sink, typename Clock, typename Filter>
+BasicCarousel<Sink, Clock, Filter>::BasicCarousel(const Sink& sink,
+                                                  size_t memorySize,
+                                                  std::chrono::milliseconds collectionInterval,
+                                                  bool original,
+                                                  const typename Filter::Config& filterConfig,
+                                                  const Clock& clock)
+  : m_sink(sink)
+  , m_filter(filterConfig, memorySize)
+  , m_clock(clock)
+  , m_memorySize(memorySize)
+  , m_collectionInterval(collectionInterval)
+  , m_nominalPhaseDuration(std::chrono::milliseconds(memorySize * collectionInterval.count()))
+  , m_phaseDuration(m_nominalPhaseDuration)
+  , m_phaseDurationTicks(m_clock.toTicks(m_phaseDuration))
+  , m_phaseCapacity(memorySize)
+  , m_ticksPerSecond(static_cast<double>(m_clock.toTicks(std::chrono::seconds(1))))
+  , m_retryTicks(m_clock.toTicks(collectionInterval) / SINK_RETRY_DIVISOR)
+  , m_original(original)
+{
+  m_statPhaseDuration.store(m_phaseDuration.count());
+  m_statPhaseCapacity.store(m_phaseCapacity);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::log(const std::string& key, const std::string& entry)
+{
+  logHash([&key] { return hashKey(key); }, [&key] () -> const std::string& { return key; },
+          [&entry] () -> const std::string& { return entry; });
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::log(const char* key, size_t keyLength, const std::string& entry)
+{
+  logHash([=] { return hashBytes(key, keyLength); }, [=] { return std::string(key, keyLength); },
+          [&entry] () -> const std::string& { return entry; });
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::log(uint32_t key, const std::string& entry)
+{
+  logHash([key] { return hashKey(key); }, [key] { return std::to_string(key); },
+          [&entry] () -> const std::string& { return entry; });
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::log(uint64_t key, const std::string& entry)
+{
+  logHash([key] { return hashKey(key); }, [key] { return std::to_string(key); },
+          [&entry] () -> const std::string& { return entry; });
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::logHashed(uint64_t hash, const std::string& key, const std::string& entry)
+{
+  logHash([hash] { return hash; }, [&key] () -> const std::string& { return key; },
+          [&entry] () -> const std::string& { return entry; });
+}
+
+template<typename Sink, typename Clock, typename Filter>
+template<typename MakeHash, typename MakeKey, typename MakeEntry>
+void
+BasicCarousel<Sink, Clock, Filter>::logHash(const MakeHash& makeHash, const MakeKey& makeKey,
+                                            const MakeEntry& makeEntry)
+{
+  if (m_latency == nullptr) {
+    processHash(makeHash, makeKey, makeEntry);
+    return;
+  }
+
+  uint64_t start = m_latency->clock.now();
+  LogPath path = processHash(makeHash, makeKey, makeEntry);
+  uint64_t elapsed = m_latency->clock.now() - start;
+  m_latency->histograms[static_cast<size_t>(path)].record(m_latency->clock.toNanoseconds(elapsed));
+}
+
+template<typename Sink, typename Clock, typename Filter>
+template<typename MakeHash, typename MakeKey, typename MakeEntry>
+LogPath
+BasicCarousel<Sink, Clock, Filter>::processHash(const MakeHash& makeHash, const MakeKey& makeKey,
+                                                const MakeEntry& makeEntry)
+{
+
+  // Spread zeroing the bloom filter retired at the last phase change over the packet path
+  m_filter.clearStep();
+
+  bool isTransition = false;
+  uint64_t now = m_clock.now();
+  if (m_isSinkReported.load(std::memory_order_relaxed)) {
+    applySinkReport(now);
+  }
+  if (now >= m_phaseDeadline) {
+    // Time to go to the next phase
+    startNextPhase();
+    isTransition = true;
+  }
+
+  if (now < m_sinkFullUntil) {
+    // The sink would drop the entry anyway
+    m_nSkipped.increment();
+    return isTransition ? LogPath::PHASE_TRANSITION : LogPath::BACKPRESSURE;
+  }
+
+  // The same hash drives both the partition check and all bloom filter probes
+  uint64_t hash = makeHash();
+  if (m_sketch) {
+    observeKey(hash, now);
+  }
+  size_t phase = m_original ? m_v : (m_v & m_kMask);
+  // Check if key matches the current phase
+  if ((hash & m_kMask) == phase) {
+    // Check if likely (bloom filter) already stored this key this phase
+    bool isEvidenced = m_filter.isEvidenced(hash);
+    sampleFalsePositive(hash, isEvidenced);
+    if (isEvidenced) {
+      // Skip since likely already logged this phase
+      m_nDuplicates.increment();
+      return isTransition ? LogPath::PHASE_TRANSITION : LogPath::DUPLICATE;
+    }
+
+    // Call sink to log this key+entry, only now producing the entry, and only add the key to the
+    // filter if the sink took it, so that a refused key can be logged when it next arrives
+    SinkResult result = detail::invokeSink(m_sink, makeKey(), makeEntry(), 0);
+    if (result == SinkResult::ACCEPTED) {
+      m_filter.add(hash);
+      m_nAdmitted.increment();
+      m_nMatchingThisPhase++;
+    }
+    else {
+      onSinkRefused(result, hash, now);
+    }
+
+    // Check for bloom filter overflow
+    if (isBloomFilterOverflowed()) {
+      repartitionOverflow();
+      isTransition = true;
+    }
+    if (isTransition) {
+      return LogPath::PHASE_TRANSITION;
+    }
+    return result == SinkResult::ACCEPTED ? LogPath::ADMITTED : LogPath::BACKPRESSURE;
+  }
+
+  m_nOutsidePhase.increment();
+  return isTransition ? LogPath::PHASE_TRANSITION : LogPath::OUTSIDE_PHASE;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::logBatch(const std::string* keys, const std::string* entries, size_t n)
+{
+  timeBatch(nullptr, keys, entries, n);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::logBatchHashed(const uint64_t* hashes, const std::string* keys,
+                                                   const std::string* entries, size_t n)
+{
+  timeBatch(hashes, keys, entries, n);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::timeBatch(const uint64_t* hashes, const std::string* keys,
+                                              const std::string* entries, size_t n)
+{
+  if (m_latency == nullptr || n == 0) {
+    processBatch(hashes, keys, entries, n);
+    return;
+  }
+
+  uint64_t start = m_latency->clock.now();
+  processBatch(hashes, keys, entries, n);
+  uint64_t elapsed = m_latency->clock.now() - start;
+  m_latency->histograms[static_cast<size_t>(LogPath::BATCH)].record(
+    m_latency->clock.toNanoseconds(elapsed) / n);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::processBatch(const uint64_t* hashes, const std::string* keys,
+                                                 const std::string* entries, size_t n)
+{
+  for (size_t i = 0; i < n; i++) {
+    m_filter.clearStep();
+  }
+
+  uint64_t now = m_clock.now();
+  if (m_isSinkReported.load(std::memory_order_relaxed)) {
+    applySinkReport(now);
+  }
+  if (now >= m_phaseDeadline) {
+    // Time to go to the next phase
+    startNextPhase();
+  }
+
+  // Entries are passed to the log callback as they are admitted, so that it can refuse them
+  bool isInlineSink = !m_batchCallback;
+  if (isInlineSink && now < m_sinkFullUntil) {
+    m_nSkipped.add(n);
+    return;
+  }
+
+  if (hashes == nullptr) {
+    m_batchHashes.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      m_batchHashes[i] = hashKey(keys[i]);
+    }
+    hashes = m_batchHashes.data();
+  }
+  if (m_sketch) {
+    for (size_t i = 0; i < n; i++) {
+      observeKey(hashes[i], now);
+    }
+  }
+
+  m_batchAdmitted.clear();
+  size_t begin = 0;
+  while (begin < n) {
+    size_t phase = m_original ? m_v : (m_v & m_kMask);
+    m_batchMatches.clear();
+    for (size_t i = begin; i < n; i++) {
+      if ((hashes[i] & m_kMask) == phase) {
+        m_batchMatches.push_back(i);
+        m_filter.prefetch(hashes[i]);
+      }
+    }
+
+    size_t end = n;
+    size_t nMatched = 0;
+    size_t nDuplicates = 0;
+    bool isOverflowed = false;
+    bool isFull = false;
+    for (size_t i : m_batchMatches) {
+      uint64_t hash = hashes[i];
+      nMatched++;
+      // Check if likely (bloom filter) already stored this key this phase
+      bool isEvidenced = m_filter.isEvidenced(hash);
+      sampleFalsePositive(hash, isEvidenced);
+      if (isEvidenced) {
+        nDuplicates++;
+        continue;
+      }
+
+      SinkResult result = SinkResult::ACCEPTED;
+      if (isInlineSink) {
+        result = detail::invokeSink(m_sink, keys[i], entries[i], 0);
+      }
+      if (result == SinkResult::ACCEPTED) {
+        m_filter.add(hash);
+        m_nAdmitted.increment();
+        m_batchAdmitted.push_back(i);
+        m_nMatchingThisPhase++;
+      }
+      else {
+        onSinkRefused(result, hash, now);
+      }
+
+      // Check for bloom filter overflow
+      if (isBloomFilterOverflowed()) {
+        // The remaining keys need to be matched against the new phase
+        end = i + 1;
+        isOverflowed = true;
+        break;
+      }
+      if (result == SinkResult::FULL) {
+        isFull = true;
+        break;
+      }
+    }
+
+    // Counted before repartitioning, so that the summary of the phase includes them
+    m_nDuplicates.add(nDuplicates);
+    if (isFull) {
+      // The matching keys left are skipped, the others are outside the phase anyway
+      m_nSkipped.add(m_batchMatches.size() - nMatched);
+      m_nOutsidePhase.add(end - begin - m_batchMatches.size());
+      break;
+    }
+    m_nOutsidePhase.add(end - begin - nMatched);
+    if (isOverflowed) {
+      repartitionOverflow();
+      if (isInlineSink && now < m_sinkFullUntil) {
+        // The sink became full with the key that overflowed the phase
+        m_nSkipped.add(n - end);
+        break;
+      }
+    }
+    begin = end;
+  }
+
+  if (m_batchCallback && !m_batchAdmitted.empty()) {
+    m_batchCallback(keys, entries, m_batchAdmitted.data(), m_batchAdmitted.size());
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::setBatchCallback(const BatchLogCallback& callback)
+{
+  m_batchCallback = callback;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::setPhaseCallback(const PhaseCallback& callback)
+{
+  m_phaseCallback = callback;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::reportSinkState(double drainRate, size_t queueDepth)
+{
+  m_sinkDrainRate.store(drainRate, std::memory_order_relaxed);
+  m_sinkQueueDepth.store(queueDepth, std::memory_order_relaxed);
+  m_isSinkReported.store(true, std::memory_order_release);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+CarouselStats
+BasicCarousel<Sink, Clock, Filter>::stats() const
+{
+  CarouselStats stats;
+  stats.k = m_statK.load();
+  stats.v = m_statV.load();
+  stats.phaseDuration = std::chrono::nanoseconds(m_statPhaseDuration.load());
+  stats.phaseCapacity = m_statPhaseCapacity.load();
+  stats.nEstimatedKeys = m_statEstimatedKeys.load();
+  stats.nPhases = m_nPhases.load();
+  stats.nOverflows = m_nOverflows.load();
+  stats.nUnderflows = m_nUnderflows.load();
+  stats.nAdmitted = m_nAdmitted.load();
+  stats.nDuplicates = m_nDuplicates.load();
+  stats.nOutsidePhase = m_nOutsidePhase.load();
+  stats.nRejected = m_nRejected.load();
+  stats.nSkipped = m_nSkipped.load();
+  stats.nSampledNew = m_nSampledNew.load();
+  stats.nSampledFalsePositives = m_nSampledFalsePositives.load();
+  uint64_t phaseStart = m_phaseStartAdmitted.load();
+  stats.nAdmittedThisPhase = stats.nAdmitted > phaseStart ? stats.nAdmitted - phaseStart : 0;
+  return stats;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::setLatencyTracking(bool isEnabled)
+{
+  if (isEnabled && !m_latencyStorage) {
+    m_latencyStorage.reset(new Latency);
+  }
+  m_latency = isEnabled ? m_latencyStorage.get() : nullptr;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::setFalsePositiveSampling(bool isEnabled)
+{
+  if (isEnabled && m_samples.empty()) {
+    // Room for four times the keys sampled in a phase of full capacity
+    size_t size = 16;
+    while (size < m_memorySize / 16) {
+      size *= 2;
+    }
+    m_samples.assign(size, Sample{0, 0});
+  }
+  m_isSampling = isEnabled;
+  if (!isEnabled) {
+    m_isSamplingPhase = false;
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+const LatencyHistogram*
+BasicCarousel<Sink, Clock, Filter>::latencyHistogram(LogPath path) const
+{
+  if (!m_latencyStorage) {
+    return nullptr;
+  }
+  return &m_latencyStorage->histograms[static_cast<size_t>(path)];
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::printLatency(std::ostream& os) const
+{
+  for (size_t i = 0; i < N_LOG_PATHS; i++) {
+    const LatencyHistogram* histogram = latencyHistogram(static_cast<LogPath>(i));
+    if (histogram != nullptr && histogram->count() > 0) {
+      histogram->print(os, logPathName(static_cast<LogPath>(i)));
+    }
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::reset()
+{
+  m_filter.reset();
+  clearSamples();
+  m_k = 0;
+  m_kMask = 0;
+  m_v = 0;
+  m_sinkFullUntil = 0;
+  adaptToSink();
+  m_phaseStart = m_clock.now();
+  m_phaseDeadline = m_phaseStart + m_phaseDurationTicks;
+  m_nMatchingThisPhase = 0;
+  m_statK.store(m_k);
+  m_statV.store(m_v);
+  m_phaseStartAdmitted.store(m_nAdmitted.load());
+  m_phaseStartDuplicates = m_nDuplicates.load();
+  m_phaseStartOutsidePhase = m_nOutsidePhase.load();
+  m_phaseStartSampledNew = m_nSampledNew.load();
+  m_phaseStartSampledFalsePositives = m_nSampledFalsePositives.load();
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::clearSamples()
+{
+  m_sampleGeneration++;
+  m_nSamplesThisPhase = 0;
+  m_isSamplingPhase = m_isSampling;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::startNextPhase()
+{
+  // The deadline is only zero before the first phase starts, at the first key
+  if (m_phaseDeadline != 0) {
+    endPhase(PhaseSummary::End::DEADLINE);
+  }
+
+  if (m_sketch) {
+    size_t k = estimateK(false);
+    if (k < m_k) {
+      m_nUnderflows.increment();
+    }
+    m_k = k;
+    m_kMask = std::pow(2, m_k) - 1;
+  }
+  // Check for bloom filter underflow, unless the phase was cut short to feed the sink
+  else if (!m_isSinkStarved && isBloomFilterUnderflowed()) {
+    size_t k = m_k;
+    repartitionUnderflow();
+    if (m_k != k) {
+      m_nUnderflows.increment();
+    }
+  }
+
+  m_filter.reset();
+  clearSamples();
+  if (m_original) {
+    m_v = (m_v + 1) % static_cast<size_t>(std::pow(2, m_k));
+  } else {
+    m_v++;
+  }
+  adaptToSink();
+  m_phaseStart = m_clock.now();
+  m_phaseDeadline = m_phaseStart + m_phaseDurationTicks;
+  m_nMatchingThisPhase = 0;
+  m_statK.store(m_k);
+  m_statV.store(m_v);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::endPhase(PhaseSummary::End end)
+{
+  uint64_t nAdmitted = m_nAdmitted.load();
+  uint64_t nDuplicates = m_nDuplicates.load();
+  uint64_t nOutsidePhase = m_nOutsidePhase.load();
+  uint64_t nSampledNew = m_nSampledNew.load();
+  uint64_t nSampledFalsePositives = m_nSampledFalsePositives.load();
+
+  if (m_phaseCallback) {
+    PhaseSummary summary;
+    summary.phase = m_nPhases.load();
+    summary.k = m_k;
+    summary.v = m_v;
+    summary.end = end;
+    uint64_t elapsed = m_clock.now() - m_phaseStart;
+    summary.duration = std::chrono::nanoseconds(
+      static_cast<int64_t>(static_cast<double>(elapsed) / m_ticksPerSecond * 1e9));
+    summary.capacity = m_phaseCapacity;
+    summary.nAdmitted = nAdmitted - m_phaseStartAdmitted.load();
+    summary.nDuplicates = nDuplicates - m_phaseStartDuplicates;
+    summary.nOutsidePhase = nOutsidePhase - m_phaseStartOutsidePhase;
+    summary.fillRatio = m_filter.fillRatio();
+    summary.expectedFalsePositiveRate = m_filter.expectedFalsePositiveRate(m_nMatchingThisPhase);
+    summary.nSampledNew = nSampledNew - m_phaseStartSampledNew;
+    summary.nSampledFalsePositives = nSampledFalsePositives - m_phaseStartSampledFalsePositives;
+    m_phaseCallback(summary);
+  }
+
+  m_nPhases.increment();
+  m_phaseStartAdmitted.store(nAdmitted);
+  m_phaseStartDuplicates = nDuplicates;
+  m_phaseStartOutsidePhase = nOutsidePhase;
+  m_phaseStartSampledNew = nSampledNew;
+  m_phaseStartSampledFalsePositives = nSampledFalsePositives;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::repartitionOverflow()
+{
+  endPhase(PhaseSummary::End::BLOOM_OVERFLOW);
+  m_nOverflows.increment();
+
+  m_filter.reset();
+  clearSamples();
+  m_k = m_sketch ? std::max(m_k + 1, estimateK(true)) : m_k + 1;
+  m_kMask = std::pow(2, m_k) - 1;
+  if (m_original) {
+    m_v = (m_v + 1) % static_cast<size_t>(std::pow(2, m_k));
+  } else {
+    m_v++;
+  }
+  adaptToSink();
+  m_phaseStart = m_clock.now();
+  m_phaseDeadline = m_phaseStart + m_phaseDurationTicks;
+  m_nMatchingThisPhase = 0;
+  m_statK.store(m_k);
+  m_statV.store(m_v);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::repartitionUnderflow()
+{
+  if (m_k > 0) {
+    m_k--;
+    m_kMask = std::pow(2, m_k) - 1;
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::startSketchWindow(uint64_t now)
+{
+  // The window that just ended only counts if it ended before this one starts, i.e., if keys were
+  // observed during the last window duration
+  bool isAdjacent = m_sketchDeadline != 0 && now - m_sketchDeadline < m_phaseDurationTicks;
+  m_lastWindowEstimate = isAdjacent ? m_sketch->estimate() : 0;
+  m_sketch->reset();
+  m_sketchWindowStart = now;
+  m_sketchDeadline = now + m_phaseDurationTicks;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+size_t
+BasicCarousel<Sink, Clock, Filter>::estimateK(bool isOverflow)
+{
+  double estimate = m_sketch->estimate();
+  double nKeys = std::max(m_lastWindowEstimate, estimate);
+  uint64_t elapsed = m_clock.now() - m_sketchWindowStart;
+  if (isOverflow && 2 * elapsed >= m_phaseDurationTicks && elapsed < m_phaseDurationTicks) {
+    // New keys keep arriving at most at the rate seen so far in the window, as some of the keys to
+    // come were already seen; earlier in the window, the projection overshoots by too much
+    nKeys = std::max(nKeys, estimate * m_phaseDurationTicks / elapsed);
+  }
+  m_statEstimatedKeys.store(static_cast<uint64_t>(nKeys));
+
+  size_t k = 0;
+  while (k < 63 && nKeys > std::ldexp(static_cast<double>(m_phaseCapacity), k)) {
+    k++;
+  }
+  return k;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::setCardinalityRepartitioning(bool isEnabled)
+{
+  if (isEnabled && !m_sketch) {
+    m_sketch.reset(new HyperLogLog);
+    m_sketchDeadline = 0;
+    m_lastWindowEstimate = 0;
+  }
+  else if (!isEnabled) {
+    m_sketch.reset();
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::saveSnapshot(const std::string& path) const
+{
+  // Converted from clock ticks in proportion to the duration of the phase, as in endPhase
+  uint64_t now = m_clock.now();
+  int64_t remaining = 0;
+  if (m_phaseDeadline > now && m_phaseDurationTicks != 0) {
+    remaining = static_cast<int64_t>(static_cast<double>(m_phaseDeadline - now) /
+                                     m_phaseDurationTicks * m_phaseDuration.count());
+  }
+
+  SnapshotState state;
+  state.memorySize = m_memorySize;
+  state.original = m_original;
+  state.filterTag = m_filter.formatTag();
+  state.nFilterWords = m_filter.nWords();
+  state.k = m_k;
+  state.v = m_v;
+  state.nMatchingThisPhase = m_nMatchingThisPhase;
+  state.phaseCapacity = m_phaseCapacity;
+  state.phaseDuration = m_phaseDuration.count();
+  state.phaseRemaining = remaining;
+  state.savedAt = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count();
+  writeSnapshot(path, state, m_filter.words());
+}
+
+template<typename Sink, typename Clock, typename Filter>
+SnapshotResult
+BasicCarousel<Sink, Clock, Filter>::restoreSnapshot(const std::string& path)
+{
+  MappedSnapshot snapshot;
+  SnapshotResult result = snapshot.open(path);
+  if (result != SnapshotResult::RESTORED) {
+    return result;
+  }
+  const SnapshotState& state = snapshot.state();
+  if (state.memorySize != m_memorySize || state.original != m_original ||
+      state.filterTag != m_filter.formatTag() || state.nFilterWords != m_filter.nWords()) {
+    return SnapshotResult::INCOMPATIBLE;
+  }
+  if (state.phaseDuration <= 0 || state.phaseCapacity == 0 || state.k >= 64) {
+    return SnapshotResult::DAMAGED;
+  }
+  // In original mode, the phase cycles through the 2^k partitions
+  if (m_original && state.v >> state.k != 0) {
+    return SnapshotResult::DAMAGED;
+  }
+
+  m_filter.loadWords(snapshot.filterWords());
+  // The restored filter holds keys that were not sampled, which would count as false positives, so
+  // sampling resumes with the next phase
+  clearSamples();
+  m_isSamplingPhase = false;
+  m_k = state.k;
+  m_kMask = std::pow(2, m_k) - 1;
+  m_v = state.v;
+  m_nMatchingThisPhase = state.nMatchingThisPhase;
+  m_phaseDuration = std::chrono::nanoseconds(state.phaseDuration);
+  m_phaseDurationTicks = m_clock.toTicks(m_phaseDuration);
+  m_phaseCapacity = state.phaseCapacity;
+
+  int64_t downtime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::system_clock::now().time_since_epoch()).count() - state.savedAt;
+  int64_t remaining = std::min(state.phaseRemaining - std::max<int64_t>(downtime, 0),
+                               state.phaseDuration);
+  uint64_t now = m_clock.now();
+  m_phaseDeadline = now + (remaining > 0 ? m_clock.toTicks(std::chrono::nanoseconds(remaining)) : 0);
+  // Backdated by the part of the phase already elapsed, without going before the clock origin
+  m_phaseStart = m_phaseDeadline - std::min(m_phaseDurationTicks, m_phaseDeadline);
+  m_sinkFullUntil = 0;
+  m_sketchDeadline = 0;
+
+  m_statK.store(m_k);
+  m_statV.store(m_v);
+  m_statPhaseDuration.store(m_phaseDuration.count());
+  m_statPhaseCapacity.store(m_phaseCapacity);
+  m_phaseStartAdmitted.store(m_nAdmitted.load());
+  m_phaseStartDuplicates = m_nDuplicates.load();
+  m_phaseStartOutsidePhase = m_nOutsidePhase.load();
+  m_phaseStartSampledNew = m_nSampledNew.load();
+  m_phaseStartSampledFalsePositives = m_nSampledFalsePositives.load();
+  return SnapshotResult::RESTORED;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+bool
+BasicCarousel<Sink, Clock, Filter>::isBloomFilterOverflowed()
+{
+  return m_nMatchingThisPhase > m_phaseCapacity;
+}
+
+template<typename Sink, typename Clock, typename Filter>
+bool
+BasicCarousel<Sink, Clock, Filter>::isBloomFilterUnderflowed()
+{
+  return static_cast<double>(m_nMatchingThisPhase) < (static_cast<double>(m_phaseCapacity) / m_x);
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::applySinkReport(uint64_t now)
+{
+  // Cleared as the report is taken, so that each report is applied once
+  if (!m_isSinkReported.exchange(false, std::memory_order_acquire)) {
+    return;
+  }
+  double drainRate = m_sinkDrainRate.load(std::memory_order_relaxed);
+  double queueDepth = static_cast<double>(m_sinkQueueDepth.load(std::memory_order_relaxed));
+
+  // Exponentially weighted, so that one report taken during a burst does not swing the duration
+  const double weight = 0.25;
+  if (drainRate > 0) {
+    m_drainRate = m_drainRate == 0 ? drainRate : m_drainRate + weight * (drainRate - m_drainRate);
+  }
+
+  bool hasInterval = m_hasSinkReport;
+  uint64_t interval = now - m_lastSinkReport;
+  bool isIntervalInPhase = hasInterval && m_lastSinkReport >= m_phaseStart;
+  uint64_t nAdmitted = m_nAdmitted.load();
+  uint64_t nAdmittedInInterval = nAdmitted - m_sinkReportAdmitted;
+  m_hasSinkReport = true;
+  m_lastSinkReport = now;
+  m_sinkReportAdmitted = nAdmitted;
+  if (!hasInterval || m_drainRate == 0) {
+    return;
+  }
+
+  // The sink is about to idle once it holds fewer entries than it records until the report after
+  // next. The phase then gives way to the next one if it filled the sink before, or if it admitted
+  // fewer keys than the sink recorded since the last report, as its keys have mostly been logged.
+  double nPerInterval = m_drainRate * interval / m_ticksPerSecond;
+  if (queueDepth > 2 * nPerInterval) {
+    m_isSinkBacklogged = true;
+  }
+  else if ((m_isSinkBacklogged || (isIntervalInPhase && nAdmittedInInterval < nPerInterval)) &&
+           now < m_phaseDeadline) {
+    m_phaseDeadline = now;
+    m_isSinkStarved = true;
+  }
+}
+
+template<typename Sink, typename Clock, typename Filter>
+void
+BasicCarousel<Sink, Clock, Filter>::adaptToSink()
+{
+  m_isSinkBacklogged = false;
+  m_isSinkStarved = false;
+  if (m_drainRate == 0) {
+    return;
+  }
+
+  // The time the sink takes to record memorySize entries at the rate it was measured to drain them
+  m_phaseDuration = std::chrono::nanoseconds(static_cast<int64_t>(m_memorySize / m_drainRate * 1e9));
+  m_phaseDurationTicks = m_clock.toTicks(m_phaseDuration);
+  m_statPhaseDuration.store(m_phaseDuration.count());
+}
+
+extern template class BasicCarousel<LogCallback, SteadyClock>;
+extern template class BasicCarousel<LogCallback, TscClock>;
+extern template class BasicCarousel<LogCallback, ManualClock>;
+extern template class BasicCarousel<LogCallback, SteadyClock, CuckooFilter>;
+extern template class BasicCarousel<BackpressureLogCallback, SteadyClock>;
+
+typedef BasicCarousel<LogCallback, SteadyClock> Carousel;
+typedef BasicCarousel<LogCallback, SteadyClock, CuckooFilter> CuckooCarousel;
+
 } // namespace carousel
 
 #endif // CAROUSEL_CAROUSEL_HPP
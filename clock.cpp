@@ -0,0 +1,37 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "clock.hpp"
+
+#include <thread>
+
+namespace carousel {
+
+namespace {
+
+double
+calibrateTsc()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  SteadyClock steady;
+  uint64_t steadyStart = steady.now();
+  uint64_t tscStart = __builtin_ia32_rdtsc();
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  uint64_t steadyEnd = steady.now();
+  uint64_t tscEnd = __builtin_ia32_rdtsc();
+  return static_cast<double>(tscEnd - tscStart) / static_cast<double>(steadyEnd - steadyStart);
+#else
+  return 1.0;
+#endif
+}
+
+} // namespace
+
+TscClock::TscClock()
+{
+  // Calibrated once, by whichever thread gets here first
+  static const double ticksPerNanosecond = calibrateTsc();
+  m_ticksPerNanosecond = ticksPerNanosecond;
+}
+
+} // namespace carousel
@@ -0,0 +1,135 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_CLOCK_HPP
+#define CAROUSEL_CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace carousel {
+
+/**
+ * Clocks driving the phases of Carousel
+ *
+ * A clock counts time in ticks of its own choosing. It provides now(), which returns the current
+ * time in ticks, and toTicks(), which converts a duration into ticks, so that Carousel can keep
+ * the end of the current phase as a tick count and check it with a single comparison.
+ */
+
+/**
+ * \brief Clock reading std::chrono::steady_clock, ticking in nanoseconds
+ */
+class SteadyClock
+{
+public:
+  uint64_t
+  now() const
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  uint64_t
+  toTicks(std::chrono::nanoseconds duration) const
+  {
+    return duration.count();
+  }
+};
+
+/**
+ * \brief Clock reading the time stamp counter of the processor, ticking in TSC cycles
+ *
+ * Reading the TSC avoids the clock_gettime call behind steady_clock, at the price of precision:
+ * the tick rate is calibrated against steady_clock once per process, and reads are not
+ * serialized with surrounding instructions. This requires an invariant TSC; on other
+ * architectures, this clock falls back to steady_clock.
+ */
+class TscClock
+{
+public:
+  TscClock();
+
+  uint64_t
+  now() const
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return SteadyClock().now();
+#endif
+  }
+
+  uint64_t
+  toTicks(std::chrono::nanoseconds duration) const
+  {
+    return static_cast<uint64_t>(duration.count() * m_ticksPerNanosecond);
+  }
+
+  /**
+   * \brief Converts a number of ticks, e.g., the difference of two now() readings, into nanoseconds
+   */
+  uint64_t
+  toNanoseconds(uint64_t ticks) const
+  {
+    return static_cast<uint64_t>(ticks / m_ticksPerNanosecond);
+  }
+
+private:
+  double m_ticksPerNanosecond;
+};
+
+/**
+ * \brief Clock advanced explicitly by the caller, ticking in nanoseconds of virtual time
+ *
+ * Copies of a ManualClock share the same time, so the caller can keep one copy to drive the
+ * instances it has passed another copy to. This allows replaying traces faster than real time
+ * and with deterministic phase boundaries.
+ */
+class ManualClock
+{
+public:
+  ManualClock()
+    : m_now(std::make_shared<std::atomic<uint64_t>>(0))
+  {
+  }
+
+  uint64_t
+  now() const
+  {
+    return m_now->load(std::memory_order_relaxed);
+  }
+
+  uint64_t
+  toTicks(std::chrono::nanoseconds duration) const
+  {
+    return duration.count();
+  }
+
+  /**
+   * \brief Moves the virtual time forward by the specified duration
+   */
+  void
+  advance(std::chrono::nanoseconds duration)
+  {
+    m_now->fetch_add(duration.count(), std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Sets the virtual time, counted from the creation of the clock
+   */
+  void
+  set(std::chrono::nanoseconds sinceStart)
+  {
+    m_now->store(sinceStart.count(), std::memory_order_relaxed);
+  }
+
+private:
+  std::shared_ptr<std::atomic<uint64_t>> m_now;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_CLOCK_HPP
@@ -0,0 +1,132 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "concurrent-carousel.hpp"
+#include "hash.hpp"
+
+namespace carousel {
+
+ConcurrentCarousel::ConcurrentCarousel(const LogCallback& callback,
+                                       size_t memorySize,
+                                       std::chrono::milliseconds collectionInterval,
+                                       bool original,
+                                       const Bloom::Config& filterConfig)
+  : m_callback(callback)
+  , m_bloom(filterConfig, memorySize)
+  , m_memorySize(memorySize)
+  , m_collectionInterval(collectionInterval)
+  , m_phaseDuration(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      collectionInterval * memorySize).count())
+  , m_state(packState(0, 0, 0))
+  , m_phaseDeadline(0)
+  , m_nMatchingThisPhase(0)
+  , m_original(original)
+{
+}
+
+void
+ConcurrentCarousel::log(const std::string& key, const std::string& entry)
+{
+  // Spread zeroing the spare bloom filter buffer over the packet path of all threads
+  m_bloom.clearStep();
+
+  uint64_t state = m_state.load(std::memory_order_acquire);
+  if ((state & STATE_BUSY) == 0 && now() >= m_phaseDeadline.load(std::memory_order_relaxed)) {
+    // Time to go to the next phase
+    advance(state);
+    state = m_state.load(std::memory_order_acquire);
+  }
+
+  uint64_t hash = hashKey(key);
+
+  size_t k = (state >> STATE_K_SHIFT) & STATE_K_MASK;
+  size_t kMask = (size_t(1) << k) - 1;
+  size_t v = state & STATE_V_MASK;
+  size_t buffer = (state >> STATE_BUFFER_SHIFT) & 1;
+
+  size_t phase = m_original ? v : (v & kMask);
+  // Check if key matches the current phase
+  if ((hash & kMask) != phase) {
+    return;
+  }
+
+  // Check if likely (bloom filter) already stored this key this phase, claiming it otherwise
+  if (m_bloom.testAndAdd(buffer, hash)) {
+    return;
+  }
+
+  // Every thread counting past the memory size tries to advance, so that the overflow is not lost
+  // when the first one cannot claim the state; the others find it claimed or already advanced
+  if (m_nMatchingThisPhase.fetch_add(1, std::memory_order_relaxed) >= m_memorySize) {
+    advance(state);
+  }
+
+  m_callback(key, entry);
+}
+
+void
+ConcurrentCarousel::reset()
+{
+  m_bloom.reset(0);
+  m_nMatchingThisPhase.store(0, std::memory_order_relaxed);
+  m_phaseDeadline.store(now() + m_phaseDuration, std::memory_order_relaxed);
+  m_state.store(packState(0, 0, 0), std::memory_order_release);
+}
+
+void
+ConcurrentCarousel::advance(uint64_t state)
+{
+  // Claim the transition; if another thread got there first, it is the one advancing the phase
+  if ((state & STATE_BUSY) != 0 ||
+      !m_state.compare_exchange_strong(state, state | STATE_BUSY, std::memory_order_acquire)) {
+    return;
+  }
+
+  size_t k = (state >> STATE_K_SHIFT) & STATE_K_MASK;
+  size_t v = state & STATE_V_MASK;
+  size_t buffer = (state >> STATE_BUFFER_SHIFT) & 1;
+
+  // Counting restarts here rather than once the phase is advanced, so that a key counted past the
+  // memory size is either seen now, or counted towards the next phase
+  size_t nMatching = m_nMatchingThisPhase.exchange(0, std::memory_order_relaxed);
+  if (nMatching > m_memorySize) {
+    if (k < STATE_K_MASK) {
+      k++;
+    }
+  }
+  else if (static_cast<double>(nMatching) < static_cast<double>(m_memorySize) / m_x) {
+    // Bloom filter underflow
+    if (k > 0) {
+      k--;
+    }
+  }
+
+  if (m_original) {
+    v = (v + 1) & ((size_t(1) << k) - 1);
+  }
+  else {
+    v = (v + 1) & STATE_V_MASK;
+  }
+  buffer ^= 1;
+
+  m_bloom.prepare(buffer);
+  m_phaseDeadline.store(now() + m_phaseDuration, std::memory_order_relaxed);
+  m_state.store(packState(k, v, buffer), std::memory_order_release);
+}
+
+uint64_t
+ConcurrentCarousel::packState(size_t k, size_t v, size_t buffer)
+{
+  return (static_cast<uint64_t>(k) << STATE_K_SHIFT) |
+         (static_cast<uint64_t>(buffer) << STATE_BUFFER_SHIFT) |
+         (static_cast<uint64_t>(v) & STATE_V_MASK);
+}
+
+int64_t
+ConcurrentCarousel::now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace carousel
@@ -0,0 +1,100 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_CONCURRENT_CAROUSEL_HPP
+#define CAROUSEL_CONCURRENT_CAROUSEL_HPP
+
+#include "atomic-bloom.hpp"
+#include "carousel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace carousel {
+
+/**
+ * \brief Variant of Carousel that may be used by several threads at once
+ *
+ * All threads share one memory budget and one sequence of phases. The partition state is kept in
+ * a single atomic word; a thread that observes the end of a phase, or the overflow of the bloom
+ * filter, tries to claim that word, and the one that does is the only one to advance it, while the
+ * other threads keep logging against the previous phase in the meantime.
+ */
+class ConcurrentCarousel
+{
+public:
+  typedef Carousel::LogCallback LogCallback;
+
+public:
+  /**
+   * \brief Creates an instance of ConcurrentCarousel that outputs to the specified callback
+   * \param callback Callback invoked for each logged entry, possibly from several threads at once
+   * \param memorySize Number of sources that can be logged
+   * \param collectionInterval Interval at which logger can accept log entries
+   * \param original Whether to use the original behavior in the paper or our proposed new one
+   * \param filterConfig Layout and size of the filter used to suppress duplicates within a
+   *        phase, which holds up to memorySize keys (see Bloom::Config)
+   */
+  ConcurrentCarousel(const LogCallback& callback,
+                     size_t memorySize,
+                     std::chrono::milliseconds collectionInterval,
+                     bool original = true,
+                     const Bloom::Config& filterConfig = Bloom::Config());
+
+  /**
+   * \brief Submit the specified entry to Carousel; safe to call from several threads at once
+   * \param key Logging key
+   * \param entry Entry for log for the given key
+   */
+  void
+  log(const std::string& key, const std::string& entry);
+
+  /**
+   * \brief Reset Carousel; must not be called concurrently with log
+   */
+  void
+  reset();
+
+private:
+  /**
+   * \brief Goes to the next phase, unless another thread is already advancing from state
+   *
+   * The phase overflowed if more than memorySize keys were counted in it by then, whichever
+   * thread observed it.
+   */
+  void
+  advance(uint64_t state);
+
+  static uint64_t
+  packState(size_t k, size_t v, size_t buffer);
+
+  static int64_t
+  now();
+
+private:
+  // Layout of m_state: transition in progress, k, bloom filter buffer in use, v
+  static const uint64_t STATE_BUSY = uint64_t(1) << 63;
+  static const unsigned STATE_K_SHIFT = 57;
+  static const uint64_t STATE_K_MASK = 0x3f;
+  static const unsigned STATE_BUFFER_SHIFT = 56;
+  static const uint64_t STATE_V_MASK = (uint64_t(1) << STATE_BUFFER_SHIFT) - 1;
+
+  LogCallback m_callback;
+  AtomicBloom m_bloom;
+  const double m_x = 2.3;
+
+  const size_t m_memorySize;
+  const std::chrono::milliseconds m_collectionInterval;
+  const int64_t m_phaseDuration; // in steady clock nanoseconds
+
+  alignas(64) std::atomic<uint64_t> m_state;
+  std::atomic<int64_t> m_phaseDeadline; // in steady clock nanoseconds
+  alignas(64) std::atomic<size_t> m_nMatchingThisPhase;
+
+  const bool m_original;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_CONCURRENT_CAROUSEL_HPP
@@ -0,0 +1,207 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "cuckoo-filter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+namespace carousel {
+
+namespace {
+
+const size_t CACHE_LINE_SIZE = 64;
+const size_t BUCKETS_PER_LINE = CACHE_LINE_SIZE / sizeof(uint64_t);
+
+// One in each 16-bit lane of a bucket, and the top bit of each lane
+const uint64_t LANES_LOW = 0x0001000100010001ULL;
+const uint64_t LANES_HIGH = 0x8000800080008000ULL;
+
+size_t
+roundUpToPowerOfTwo(size_t n)
+{
+  size_t p = BUCKETS_PER_LINE;
+  while (p < n) {
+    p <<= 1;
+  }
+  return p;
+}
+
+/**
+ * \brief Returns a word that is non-zero if and only if a 16-bit lane of the bucket is equal to
+ *        the fingerprint, and whose lowest set bit is the top bit of the lowest such lane
+ */
+inline uint64_t
+matchingLanes(uint64_t bucket, uint16_t fingerprint)
+{
+  uint64_t x = bucket ^ (fingerprint * LANES_LOW);
+  return (x - LANES_LOW) & ~x & LANES_HIGH;
+}
+
+} // namespace
+
+void
+CuckooFilter::FreeDeleter::operator()(uint64_t* p) const
+{
+  std::free(p);
+}
+
+CuckooFilter::CuckooFilter(const Config& config, size_t nKeys)
+  : CuckooFilter(static_cast<size_t>(std::ceil(nKeys / (SLOTS_PER_BUCKET * config.loadFactor))))
+{
+}
+
+CuckooFilter::CuckooFilter(size_t nBuckets)
+  : m_nBuckets(roundUpToPowerOfTwo(nBuckets))
+  , m_mask(m_nBuckets - 1)
+  , m_clearCursor(m_nBuckets)
+  , m_nKicks(0)
+  , m_victim(0)
+  , m_victimBucket(0)
+{
+  void* p = nullptr;
+  if (posix_memalign(&p, CACHE_LINE_SIZE, 2 * m_nBuckets * sizeof(uint64_t)) != 0) {
+    throw std::bad_alloc();
+  }
+  m_storage.reset(static_cast<uint64_t*>(p));
+  std::memset(m_storage.get(), 0, 2 * m_nBuckets * sizeof(uint64_t));
+  m_buckets = m_storage.get();
+  m_retired = m_storage.get() + m_nBuckets;
+}
+
+uint16_t
+CuckooFilter::fingerprintOf(uint64_t hash)
+{
+  // Mixed so that the fingerprint depends on other bits than the bucket index, which are the
+  // high bits, and the partition of Carousel, which are the low bits; 0 marks an empty slot
+  uint16_t fingerprint = static_cast<uint16_t>(((hash ^ (hash >> 29)) * 0xbf58476d1ce4e5b9ULL) >> 48);
+  return fingerprint != 0 ? fingerprint : 1;
+}
+
+size_t
+CuckooFilter::alternateBucket(size_t bucket, uint16_t fingerprint) const
+{
+  // XOR with a hash of the fingerprint, so that the alternate of the alternate is the bucket
+  return (bucket ^ ((fingerprint * 0x5bd1e995ULL) >> 8)) & m_mask;
+}
+
+bool
+CuckooFilter::contains(size_t bucket, uint16_t fingerprint) const
+{
+  return matchingLanes(m_buckets[bucket], fingerprint) != 0;
+}
+
+bool
+CuckooFilter::tryInsert(size_t bucket, uint16_t fingerprint)
+{
+  uint64_t empty = matchingLanes(m_buckets[bucket], 0);
+  if (empty == 0) {
+    return false;
+  }
+  // The lowest empty lane
+  unsigned shift = __builtin_ctzll(empty) - 15;
+  m_buckets[bucket] |= static_cast<uint64_t>(fingerprint) << shift;
+  return true;
+}
+
+void
+CuckooFilter::add(uint64_t hash)
+{
+  uint16_t fingerprint = fingerprintOf(hash);
+  size_t bucket = (hash >> 32) & m_mask;
+  if (tryInsert(bucket, fingerprint)) {
+    return;
+  }
+  bucket = alternateBucket(bucket, fingerprint);
+  if (tryInsert(bucket, fingerprint)) {
+    return;
+  }
+
+  // Both buckets are full: evict fingerprints to their alternate bucket until one finds room
+  for (size_t i = 0; i < MAX_KICKS; i++) {
+    unsigned shift = 16 * (m_nKicks++ % SLOTS_PER_BUCKET);
+    uint16_t evicted = static_cast<uint16_t>(m_buckets[bucket] >> shift);
+    m_buckets[bucket] ^= static_cast<uint64_t>(evicted ^ fingerprint) << shift;
+    fingerprint = evicted;
+    bucket = alternateBucket(bucket, fingerprint);
+    if (tryInsert(bucket, fingerprint)) {
+      return;
+    }
+  }
+
+  if (m_victim == 0) {
+    m_victim = fingerprint;
+    m_victimBucket = bucket;
+  }
+}
+
+bool
+CuckooFilter::isEvidenced(uint64_t hash) const
+{
+  uint16_t fingerprint = fingerprintOf(hash);
+  size_t bucket = (hash >> 32) & m_mask;
+  size_t alternate = alternateBucket(bucket, fingerprint);
+  if (contains(bucket, fingerprint) || contains(alternate, fingerprint)) {
+    return true;
+  }
+  return m_victim == fingerprint && (m_victimBucket == bucket || m_victimBucket == alternate);
+}
+
+void
+CuckooFilter::prefetch(uint64_t hash) const
+{
+  size_t bucket = (hash >> 32) & m_mask;
+  __builtin_prefetch(m_buckets + bucket);
+  __builtin_prefetch(m_buckets + alternateBucket(bucket, fingerprintOf(hash)));
+}
+
+void
+CuckooFilter::reset()
+{
+  if (m_clearCursor < m_nBuckets) {
+    std::memset(m_retired + m_clearCursor, 0, (m_nBuckets - m_clearCursor) * sizeof(uint64_t));
+  }
+  std::swap(m_buckets, m_retired);
+  m_clearCursor = 0;
+  m_victim = 0;
+}
+
+void
+CuckooFilter::clearRetiredSlice()
+{
+  std::memset(m_retired + m_clearCursor, 0, BUCKETS_PER_LINE * sizeof(uint64_t));
+  m_clearCursor += BUCKETS_PER_LINE;
+}
+
+void
+CuckooFilter::loadWords(const uint64_t* words)
+{
+  std::memcpy(m_buckets, words, m_nBuckets * sizeof(uint64_t));
+  m_victim = 0;
+}
+
+double
+CuckooFilter::fillRatio() const
+{
+  size_t nUsed = 0;
+  for (size_t i = 0; i < m_nBuckets; i++) {
+    for (size_t slot = 0; slot < SLOTS_PER_BUCKET; slot++) {
+      nUsed += ((m_buckets[i] >> (16 * slot)) & 0xffff) != 0;
+    }
+  }
+  return static_cast<double>(nUsed) / (m_nBuckets * SLOTS_PER_BUCKET);
+}
+
+double
+CuckooFilter::expectedFalsePositiveRate(size_t nKeys) const
+{
+  // Each of the fingerprints in the two candidate buckets matches with probability 1 / (2^16 - 1)
+  double nCompared = 2.0 * std::min<double>(nKeys, m_nBuckets * SLOTS_PER_BUCKET) / m_nBuckets;
+  return 1 - std::pow(1 - 1.0 / 65535, nCompared);
+}
+
+} // namespace carousel
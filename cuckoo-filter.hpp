@@ -0,0 +1,192 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_CUCKOO_FILTER_HPP
+#define CAROUSEL_CUCKOO_FILTER_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace carousel {
+
+/**
+ * \brief Cuckoo filter (Fan et al., CoNEXT 2014), storing a 16-bit fingerprint per key
+ *
+ * Each key has two candidate buckets of four fingerprints, packed in a 64-bit word, and the
+ * second bucket is derived from the first and the fingerprint, so that fingerprints can be moved
+ * between them without knowing their key. A lookup thus reads at most two words, and compares all
+ * slots of a bucket at once. Like Bloom, the filter keeps two tables so that reset is O(1).
+ *
+ * Compared to a bloom filter of the same size, the false positive rate is lower as soon as more
+ * than about 12 bits per key are spent. If a key cannot be placed after MAX_KICKS relocations, its
+ * fingerprint is kept aside in a single victim slot; once that slot is taken, further keys that
+ * cannot be placed are lost, i.e., they may later be reported as absent. Sizing the table for a
+ * load factor below 95% makes this unlikely.
+ */
+class CuckooFilter
+{
+public:
+  /**
+   * \brief Size of a cuckoo filter, relative to the number of keys it is meant to hold
+   */
+  struct Config
+  {
+    /// Maximum share of the slots in use when holding as many keys as the filter is sized for;
+    /// the number of buckets is then rounded up to a power of two
+    double loadFactor = 0.9;
+  };
+
+public:
+  /**
+   * \brief Creates a cuckoo filter with at least the given number of buckets
+   */
+  explicit
+  CuckooFilter(size_t nBuckets);
+
+  /**
+   * \brief Creates a cuckoo filter for the specified number of keys
+   */
+  CuckooFilter(const Config& config, size_t nKeys);
+
+  CuckooFilter(CuckooFilter&&) = default;
+  CuckooFilter& operator=(CuckooFilter&&) = default;
+
+  /**
+   * \brief Adds a key to the filter, given its 64-bit hash (see hashKey)
+   */
+  void
+  add(uint64_t hash);
+
+  /**
+   * \brief Checks whether the existence of a key is evidenced by the filter, given its 64-bit
+   *        hash (see hashKey)
+   */
+  bool
+  isEvidenced(uint64_t hash) const;
+
+  /**
+   * \brief Prefetches both candidate buckets of a key, given its 64-bit hash (see hashKey)
+   */
+  void
+  prefetch(uint64_t hash) const;
+
+  /**
+   * \brief Removes all keys, swapping in the spare table zeroed by clearStep (see Bloom::reset)
+   */
+  void
+  reset();
+
+  /**
+   * \brief Zeroes one cache line of the table retired by the last reset, if any is left
+   */
+  void
+  clearStep()
+  {
+    if (m_clearCursor < m_nBuckets) {
+      clearRetiredSlice();
+    }
+  }
+
+  /**
+   * \brief Returns the share of slots in use
+   */
+  double
+  fillRatio() const;
+
+  /**
+   * \brief Returns the probability that a key which was not added is evidenced, once the
+   *        specified number of distinct keys were added
+   */
+  double
+  expectedFalsePositiveRate(size_t nKeys) const;
+
+  /**
+   * \brief Returns the number of bytes allocated, including the spare table
+   */
+  size_t
+  memoryBytes() const
+  {
+    return 2 * m_nBuckets * sizeof(uint64_t);
+  }
+
+  size_t
+  nBuckets() const
+  {
+    return m_nBuckets;
+  }
+
+  /**
+   * \brief Returns the table in use, of nWords() words, e.g., to save it (see loadWords)
+   *
+   * The victim slot is not part of the table, so a key that could not be placed is lost when the
+   * table is loaded into another filter.
+   */
+  const uint64_t*
+  words() const
+  {
+    return m_buckets;
+  }
+
+  size_t
+  nWords() const
+  {
+    return m_nBuckets;
+  }
+
+  /**
+   * \brief Replaces the table in use with nWords() words saved from a filter of the same size
+   */
+  void
+  loadWords(const uint64_t* words);
+
+  /**
+   * \brief Returns a value identifying the table format, distinct from those of Bloom (see
+   *        Bloom::formatTag)
+   */
+  uint64_t
+  formatTag() const
+  {
+    return (uint64_t(1) << 32) | SLOTS_PER_BUCKET;
+  }
+
+  static const size_t SLOTS_PER_BUCKET = 4;
+  static const size_t MAX_KICKS = 500;
+
+private:
+  void
+  clearRetiredSlice();
+
+  static uint16_t
+  fingerprintOf(uint64_t hash);
+
+  size_t
+  alternateBucket(size_t bucket, uint16_t fingerprint) const;
+
+  bool
+  contains(size_t bucket, uint16_t fingerprint) const;
+
+  bool
+  tryInsert(size_t bucket, uint16_t fingerprint);
+
+private:
+  struct FreeDeleter
+  {
+    void
+    operator()(uint64_t* p) const;
+  };
+
+  size_t m_nBuckets;
+  size_t m_mask;
+  std::unique_ptr<uint64_t[], FreeDeleter> m_storage; // both tables, aligned to a cache line
+  uint64_t* m_buckets; // table in use, one bucket of four 16-bit fingerprints per word
+  uint64_t* m_retired; // table being zeroed by clearStep
+  size_t m_clearCursor; // number of buckets of m_retired zeroed so far
+  size_t m_nKicks; // relocations so far, used to vary the evicted slot
+  uint16_t m_victim; // fingerprint that could not be placed, or 0
+  size_t m_victimBucket;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_CUCKOO_FILTER_HPP
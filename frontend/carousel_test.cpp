@@ -1,6 +1,7 @@
 #include <functional>
 #include <iostream>
 #include <random>
+#include <vector>
 
 #include <getopt.h>
 #include <stdlib.h>
@@ -9,26 +10,54 @@
 #include "carousel.hpp"
 #include "logger.hpp"
 #include "log-fetcher.hpp"
+#include "trace-log-fetcher.hpp"
 
-using carousel::Carousel;
+using carousel::BackpressureLogCallback;
+using carousel::BasicCarousel;
+using carousel::Bloom;
+using carousel::CuckooFilter;
+using carousel::LogCallback;
+using carousel::ManualClock;
+using carousel::SteadyClock;
 using carousel::Logger;
 using carousel::LogFetcher;
 using carousel::RandomLogFetcher;
-using carousel::DatasetLogFetcher;
+using carousel::MappedDatasetLogFetcher;
+using carousel::PhaseSummary;
+using carousel::SinkResult;
+using carousel::TraceLogFetcher;
+using carousel::TraceRecord;
 
 using std::placeholders::_1;
 using std::placeholders::_2;
+using std::placeholders::_3;
+using std::placeholders::_4;
 
 struct Options {
   int memorySize = 200;
   int logInterval = 10;
+  int sinkInterval = 0;
   int keyRange = 3000;
   int logPerTick = 3;
   int outputInterval = 200;
   int totalIteration = 50000;
   bool original = true;
+  bool blockedBloom = false;
+  double falsePositiveRate = 0;
+  double bitsPerKey = 0;
+  bool cuckoo = false;
+  bool simulate = false;
+  bool phaseStats = false;
+  bool latency = false;
+  bool adaptive = false;
+  bool backpressure = false;
+  bool estimateK = false;
   char *dataset = nullptr;
+  char *trace = nullptr;
+  char *snapshot = nullptr;
   int datasetSkip = 0;
+  int keyColumn = 2;
+  int keyFields = 1;
 
   int parseArg(int argc, char *argv[])
   {
@@ -36,30 +65,60 @@ struct Options {
     static struct option optlist[] = {
       {"memory", required_argument, nullptr, 'm'},
       {"interval", required_argument, nullptr, 'i'},
+      {"sink-interval", required_argument, nullptr, 'I'},
       {"key", required_argument, nullptr, 'k'},
       {"lograte", required_argument, nullptr, 'r'},
       {"output", required_argument, nullptr, 'o'},
       {"iteration", required_argument, nullptr, 'T'},
       {"enhanced", no_argument, nullptr, 'e'},
+      {"blocked-bloom", no_argument, nullptr, 'B'},
+      {"false-positive-rate", required_argument, nullptr, 'F'},
+      {"bits-per-key", required_argument, nullptr, 'b'},
+      {"cuckoo", no_argument, nullptr, 'C'},
+      {"simulate", no_argument, nullptr, 's'},
+      {"phase-stats", no_argument, nullptr, 'P'},
+      {"latency", no_argument, nullptr, 'L'},
+      {"adaptive", no_argument, nullptr, 'A'},
+      {"backpressure", no_argument, nullptr, 'K'},
+      {"estimate-k", no_argument, nullptr, 'E'},
+      {"snapshot", required_argument, nullptr, 'W'},
       {"dataset", required_argument, nullptr, 'd'},
       {"dataset-skip", required_argument, nullptr, 'S'},
+      {"trace", required_argument, nullptr, 't'},
+      {"key-column", required_argument, nullptr, 'c'},
+      {"key-fields", required_argument, nullptr, 'f'},
       {"help", no_argument, nullptr, 'h'},
       {nullptr, 0, nullptr, 0},
     };
 
     while ((ch = getopt_long(argc, argv,
-                             "m:i:k:r:o:T:ed:S:h",
+                             "m:i:I:k:r:o:T:eBF:b:CsPLAKEW:d:S:t:c:f:h",
                              optlist, NULL)) != -1) {
       switch(ch) {
       case 'm': memorySize = atoi(optarg); break;
       case 'i': logInterval = atoi(optarg); break;
+      case 'I': sinkInterval = atoi(optarg); break;
       case 'k': keyRange = atoi(optarg); break;
       case 'r': logPerTick = atoi(optarg); break;
       case 'o': outputInterval = atoi(optarg); break;
       case 'T': totalIteration = atoi(optarg); break;
       case 'e': original = false; break;
+      case 'B': blockedBloom = true; break;
+      case 'F': falsePositiveRate = atof(optarg); break;
+      case 'b': bitsPerKey = atof(optarg); break;
+      case 'C': cuckoo = true; break;
+      case 's': simulate = true; break;
+      case 'P': phaseStats = true; break;
+      case 'L': latency = true; break;
+      case 'A': adaptive = true; break;
+      case 'K': backpressure = true; break;
+      case 'E': estimateK = true; break;
+      case 'W': snapshot = strdup(optarg); break;
       case 'd': dataset = strdup(optarg); break;
       case 'S': datasetSkip = atoi(optarg); break;
+      case 't': trace = strdup(optarg); break;
+      case 'c': keyColumn = atoi(optarg); break;
+      case 'f': keyFields = atoi(optarg); break;
       case 'h': printHelp(); return 1;
       default:
         std::cerr << "Unrecognized argument" << std::endl;
@@ -76,51 +135,140 @@ private:
     std::cerr << "simpletest [OPTIONS]\n" << std::endl;
     std::cerr << "-m, --memory\tBuffer size of logger (default: 200)" << std::endl;
     std::cerr << "-i, --interval\tTicks between logger process a log (default: 10)" << std::endl;
+    std::cerr << "-I, --sink-interval\tTicks between logger process a log actually, while Carousel assumes -i (default: same as -i)" << std::endl;
     std::cerr << "-k, --key\tNumber of keys (default: 3000)" << std::endl;
     std::cerr << "-r, --lograte\tNumbers of log generated per tick (default: 3)" << std::endl;
     std::cerr << "-o, --output\tNumbers of ticks per output (default: 200)" << std::endl;
     std::cerr << "-T, --iteration\tTotal numbers of iteration to run (default: 50000)" << std::endl;
     std::cerr << "-d, --dataset\tUse dataset file (Otherwise the random data generator will be used" << std::endl;
     std::cerr << "-e, --enhanced\tUse enhanced behavior, without wrapping v without 2^k (default: disabled)" << std::endl;
+    std::cerr << "-B, --blocked-bloom\tUse a cache-line-blocked bloom filter (default: disabled)" << std::endl;
+    std::cerr << "-F, --false-positive-rate\tSize the bloom filter for this false positive rate when full (default: 10 bits per key)" << std::endl;
+    std::cerr << "-b, --bits-per-key\tSize the bloom filter to this many bits per key, with the best number of hashes (default: 10)" << std::endl;
+    std::cerr << "-C, --cuckoo\tUse a cuckoo filter instead of a bloom filter, at a load factor of 0.9 (default: disabled)" << std::endl;
+    std::cerr << "-s, --simulate\tRun in virtual time, without sleeping or threads (default: disabled)" << std::endl;
+    std::cerr << "-P, --phase-stats\tPrint a summary of each phase of Carousel, with its sampled false positives, to stderr (default: disabled)" << std::endl;
+    std::cerr << "-L, --latency\tPrint latency histograms of Carousel and of the logger queue to stderr at the end (default: disabled)" << std::endl;
+    std::cerr << "-A, --adaptive\tReport the drain rate and queue depth of the logger to Carousel, which adapts its phases to them (default: disabled)" << std::endl;
+    std::cerr << "-K, --backpressure\tHave the logger report a full queue to Carousel, which then only counts the keys it accepted as logged (default: disabled)" << std::endl;
+    std::cerr << "-E, --estimate-k\tChoose the number of partitions from a HyperLogLog estimate of the distinct keys, instead of one step per phase (default: disabled)" << std::endl;
+    std::cerr << "-W, --snapshot\tResume Carousel from this snapshot file if it is compatible, and save its state to it at the end" << std::endl;
     std::cerr << "-S, --dataset-skip\tSkip number of lines in the dataset (default: 0)" << std::endl;
+    std::cerr << "-t, --trace\tUse binary trace file, as written by trace_convert" << std::endl;
+    std::cerr << "-c, --key-column\tTab-separated field of the dataset holding the key, from 0 (default: 2)" << std::endl;
+    std::cerr << "-f, --key-fields\tNumber of consecutive fields forming the key, e.g. 2 for address and port (default: 1)" << std::endl;
     std::cerr << "-h, --help\tThis help message" << std::endl;
   }
 };
 
-int main(int argc, char *argv[])
+/**
+ * \brief Connects the carousel to the logger it outputs to, and to the phase summary output
+ */
+template<typename C>
+void
+setUp(const Options& o, C& carousel, Logger& c)
 {
-  Options o;
-  if (o.parseArg(argc, argv)) {
-    return 1;
+  if (!o.backpressure) {
+    // Otherwise, entries go through the log callback one by one, so that the logger can refuse them
+    carousel.setBatchCallback(std::bind(&Logger::logBatch, &c, _1, _2, _3, _4));
   }
-
-  Logger c(o.memorySize, std::chrono::milliseconds(o.logInterval));
-  Logger n(o.memorySize, std::chrono::milliseconds(o.logInterval));
-  Carousel carousel(std::bind(&Logger::log, &c, _1, _2),
-                    o.memorySize,
-                    std::chrono::milliseconds(o.logInterval),
-                    o.original);
-
-  std::shared_ptr<LogFetcher> fetcher;
-
-  if (o.dataset != nullptr) {
-    fetcher = std::make_shared<DatasetLogFetcher>(o.dataset, o.datasetSkip);
-  } else {
-    fetcher = std::make_shared<RandomLogFetcher>(o.keyRange);
+  carousel.setLatencyTracking(o.latency);
+  carousel.setFalsePositiveSampling(o.phaseStats);
+  carousel.setCardinalityRepartitioning(o.estimateK);
+  if (o.snapshot != nullptr) {
+    static const char* const results[] = {"restored", "not found", "incompatible", "damaged"};
+    std::cerr << "snapshot " << o.snapshot << ": "
+              << results[static_cast<size_t>(carousel.restoreSnapshot(o.snapshot))]
+              << "\tk: " << carousel.stats().k << std::endl;
+  }
+  c.setQueueDelayTracking(o.latency);
+  if (o.phaseStats) {
+    carousel.setPhaseCallback([] (const PhaseSummary& p) {
+      std::cerr << "phase " << p.phase << ":\tk: " << p.k << "\tv: " << p.v
+                << "\tend: " << (p.end == PhaseSummary::End::DEADLINE ? "deadline" : "overflow")
+                << "\tduration: " << std::chrono::duration_cast<std::chrono::milliseconds>(p.duration).count()
+                << " ms\tcapacity: " << p.capacity << "\tadmitted: " << p.nAdmitted << "\tduplicates: " << p.nDuplicates
+                << "\toutside: " << p.nOutsidePhase << "\tfilter fill: " << p.fillRatio
+                << "\texpected fpr: " << p.expectedFalsePositiveRate
+                << "\tsampled fp: " << p.nSampledFalsePositives << "/" << p.nSampledNew << std::endl;
+    });
   }
+}
 
-  if (!fetcher->prepare()) {
-    return 1;
+/**
+ * \brief Reports the state of a logger to a carousel, as a sink would in adaptive mode
+ *
+ * The drain rate is measured over windows during which the logger had a backlog throughout, as
+ * it records fewer entries than it could otherwise; it is reported as unknown for other windows.
+ */
+class SinkMonitor
+{
+public:
+  template<typename C>
+  void
+  report(C& carousel, Logger& sink, std::chrono::milliseconds now)
+  {
+    uint64_t nRecorded = sink.numRecordedEntries();
+    size_t queueDepth = sink.queueDepth();
+    double drainRate = 0;
+    if (m_wasBacklogged && queueDepth > 0 && now > m_lastReport) {
+      drainRate = (nRecorded - m_lastRecorded) /
+                  std::chrono::duration<double>(now - m_lastReport).count();
+    }
+    carousel.reportSinkState(drainRate, queueDepth);
+    m_lastRecorded = nRecorded;
+    m_lastReport = now;
+    m_wasBacklogged = queueDepth > 0;
   }
 
-  std::chrono::steady_clock::time_point log_time = std::chrono::steady_clock::now();
-  c.run();
-  n.run();
+private:
+  uint64_t m_lastRecorded = 0;
+  std::chrono::milliseconds m_lastReport{0};
+  bool m_wasBacklogged = false;
+};
+
+/**
+ * \brief Replays one tick of one millisecond per iteration
+ *
+ * settle is called once the entries of a tick are submitted, before the key counts are printed,
+ * and nextTick at the end of each tick. The keys of a trace are submitted with their hashes, which
+ * the trace stores or TraceLogFetcher computes once per distinct key, instead of being hashed again
+ * by Carousel.
+ */
+template<typename C, typename Settle, typename NextTick>
+void
+replay(const Options& o, LogFetcher& fetcher, C& carousel, Logger& c, Logger& n,
+       Settle settle, NextTick nextTick)
+{
+  // Ticks between two reports of the logger state in adaptive mode
+  const int REPORT_INTERVAL = 100;
+  SinkMonitor monitor;
+  std::vector<std::string> keys(o.logPerTick);
+  TraceLogFetcher* trace = dynamic_cast<TraceLogFetcher*>(&fetcher);
+  std::vector<TraceRecord> records(trace != nullptr ? keys.size() : 0);
+  std::vector<uint64_t> hashes(records.size());
   for (int iter = 0; iter < o.totalIteration; iter++) {
-    for (int i = 0; i < o.logPerTick; i++) {
-      const std::string& k = fetcher->fetch();
-      carousel.log(k, k);
-      n.log(k, k);
+    size_t nFetched;
+    if (trace != nullptr) {
+      nFetched = trace->fetchBatch(records.data(), records.size());
+      for (size_t i = 0; i < nFetched; i++) {
+        keys[i].assign(records[i].key.data, records[i].key.size);
+        hashes[i] = records[i].hash;
+      }
+    } else {
+      nFetched = fetcher.fetchBatch(keys.data(), keys.size());
+    }
+    for (size_t i = 0; i < nFetched; i++) {
+      n.log(keys[i], keys[i]);
+    }
+    if (trace != nullptr) {
+      carousel.logBatchHashed(hashes.data(), keys.data(), keys.data(), nFetched);
+    } else {
+      carousel.logBatch(keys.data(), keys.data(), nFetched);
+    }
+    settle();
+    if (o.adaptive && iter % REPORT_INTERVAL == 0) {
+      monitor.report(carousel, c, std::chrono::milliseconds(iter));
     }
 
     if (iter % o.outputInterval == 0) {
@@ -128,11 +276,135 @@ int main(int argc, char *argv[])
                 << "\tCarousel: " << c.numRecordedKeys() << std::endl;
     }
 
-    log_time += std::chrono::milliseconds(1);
-    std::this_thread::sleep_until(log_time);
+    nextTick();
+  }
+
+  if (o.snapshot != nullptr) {
+    carousel.saveSnapshot(o.snapshot);
+  }
+
+  if (o.phaseStats) {
+    carousel::CarouselStats stats = carousel.stats();
+    std::cerr << "measured fpr: " << stats.falsePositiveRate() << std::endl;
+    std::cerr << "rejected by logger: " << stats.nRejected << "\tskipped: " << stats.nSkipped << std::endl;
+    std::cerr << "recorded by logger: " << c.numRecordedEntries() << "\tdropped: " << c.numDroppedEntries() << std::endl;
   }
+  if (o.latency) {
+    carousel.printLatency(std::cerr);
+    c.queueDelay().print(std::cerr, "queue-delay");
+  }
+}
+
+/**
+ * \brief Runs the test with a carousel outputting to the specified sink, and suppressing
+ *        duplicates with the specified filter type
+ */
+template<typename Sink, typename Filter>
+int
+run(const Options& o, LogFetcher& fetcher, Logger& c, Logger& n, const Sink& sink,
+    const typename Filter::Config& filterConfig)
+{
+  if (o.simulate) {
+    // Carousel and both loggers follow a virtual clock, advanced by one millisecond per tick
+    ManualClock clock;
+    BasicCarousel<Sink, ManualClock, Filter> carousel(sink,
+                                                      o.memorySize,
+                                                      std::chrono::milliseconds(o.logInterval),
+                                                      o.original,
+                                                      filterConfig,
+                                                      clock);
+    setUp(o, carousel, c);
+
+    std::chrono::milliseconds now(0);
+    replay(o, fetcher, carousel, c, n,
+           [&] {
+             c.drainUntil(now);
+             n.drainUntil(now);
+           },
+           [&] {
+             now += std::chrono::milliseconds(1);
+             clock.set(now);
+           });
+    return 0;
+  }
+
+  BasicCarousel<Sink, SteadyClock, Filter> carousel(sink,
+                                                    o.memorySize,
+                                                    std::chrono::milliseconds(o.logInterval),
+                                                    o.original,
+                                                    filterConfig);
+  setUp(o, carousel, c);
+
+  std::chrono::steady_clock::time_point log_time = std::chrono::steady_clock::now();
+  c.run();
+  n.run();
+  replay(o, fetcher, carousel, c, n,
+         [] {},
+         [&] {
+           log_time += std::chrono::milliseconds(1);
+           std::this_thread::sleep_until(log_time);
+         });
 
   c.stop();
   n.stop();
   return 0;
 }
+
+/**
+ * \brief Runs the test with a carousel outputting to the specified sink, and the filter selected
+ *        by the options
+ */
+template<typename Sink>
+int
+runWithSink(const Options& o, LogFetcher& fetcher, Logger& c, Logger& n, const Sink& sink,
+            const Bloom::Config& bloomConfig)
+{
+  if (o.cuckoo) {
+    return run<Sink, CuckooFilter>(o, fetcher, c, n, sink, CuckooFilter::Config());
+  }
+  return run<Sink, Bloom>(o, fetcher, c, n, sink, bloomConfig);
+}
+
+int main(int argc, char *argv[])
+{
+  Options o;
+  if (o.parseArg(argc, argv)) {
+    return 1;
+  }
+
+  // Both loggers stand for the same sink, whose actual rate may differ from the one Carousel assumes
+  std::chrono::milliseconds sinkInterval(o.sinkInterval > 0 ? o.sinkInterval : o.logInterval);
+  Logger c(o.memorySize, sinkInterval);
+  Logger n(o.memorySize, sinkInterval);
+  Bloom::Layout bloomLayout = o.blockedBloom ? Bloom::Layout::BLOCKED : Bloom::Layout::STANDARD;
+  Bloom::Config bloomConfig(bloomLayout);
+  if (o.falsePositiveRate > 0) {
+    bloomConfig = Bloom::Config::forFalsePositiveRate(o.falsePositiveRate, bloomLayout);
+  } else if (o.bitsPerKey > 0) {
+    bloomConfig = Bloom::Config::forBitsPerKey(o.bitsPerKey, bloomLayout);
+  }
+
+  std::shared_ptr<LogFetcher> fetcher;
+
+  if (o.trace != nullptr) {
+    fetcher = std::make_shared<TraceLogFetcher>(o.trace);
+  } else if (o.dataset != nullptr) {
+    fetcher = std::make_shared<MappedDatasetLogFetcher>(o.dataset, o.datasetSkip,
+                                                        o.keyColumn, o.keyFields);
+  } else {
+    fetcher = std::make_shared<RandomLogFetcher>(o.keyRange);
+  }
+
+  if (!fetcher->prepare()) {
+    return 1;
+  }
+
+  if (o.backpressure) {
+    BackpressureLogCallback sink = [&c] (const std::string& key, const std::string& entry) {
+      return c.tryLog(key, entry) ? SinkResult::ACCEPTED : SinkResult::FULL;
+    };
+    return runWithSink(o, *fetcher, c, n, sink, bloomConfig);
+  }
+  LogCallback sink = std::bind(&Logger::log, &c, _1, _2);
+  return runWithSink(o, *fetcher, c, n, sink, bloomConfig);
+}
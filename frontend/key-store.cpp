@@ -0,0 +1,104 @@
+#include <cstring>
+#include <stdexcept>
+
+#include "hash.hpp"
+#include "key-store.hpp"
+
+namespace carousel
+{
+
+namespace
+{
+
+const size_t INITIAL_CAPACITY = 1024;
+
+}
+
+KeyStore::KeyStore()
+  : m_slots(INITIAL_CAPACITY, Slot{0, 0})
+  , m_mask(INITIAL_CAPACITY - 1)
+  , m_size(0)
+{
+}
+
+bool
+KeyStore::insert(const char* key, size_t length)
+{
+  if (length >= (size_t(1) << LENGTH_BITS)) {
+    throw std::length_error("key too long for KeyStore");
+  }
+
+  uint64_t hash = hashOf(key, length);
+  size_t i = hash & m_mask;
+  while (m_slots[i].hash != 0) {
+    if (matches(m_slots[i], hash, key, length)) {
+      return false;
+    }
+    i = (i + 1) & m_mask;
+  }
+
+  m_slots[i].hash = hash;
+  m_slots[i].location = (static_cast<uint64_t>(m_arena.size()) << LENGTH_BITS) | length;
+  m_arena.insert(m_arena.end(), key, key + length);
+  m_size++;
+
+  // Keep the load factor at most 3/4
+  if (4 * m_size > 3 * m_slots.size()) {
+    grow();
+  }
+  return true;
+}
+
+bool
+KeyStore::contains(const char* key, size_t length) const
+{
+  uint64_t hash = hashOf(key, length);
+  for (size_t i = hash & m_mask; m_slots[i].hash != 0; i = (i + 1) & m_mask) {
+    if (matches(m_slots[i], hash, key, length)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+size_t
+KeyStore::memoryUsage() const
+{
+  return m_slots.capacity() * sizeof(Slot) + m_arena.capacity();
+}
+
+uint64_t
+KeyStore::hashOf(const char* key, size_t length) const
+{
+  uint64_t hash = hashBytes(key, length);
+  return hash != 0 ? hash : 1;
+}
+
+bool
+KeyStore::matches(const Slot& slot, uint64_t hash, const char* key, size_t length) const
+{
+  return slot.hash == hash &&
+         (slot.location & ((uint64_t(1) << LENGTH_BITS) - 1)) == length &&
+         std::memcmp(m_arena.data() + (slot.location >> LENGTH_BITS), key, length) == 0;
+}
+
+void
+KeyStore::grow()
+{
+  std::vector<Slot> slots(2 * m_slots.size(), Slot{0, 0});
+  size_t mask = slots.size() - 1;
+  for (const Slot& slot : m_slots) {
+    if (slot.hash == 0) {
+      continue;
+    }
+    size_t i = slot.hash & mask;
+    while (slots[i].hash != 0) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = slot;
+  }
+  m_slots.swap(slots);
+  m_mask = mask;
+}
+
+}
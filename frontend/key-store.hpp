@@ -0,0 +1,84 @@
+#ifndef CAROUSEL_KEY_STORE_HPP
+#define CAROUSEL_KEY_STORE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace carousel
+{
+
+/**
+ * \brief Set of distinct keys, stored in a flat open-addressing table
+ *
+ * Key bytes are appended to one arena and never freed, and the table only holds each key's hash
+ * and location in the arena, 16 bytes per slot. Lookups probe linearly and compare full hashes
+ * before touching the arena, and growing the table does not rehash keys.
+ */
+class KeyStore
+{
+public:
+  KeyStore();
+
+  /**
+   * \brief Inserts a key, unless it is already stored
+   * \return Whether the key was inserted
+   */
+  bool
+  insert(const char* key, size_t length);
+
+  bool
+  insert(const std::string& key)
+  {
+    return insert(key.data(), key.size());
+  }
+
+  bool
+  contains(const char* key, size_t length) const;
+
+  bool
+  contains(const std::string& key) const
+  {
+    return contains(key.data(), key.size());
+  }
+
+  size_t
+  size() const
+  {
+    return m_size;
+  }
+
+  /**
+   * \brief Returns the number of bytes allocated for the table and the arena
+   */
+  size_t
+  memoryUsage() const;
+
+private:
+  struct Slot
+  {
+    uint64_t hash; // 0 marks an empty slot
+    uint64_t location; // offset in the arena in the high bits, length in the low bits
+  };
+
+  static const unsigned LENGTH_BITS = 24;
+
+  uint64_t
+  hashOf(const char* key, size_t length) const;
+
+  bool
+  matches(const Slot& slot, uint64_t hash, const char* key, size_t length) const;
+
+  void
+  grow();
+
+private:
+  std::vector<Slot> m_slots;
+  size_t m_mask;
+  size_t m_size;
+  std::vector<char> m_arena;
+};
+
+}
+
+#endif // CAROUSEL_KEY_STORE_HPP
@@ -1,11 +1,47 @@
+#include <cstring>
 #include <iostream>
 #include <sstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include "log-fetcher.hpp"
 
 namespace carousel
 {
 
+KeyView
+findFields(KeyView line, size_t column, size_t nColumns)
+{
+  const char *eol = line.data + line.size;
+  const char *begin = line.data;
+  for (size_t i = 0; i < column; i++) {
+    const char *tab = static_cast<const char*>(std::memchr(begin, '\t', eol - begin));
+    if (tab == nullptr) {
+      begin = eol;
+      break;
+    }
+    begin = tab + 1;
+  }
+
+  const char *end = begin;
+  for (size_t i = 0; i < nColumns; i++) {
+    const char *tab = static_cast<const char*>(std::memchr(end, '\t', eol - end));
+    if (tab == nullptr) {
+      end = eol;
+      break;
+    }
+    end = i + 1 < nColumns ? tab + 1 : tab;
+  }
+  if (end == eol && end != begin && end[-1] == '\r') {
+    end--;
+  }
+
+  return KeyView{begin, static_cast<size_t>(end - begin)};
+}
+
 RandomLogFetcher::RandomLogFetcher(int keyRange)
   : m_distribution(0, keyRange - 1)
   , m_keylist(keyRange)
@@ -66,4 +102,111 @@ DatasetLogFetcher::fetch()
   return s;
 }
 
+MappedDatasetLogFetcher::MappedDatasetLogFetcher(const char *fileName, int skip,
+                                                 size_t keyColumn, size_t nKeyColumns)
+  : m_fileName(fileName)
+  , m_skip(skip)
+  , m_keyColumn(keyColumn)
+  , m_nKeyColumns(nKeyColumns)
+{
+}
+
+MappedDatasetLogFetcher::~MappedDatasetLogFetcher()
+{
+  if (m_data != nullptr) {
+    munmap(const_cast<char*>(m_data), m_size);
+  }
+}
+
+bool
+MappedDatasetLogFetcher::prepare()
+{
+  int fd = open(m_fileName, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Cannot open file: " << m_fileName << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << "Cannot map file: " << m_fileName << std::endl;
+    return false;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  m_data = static_cast<const char*>(data);
+  m_size = st.st_size;
+  m_cursor = m_data;
+  m_end = m_data + m_size;
+
+  for (int i = 0; i < m_skip && m_cursor != m_end; i++) {
+    const char *eol = static_cast<const char*>(std::memchr(m_cursor, '\n', m_end - m_cursor));
+    m_cursor = eol != nullptr ? eol + 1 : m_end;
+  }
+
+  if (m_cursor == m_end) {
+    std::cerr << "File status is not correct after initialization" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+const std::string
+MappedDatasetLogFetcher::fetch()
+{
+  return fetchView().str();
+}
+
+size_t
+MappedDatasetLogFetcher::fetchBatch(std::string* keys, size_t n)
+{
+  size_t i = 0;
+  for (; i < n && m_cursor != m_end; i++) {
+    KeyView key = fetchView();
+    keys[i].assign(key.data, key.size);
+  }
+  return i;
+}
+
+KeyView
+MappedDatasetLogFetcher::fetchView()
+{
+  KeyView line;
+  fetchLine(line);
+  return findFields(line, m_keyColumn, m_nKeyColumns);
+}
+
+bool
+MappedDatasetLogFetcher::fetchLine(KeyView& line)
+{
+  if (m_cursor == m_end) {
+    line = KeyView{m_end, 0};
+    return false;
+  }
+
+  const char *eol = static_cast<const char*>(std::memchr(m_cursor, '\n', m_end - m_cursor));
+  if (eol == nullptr) {
+    eol = m_end;
+  }
+  line = KeyView{m_cursor, static_cast<size_t>(eol - m_cursor)};
+  m_cursor = eol == m_end ? m_end : eol + 1;
+  return true;
+}
+
+size_t
+MappedDatasetLogFetcher::fetchBatch(KeyView* keys, size_t n)
+{
+  size_t i = 0;
+  for (; i < n && m_cursor != m_end; i++) {
+    keys[i] = fetchView();
+  }
+  return i;
+}
+
 }
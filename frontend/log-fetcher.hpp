@@ -6,6 +6,10 @@
 #include <random>
 #include <fstream>
 
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
 namespace carousel
 {
 
@@ -19,8 +23,55 @@ public:
 
   virtual const std::string
   fetch() = 0;
+
+  /**
+   * \brief Fetches up to n keys, assigning them to keys[0] to keys[n - 1]
+   * \return Number of keys fetched, fewer than n only once the input is exhausted
+   *
+   * Assigning to the same strings on every call reuses their storage.
+   */
+  virtual size_t
+  fetchBatch(std::string* keys, size_t n)
+  {
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = fetch();
+    }
+    return n;
+  }
+};
+
+/**
+ * \brief Key pointing into the input of a fetcher
+ */
+struct KeyView
+{
+  const char* data;
+  size_t size;
+
+  std::string
+  str() const
+  {
+    return std::string(data, size);
+  }
+
+#if __cplusplus >= 201703L
+  operator std::string_view() const
+  {
+    return std::string_view(data, size);
+  }
+#endif
 };
 
+/**
+ * \brief Returns the range of nColumns consecutive tab-separated fields of a line, starting at
+ * field column, counted from 0
+ *
+ * The range is empty if the line has fewer fields, and does not include a trailing carriage
+ * return.
+ */
+KeyView
+findFields(KeyView line, size_t column, size_t nColumns);
+
 class RandomLogFetcher : public LogFetcher {
 public:
   RandomLogFetcher(int keyRange);
@@ -50,6 +101,64 @@ private:
   std::ifstream m_ifs;
 };
 
+/**
+ * \brief Reads keys from a memory-mapped dataset of tab-separated fields
+ *
+ * Lines are scanned in place, and keys are returned as views into the mapping. The key is a range
+ * of nKeyColumns consecutive fields starting at field keyColumn, counted from 0, so that e.g. an
+ * address and a port form one key, tab included.
+ */
+class MappedDatasetLogFetcher : public LogFetcher {
+public:
+  MappedDatasetLogFetcher(const char *fileName, int skip, size_t keyColumn = 2, size_t nKeyColumns = 1);
+
+  ~MappedDatasetLogFetcher();
+
+  MappedDatasetLogFetcher(const MappedDatasetLogFetcher&) = delete; // non construction-copyable
+  MappedDatasetLogFetcher& operator=(const MappedDatasetLogFetcher&) = delete; // non copyable
+
+  bool
+  prepare();
+
+  const std::string
+  fetch();
+
+  size_t
+  fetchBatch(std::string* keys, size_t n);
+
+  /**
+   * \brief Fetches the key of the next line, which remains valid as long as the fetcher
+   *
+   * Returns an empty key once the dataset is exhausted.
+   */
+  KeyView
+  fetchView();
+
+  /**
+   * \brief Fetches the keys of up to n lines
+   * \return Number of keys fetched, fewer than n only once the dataset is exhausted
+   */
+  size_t
+  fetchBatch(KeyView* keys, size_t n);
+
+  /**
+   * \brief Fetches the next line, without its line terminator
+   * \return false once the dataset is exhausted
+   */
+  bool
+  fetchLine(KeyView& line);
+
+private:
+  const char *m_fileName;
+  int m_skip;
+  size_t m_keyColumn;
+  size_t m_nKeyColumns;
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  const char *m_cursor = nullptr;
+  const char *m_end = nullptr;
+};
+
 }
 
 #endif //
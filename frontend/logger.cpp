@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <functional>
 #include <iostream>
 
@@ -6,30 +7,84 @@
 namespace carousel
 {
 
+namespace
+{
+
+// Waits shorter than this are done by yielding, as sleeping would overshoot them
+const std::chrono::microseconds SPIN_THRESHOLD(200);
+
+uint64_t
+steadyNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
 Logger::Logger(size_t memorySize,
-               std::chrono::milliseconds collectionInterval)
+               std::chrono::nanoseconds collectionInterval,
+               size_t burstSize)
   : m_memorySize(memorySize)
   , m_interval(collectionInterval)
+  , m_burstSize(burstSize != 0 ? burstSize :
+                std::max<size_t>(1, std::chrono::milliseconds(1) / collectionInterval))
+  , m_tokens(0)
+  , m_logging_queue(memorySize)
+  , m_batch(m_burstSize)
+  , m_nRecordedKeys(0)
+  , m_nQueuedEntries(0)
+  , m_nRecordedEntries(0)
+  , m_nDroppedEntries(0)
+  , m_isTrackingQueueDelay(false)
+  , m_stop(false)
 {
 }
 
+uint64_t
+Logger::enqueueTime() const
+{
+  if (!m_isTrackingQueueDelay.load(std::memory_order_relaxed)) {
+    return 0;
+  }
+  return steadyNanoseconds();
+}
+
 void
 Logger::log(const std::string& key, const std::string& content)
 {
-  std::unique_lock<std::mutex> lock(m_queue_mutex);
-  bool was_empty = m_logging_queue.empty();
-  if (m_logging_queue.size() < m_memorySize) {
-    m_logging_queue.push_back(key);
-    if (was_empty) {
-      m_queue_cond.notify_one();
-    }
+  tryLog(key, content);
+}
+
+bool
+Logger::tryLog(const std::string& key, const std::string& content)
+{
+  if (m_logging_queue.tryPush(StampedKey{key, enqueueTime()})) {
+    m_nQueuedEntries.fetch_add(1, std::memory_order_relaxed);
+    return true;
   }
+  m_nDroppedEntries.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+void
+Logger::logBatch(const std::string* keys, const std::string* contents,
+                 const size_t* admitted, size_t nAdmitted)
+{
+  uint64_t time = enqueueTime();
+  size_t i = 0;
+  while (i < nAdmitted && m_logging_queue.tryPush(StampedKey{keys[admitted[i]], time})) {
+    i++;
+  }
+  m_nQueuedEntries.fetch_add(i, std::memory_order_relaxed);
+  m_nDroppedEntries.fetch_add(nAdmitted - i, std::memory_order_relaxed);
 }
 
 void
 Logger::run()
 {
-  m_lastLog = std::chrono::steady_clock::now();
+  m_lastRefill = std::chrono::steady_clock::now();
+  m_tokens = 0;
   m_stop = false;
   m_log_thread = new std::thread(std::bind(&Logger::thread, this));
 }
@@ -37,11 +92,8 @@ Logger::run()
 void
 Logger::stop()
 {
-  {
-  std::unique_lock<std::mutex> lock(m_queue_mutex);
   m_stop = true;
-  m_queue_cond.notify_one();
-  }
+  m_logging_queue.notify();
   m_log_thread->join();
   delete m_log_thread;
 }
@@ -49,37 +101,123 @@ Logger::stop()
 size_t
 Logger::numRecordedKeys()
 {
-  std::unique_lock<std::mutex> lock(m_queue_mutex);
-  return m_db.size();
+  return m_nRecordedKeys.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Logger::numRecordedEntries() const
+{
+  return m_nRecordedEntries.load(std::memory_order_relaxed);
+}
+
+uint64_t
+Logger::numDroppedEntries() const
+{
+  return m_nDroppedEntries.load(std::memory_order_relaxed);
+}
+
+size_t
+Logger::queueDepth() const
+{
+  // An entry may be recorded before its producer counts it as queued
+  uint64_t nRecorded = m_nRecordedEntries.load(std::memory_order_relaxed);
+  uint64_t nQueued = m_nQueuedEntries.load(std::memory_order_relaxed);
+  return nQueued > nRecorded ? nQueued - nRecorded : 0;
 }
 
 void
-Logger::processLog()
+Logger::setQueueDelayTracking(bool isEnabled)
+{
+  m_isTrackingQueueDelay.store(isEnabled, std::memory_order_relaxed);
+}
+
+const LatencyHistogram&
+Logger::queueDelay() const
+{
+  return m_queueDelay;
+}
+
+void
+Logger::drainUntil(std::chrono::nanoseconds now)
+{
+  refillTokens(std::chrono::steady_clock::time_point(now));
+  size_t n = 0;
+  while (n < m_tokens && m_logging_queue.tryPop(m_batch[n])) {
+    n++;
+  }
+  recordBatch(n);
+}
+
+void
+Logger::refillTokens(std::chrono::steady_clock::time_point now)
 {
-  std::unique_lock<std::mutex> lock(m_queue_mutex);
+  size_t accrued = (now - m_lastRefill) / m_interval;
+  // Stay on the token grid, so that oversleeping does not lower the average rate
+  m_lastRefill += accrued * m_interval;
+  // Tokens beyond the bucket size are lost
+  m_tokens = std::min(m_burstSize, m_tokens + accrued);
+}
 
-  // because of the sleep, stop() may have been called before
-  // entering this function
-  if (m_stop) {
+void
+Logger::waitUntil(std::chrono::steady_clock::time_point deadline)
+{
+  if (deadline - std::chrono::steady_clock::now() > SPIN_THRESHOLD) {
+    std::this_thread::sleep_until(deadline);
     return;
   }
+  while (std::chrono::steady_clock::now() < deadline && !m_stop) {
+    std::this_thread::yield();
+  }
+}
+
+void
+Logger::processLog()
+{
+  // Record as many queued entries as there are tokens
+  size_t n = 0;
+  while (n < m_tokens && m_logging_queue.tryPop(m_batch[n])) {
+    n++;
+  }
 
-  while (m_logging_queue.empty()) {
-    m_queue_cond.wait(lock);
-    if (m_stop) {
+  if (n == 0) {
+    // Queue is empty: block until an entry arrives, which can be recorded right away
+    if (!m_logging_queue.waitPop(m_batch[0], m_stop)) {
       return;
     }
+    n = 1;
   }
-  m_lastLog = std::chrono::steady_clock::now();
-  m_db.insert(m_logging_queue.front());
-  m_logging_queue.pop_front();
+  recordBatch(n);
+}
+
+void
+Logger::recordBatch(size_t n)
+{
+  m_tokens -= n;
+  uint64_t now = 0;
+  for (size_t i = 0; i < n; i++) {
+    m_db.insert(m_batch[i].key);
+    if (m_batch[i].enqueueTime != 0) {
+      if (now == 0) {
+        now = steadyNanoseconds();
+      }
+      m_queueDelay.record(now > m_batch[i].enqueueTime ? now - m_batch[i].enqueueTime : 0);
+    }
+  }
+  m_nRecordedKeys.store(m_db.size(), std::memory_order_relaxed);
+  m_nRecordedEntries.store(m_nRecordedEntries.load(std::memory_order_relaxed) + n,
+                           std::memory_order_relaxed);
 }
 
 void
 Logger::thread()
 {
   while (!m_stop) {
-    std::this_thread::sleep_until(m_lastLog + m_interval);
+    refillTokens(std::chrono::steady_clock::now());
+    if (m_tokens == 0) {
+      // Wait for the bucket to fill up, so that the next batch is worth a wakeup
+      waitUntil(m_lastRefill + m_burstSize * m_interval);
+      continue;
+    }
     processLog();
   }
 }
@@ -1,32 +1,66 @@
 #ifndef CAROUSEL_LOGGER_HPP
 #define CAROUSEL_LOGGER_HPP
 
+#include "key-store.hpp"
+#include "ring-buffer.hpp"
+#include "stats.hpp"
+
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
-#include <deque>
 #include <memory>
-#include <mutex>
+#include <string>
 #include <thread>
-#include <unordered_set>
+#include <vector>
 
 namespace carousel {
 
+/**
+ * \brief Stand-in for a slow sink, recording one entry per collection interval on average
+ *
+ * The drain thread follows a token bucket: a token accrues every collection interval, up to
+ * burstSize tokens, and each recorded entry consumes one. Whenever it wakes up, the thread records
+ * as many queued entries as it has tokens in one batch, so fast sinks do not need a wakeup per
+ * entry. Waits shorter than a spin threshold are done by yielding instead of sleeping.
+ */
 class Logger
 {
 public:
+  /**
+   * \param memorySize Capacity of the logging queue
+   * \param collectionInterval Average time between two recorded entries
+   * \param burstSize Maximum number of tokens, or 0 for as many as accrue in one millisecond
+   */
   Logger(size_t memorySize,
-         std::chrono::milliseconds collectionInterval);
+         std::chrono::nanoseconds collectionInterval,
+         size_t burstSize = 0);
 
   Logger(const Logger&) = delete; // non construction-copyable
   Logger& operator=(const Logger&) = delete; // non copyable
 
   /**
    * \brief Insert data into logging queue
+   *
+   * Never blocks: the entry is dropped if the queue is full.
    */
   void
   log(const std::string& key, const std::string& content);
 
+  /**
+   * \brief Insert data into logging queue, returning whether it was queued
+   *
+   * Like log, except that the caller learns that the entry was dropped because the queue was full
+   * (see SinkResult).
+   */
+  bool
+  tryLog(const std::string& key, const std::string& content);
+
+  /**
+   * \brief Insert the admitted entries of a batch into logging queue (see Carousel::logBatch)
+   */
+  void
+  logBatch(const std::string* keys, const std::string* contents,
+           const size_t* admitted, size_t nAdmitted);
+
   /**
    * \brief start processing in a separate thread
    */
@@ -39,31 +73,120 @@ public:
   void
   stop();
 
+  /**
+   * \brief Records queued entries in the calling thread, as the drain thread would have by the
+   *        specified virtual time
+   *
+   * This drives the logger from a virtual clock instead of run(), for simulations: tokens accrue
+   * from time zero, and entries queued since the last call are recorded as tokens allow.
+   */
+  void
+  drainUntil(std::chrono::nanoseconds now);
+
+  /**
+   * \brief Returns the number of distinct keys recorded so far; safe to call from any thread
+   */
   size_t
   numRecordedKeys();
 
+  /**
+   * \brief Returns the number of entries recorded so far, including repeated keys; safe to call
+   *        from any thread
+   */
+  uint64_t
+  numRecordedEntries() const;
+
+  /**
+   * \brief Returns the number of entries dropped so far because the queue was full; safe to call
+   *        from any thread
+   */
+  uint64_t
+  numDroppedEntries() const;
+
+  /**
+   * \brief Returns the number of entries queued but not recorded yet; safe to call from any
+   *        thread
+   */
+  size_t
+  queueDepth() const;
+
+  /**
+   * \brief Starts or stops recording the time from log to the recording of each entry
+   *
+   * While enabled, log reads the steady clock to stamp each entry. Entries logged while disabled
+   * are not counted.
+   */
+  void
+  setQueueDelayTracking(bool isEnabled);
+
+  /**
+   * \brief Returns the histogram of queue delays; may be read from any thread
+   */
+  const LatencyHistogram&
+  queueDelay() const;
+
 private:
+  /**
+   * \brief Key and time of an entry, assigned into a queue slot without constructing an entry
+   */
+  struct StampedKey
+  {
+    const std::string& key;
+    uint64_t enqueueTime;
+  };
+
+  struct Entry
+  {
+    std::string key;
+    uint64_t enqueueTime; // in steady clock nanoseconds, or 0 if not tracked
+
+    Entry&
+    operator=(const StampedKey& stamped)
+    {
+      key = stamped.key;
+      enqueueTime = stamped.enqueueTime;
+      return *this;
+    }
+  };
+
+  uint64_t
+  enqueueTime() const;
+
+  void
+  refillTokens(std::chrono::steady_clock::time_point now);
+
+  void
+  waitUntil(std::chrono::steady_clock::time_point deadline);
+
   void
   processLog();
 
+  void
+  recordBatch(size_t n);
+
   void
   thread();
 
 private:
   size_t m_memorySize;
-  std::chrono::milliseconds m_interval;
-  std::chrono::steady_clock::time_point m_lastLog;
-
-  std::deque<std::string> m_logging_queue;
-  std::unordered_set<std::string> m_db;
+  std::chrono::nanoseconds m_interval;
+  size_t m_burstSize;
+  size_t m_tokens;
+  std::chrono::steady_clock::time_point m_lastRefill;
+
+  MpscRingBuffer<Entry> m_logging_queue;
+  std::vector<Entry> m_batch; // entries being recorded, reused to avoid allocations
+  KeyStore m_db; // only accessed by the drain thread
+  std::atomic<size_t> m_nRecordedKeys;
+  std::atomic<uint64_t> m_nQueuedEntries;
+  std::atomic<uint64_t> m_nRecordedEntries;
+  std::atomic<uint64_t> m_nDroppedEntries;
+  std::atomic<bool> m_isTrackingQueueDelay;
+  LatencyHistogram m_queueDelay; // only written by the drain thread
 
   std::thread *m_log_thread;
 
-  std::mutex m_queue_mutex;
-  std::condition_variable m_queue_cond;
-  std::mutex m_db_mutex;
-
-  bool m_stop;
+  std::atomic<bool> m_stop;
 };
 
 }
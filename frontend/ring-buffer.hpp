@@ -0,0 +1,164 @@
+#ifndef CAROUSEL_RING_BUFFER_HPP
+#define CAROUSEL_RING_BUFFER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace carousel
+{
+
+/**
+ * \brief Bounded multi-producer single-consumer queue
+ *
+ * Slots are preallocated and reused, and each carries a sequence number telling producers and
+ * the consumer whose turn it is (D. Vyukov's bounded queue), so producers never take a lock.
+ * The consumer spins briefly when the queue is empty and then blocks; producers only touch the
+ * mutex to wake it up when it is blocked.
+ */
+template<typename T>
+class MpscRingBuffer
+{
+public:
+  explicit
+  MpscRingBuffer(size_t capacity)
+    : m_capacity(capacity)
+    , m_slots(new Slot[capacity])
+    , m_enqueuePos(0)
+    , m_dequeuePos(0)
+    , m_consumerWaiting(false)
+  {
+    for (size_t i = 0; i < capacity; i++) {
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MpscRingBuffer(const MpscRingBuffer&) = delete;
+  MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+  /**
+   * \brief Appends a value, unless the queue is full
+   * \return Whether the value was appended
+   */
+  template<typename U>
+  bool
+  tryPush(U&& value)
+  {
+    uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot;
+    while (true) {
+      slot = &m_slots[pos % m_capacity];
+      uint64_t sequence = slot->sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(sequence - pos);
+      if (diff == 0) {
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+
+    slot->value = std::forward<U>(value);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_consumerWaiting.load(std::memory_order_relaxed)) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_cond.notify_one();
+    }
+    return true;
+  }
+
+  /**
+   * \brief Removes the oldest value, if any; must only be called by the consumer
+   * \return Whether a value was removed
+   */
+  bool
+  tryPop(T& value)
+  {
+    Slot& slot = m_slots[m_dequeuePos % m_capacity];
+    if (slot.sequence.load(std::memory_order_acquire) != m_dequeuePos + 1) {
+      return false;
+    }
+    std::swap(value, slot.value);
+    slot.sequence.store(m_dequeuePos + m_capacity, std::memory_order_release);
+    m_dequeuePos++;
+    return true;
+  }
+
+  /**
+   * \brief Removes the oldest value, waiting for one if the queue is empty; must only be called
+   *        by the consumer
+   * \return Whether a value was removed, which is false only if cancel became true
+   */
+  bool
+  waitPop(T& value, const std::atomic<bool>& cancel)
+  {
+    for (int i = 0; i < SPIN_COUNT; i++) {
+      if (tryPop(value)) {
+        return true;
+      }
+      if (cancel.load(std::memory_order_relaxed)) {
+        return false;
+      }
+      std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_consumerWaiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool popped;
+    while (!(popped = tryPop(value)) && !cancel.load(std::memory_order_relaxed)) {
+      m_cond.wait(lock);
+    }
+    m_consumerWaiting.store(false, std::memory_order_relaxed);
+    return popped;
+  }
+
+  /**
+   * \brief Wakes up the consumer if it is blocked in waitPop, e.g., to let it observe cancel
+   */
+  void
+  notify()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cond.notify_one();
+  }
+
+  size_t
+  capacity() const
+  {
+    return m_capacity;
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<uint64_t> sequence;
+    T value;
+  };
+
+  static const int SPIN_COUNT = 64;
+
+  const size_t m_capacity;
+  std::unique_ptr<Slot[]> m_slots;
+  alignas(64) std::atomic<uint64_t> m_enqueuePos;
+  alignas(64) uint64_t m_dequeuePos;
+  std::atomic<bool> m_consumerWaiting;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+};
+
+}
+
+#endif // CAROUSEL_RING_BUFFER_HPP
@@ -0,0 +1,169 @@
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hash.hpp"
+#include "trace-log-fetcher.hpp"
+
+namespace carousel
+{
+
+const char TraceHeader::MAGIC[8] = {'C', 'R', 'S', 'L', 'T', 'R', 'C', 1};
+
+namespace {
+
+inline bool
+readVarint(const uint8_t *&p, const uint8_t *end, uint64_t& value)
+{
+  value = 0;
+  for (unsigned shift = 0; p != end && shift < 64; shift += 7) {
+    uint8_t byte = *p++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool
+isValidRange(uint64_t offset, uint64_t size, size_t fileSize)
+{
+  return offset <= fileSize && size <= fileSize - offset;
+}
+
+}
+
+TraceLogFetcher::TraceLogFetcher(const char *fileName)
+  : m_fileName(fileName)
+{
+}
+
+TraceLogFetcher::~TraceLogFetcher()
+{
+  if (m_data != nullptr) {
+    munmap(const_cast<char*>(m_data), m_size);
+  }
+}
+
+bool
+TraceLogFetcher::prepare()
+{
+  int fd = open(m_fileName, O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Cannot open file: " << m_fileName << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  void *data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(TraceHeader)) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (data == MAP_FAILED) {
+    std::cerr << "Cannot map file: " << m_fileName << std::endl;
+    return false;
+  }
+  m_data = static_cast<const char*>(data);
+  m_size = st.st_size;
+
+  std::memcpy(&m_header, m_data, sizeof(m_header));
+  const TraceHeader& h = m_header;
+  bool hasHashes = (h.flags & TraceHeader::HAS_HASHES) != 0;
+  if (std::memcmp(h.magic, TraceHeader::MAGIC, sizeof(h.magic)) != 0 ||
+      h.nKeys >= (uint64_t(1) << 32) ||
+      h.keyOffsetsOffset % sizeof(uint64_t) != 0 ||
+      h.hashesOffset % sizeof(uint64_t) != 0 ||
+      !isValidRange(h.recordsOffset, h.recordsSize, m_size) ||
+      !isValidRange(h.keyOffsetsOffset, (h.nKeys + 1) * sizeof(uint64_t), m_size) ||
+      (hasHashes && !isValidRange(h.hashesOffset, h.nKeys * sizeof(uint64_t), m_size))) {
+    std::cerr << "Not a valid trace: " << m_fileName << std::endl;
+    return false;
+  }
+
+  m_keyOffsets = reinterpret_cast<const uint64_t*>(m_data + h.keyOffsetsOffset);
+  m_keys = m_data + h.keysOffset;
+  bool validOffsets = m_keyOffsets[0] == 0 && isValidRange(h.keysOffset, m_keyOffsets[h.nKeys], m_size);
+  for (uint64_t i = 0; i < h.nKeys && validOffsets; i++) {
+    validOffsets = m_keyOffsets[i] <= m_keyOffsets[i + 1];
+  }
+  if (!validOffsets) {
+    std::cerr << "Not a valid trace: " << m_fileName << std::endl;
+    return false;
+  }
+
+  if (hasHashes) {
+    m_hashes = reinterpret_cast<const uint64_t*>(m_data + h.hashesOffset);
+  }
+  else {
+    m_computedHashes.resize(h.nKeys);
+    for (uint64_t i = 0; i < h.nKeys; i++) {
+      m_computedHashes[i] = hashBytes(m_keys + m_keyOffsets[i], m_keyOffsets[i + 1] - m_keyOffsets[i]);
+    }
+    m_hashes = m_computedHashes.data();
+  }
+
+  m_cursor = reinterpret_cast<const uint8_t*>(m_data + h.recordsOffset);
+  m_end = m_cursor + h.recordsSize;
+  m_timestamp = h.startTime;
+  madvise(const_cast<char*>(m_data) + h.recordsOffset, h.recordsSize, MADV_SEQUENTIAL);
+  return true;
+}
+
+const std::string
+TraceLogFetcher::fetch()
+{
+  TraceRecord record;
+  if (!fetchRecord(record)) {
+    return std::string();
+  }
+  return record.key.str();
+}
+
+size_t
+TraceLogFetcher::fetchBatch(std::string* keys, size_t n)
+{
+  size_t i = 0;
+  TraceRecord record;
+  for (; i < n && fetchRecord(record); i++) {
+    keys[i].assign(record.key.data, record.key.size);
+  }
+  return i;
+}
+
+bool
+TraceLogFetcher::fetchRecord(TraceRecord& record)
+{
+  uint64_t delta;
+  uint64_t keyId;
+  if (!readVarint(m_cursor, m_end, delta) || !readVarint(m_cursor, m_end, keyId) ||
+      keyId >= m_header.nKeys) {
+    m_cursor = m_end;
+    return false;
+  }
+
+  // Zigzag decoding
+  m_timestamp += (delta >> 1) ^ -(delta & 1);
+  record.timestamp = m_timestamp;
+  record.keyId = static_cast<uint32_t>(keyId);
+  record.key = KeyView{m_keys + m_keyOffsets[keyId],
+                       static_cast<size_t>(m_keyOffsets[keyId + 1] - m_keyOffsets[keyId])};
+  record.hash = m_hashes[keyId];
+  return true;
+}
+
+size_t
+TraceLogFetcher::fetchBatch(TraceRecord* records, size_t n)
+{
+  size_t i = 0;
+  for (; i < n && fetchRecord(records[i]); i++) {
+  }
+  return i;
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef CAROUSEL_TRACE_LOG_FETCHER_HPP
+#define CAROUSEL_TRACE_LOG_FETCHER_HPP
+
+#include "log-fetcher.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace carousel
+{
+
+/**
+ * \brief Header of a binary trace, as written by trace_convert
+ *
+ * A trace is made of this header, the records, and the key dictionary. All integers are in host
+ * byte order, and offsets are in bytes from the start of the file.
+ *
+ * Each record is a pair of LEB128 varints: the zigzag-encoded difference between its timestamp
+ * and the previous one (the start time for the first record), and the id of its key. The
+ * dictionary is an array of nKeys + 1 64-bit offsets, followed by the key bytes they delimit, and
+ * optionally by the 64-bit hashKey of every key, so that replays need not hash keys again.
+ */
+struct TraceHeader
+{
+  static const char MAGIC[8]; // "CRSLTRC" and the format version
+  static const uint64_t HAS_HASHES = 1;
+
+  char magic[8];
+  uint64_t flags;
+  uint64_t nKeys;
+  uint64_t nRecords;
+  uint64_t startTime; // in ticks since the epoch
+  uint64_t tickNanoseconds;
+  uint64_t recordsOffset;
+  uint64_t recordsSize;
+  uint64_t keyOffsetsOffset;
+  uint64_t keysOffset;
+  uint64_t hashesOffset; // 0 without hashes
+};
+
+/**
+ * \brief Record of a trace
+ */
+struct TraceRecord
+{
+  uint64_t timestamp; // in ticks since the epoch
+  uint32_t keyId;
+  KeyView key;
+  uint64_t hash; // hashKey of the key
+};
+
+/**
+ * \brief Reads keys from a memory-mapped binary trace
+ *
+ * Records are decoded in place, and keys point into the dictionary of the mapping, so fetching a
+ * record does not allocate. If the trace has no hashes, they are computed once per key when the
+ * trace is prepared.
+ */
+class TraceLogFetcher : public LogFetcher {
+public:
+  TraceLogFetcher(const char *fileName);
+
+  ~TraceLogFetcher();
+
+  TraceLogFetcher(const TraceLogFetcher&) = delete; // non construction-copyable
+  TraceLogFetcher& operator=(const TraceLogFetcher&) = delete; // non copyable
+
+  bool
+  prepare();
+
+  const std::string
+  fetch();
+
+  size_t
+  fetchBatch(std::string* keys, size_t n);
+
+  /**
+   * \brief Fetches the next record
+   * \return false once the trace is exhausted
+   */
+  bool
+  fetchRecord(TraceRecord& record);
+
+  /**
+   * \brief Fetches up to n records
+   * \return Number of records fetched, fewer than n only once the trace is exhausted
+   */
+  size_t
+  fetchBatch(TraceRecord* records, size_t n);
+
+  const TraceHeader&
+  header() const
+  {
+    return m_header;
+  }
+
+private:
+  const char *m_fileName;
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  TraceHeader m_header;
+  const uint8_t *m_cursor = nullptr;
+  const uint8_t *m_end = nullptr;
+  uint64_t m_timestamp = 0;
+  const uint64_t *m_keyOffsets = nullptr;
+  const char *m_keys = nullptr;
+  const uint64_t *m_hashes = nullptr;
+  std::vector<uint64_t> m_computedHashes;
+};
+
+}
+
+#endif // CAROUSEL_TRACE_LOG_FETCHER_HPP
@@ -0,0 +1,286 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include "hash.hpp"
+#include "log-fetcher.hpp"
+#include "trace-log-fetcher.hpp"
+
+using carousel::KeyView;
+using carousel::MappedDatasetLogFetcher;
+using carousel::TraceHeader;
+
+struct Options {
+  int datasetSkip = 0;
+  int keyColumn = 2;
+  int keyFields = 1;
+  int timeColumn = 0;
+  bool hashes = false;
+  const char *input = nullptr;
+  const char *output = nullptr;
+
+  int parseArg(int argc, char *argv[])
+  {
+    int ch;
+    static struct option optlist[] = {
+      {"dataset-skip", required_argument, nullptr, 'S'},
+      {"key-column", required_argument, nullptr, 'c'},
+      {"key-fields", required_argument, nullptr, 'f'},
+      {"time-column", required_argument, nullptr, 't'},
+      {"hashes", no_argument, nullptr, 'H'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0},
+    };
+
+    while ((ch = getopt_long(argc, argv,
+                             "S:c:f:t:Hh",
+                             optlist, NULL)) != -1) {
+      switch(ch) {
+      case 'S': datasetSkip = atoi(optarg); break;
+      case 'c': keyColumn = atoi(optarg); break;
+      case 'f': keyFields = atoi(optarg); break;
+      case 't': timeColumn = atoi(optarg); break;
+      case 'H': hashes = true; break;
+      case 'h': printHelp(); return 1;
+      default:
+        std::cerr << "Unrecognized argument" << std::endl;
+        printHelp();
+        return 1;
+      }
+    }
+    if (argc - optind != 2) {
+      printHelp();
+      return 1;
+    }
+    input = argv[optind];
+    output = argv[optind + 1];
+    return 0;
+  }
+
+private:
+  void printHelp()
+  {
+    std::cerr << "trace_convert [OPTIONS] DATASET TRACE\n" << std::endl;
+    std::cerr << "Converts a dataset of tab-separated fields into a binary trace for carousel_test -t\n" << std::endl;
+    std::cerr << "-S, --dataset-skip\tSkip number of lines in the dataset (default: 0)" << std::endl;
+    std::cerr << "-c, --key-column\tTab-separated field of the dataset holding the key, from 0 (default: 2)" << std::endl;
+    std::cerr << "-f, --key-fields\tNumber of consecutive fields forming the key (default: 1)" << std::endl;
+    std::cerr << "-t, --time-column\tField holding the YYYY-MM-DD date, followed by the HH:MM:SS.ffffff time (default: 0)" << std::endl;
+    std::cerr << "-H, --hashes\tStore the hash of every key in the trace (default: disabled)" << std::endl;
+    std::cerr << "-h, --help\tThis help message" << std::endl;
+  }
+};
+
+/**
+ * \brief Parses an unsigned number of at most maxDigits digits, advancing p past it
+ */
+static bool
+parseNumber(const char *&p, const char *end, size_t maxDigits, uint64_t& value)
+{
+  const char *begin = p;
+  value = 0;
+  while (p != end && p - begin < static_cast<ptrdiff_t>(maxDigits) && *p >= '0' && *p <= '9') {
+    value = value * 10 + (*p++ - '0');
+  }
+  return p != begin;
+}
+
+static bool
+skip(const char *&p, const char *end, char c)
+{
+  if (p == end || *p != c) {
+    return false;
+  }
+  p++;
+  return true;
+}
+
+/**
+ * \brief Returns the number of days from 1970-01-01 to the specified date of the Gregorian calendar
+ */
+static int64_t
+daysFromCivil(int64_t y, unsigned m, unsigned d)
+{
+  y -= m <= 2;
+  const int64_t era = (y >= 0 ? y : y - 399) / 400;
+  const unsigned yoe = static_cast<unsigned>(y - era * 400);
+  const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/**
+ * \brief Parses "YYYY-MM-DD<separator>HH:MM:SS[.ffffff]" into microseconds since the epoch
+ */
+static bool
+parseTimestamp(KeyView field, uint64_t& timestamp)
+{
+  const char *p = field.data;
+  const char *end = field.data + field.size;
+  uint64_t year, month, day, hour, minute, second;
+  if (!parseNumber(p, end, 4, year) || !skip(p, end, '-') ||
+      !parseNumber(p, end, 2, month) || !skip(p, end, '-') ||
+      !parseNumber(p, end, 2, day) || p == end || !(*p == '\t' || *p == ' ' || *p == 'T') ||
+      !parseNumber(++p, end, 2, hour) || !skip(p, end, ':') ||
+      !parseNumber(p, end, 2, minute) || !skip(p, end, ':') ||
+      !parseNumber(p, end, 2, second) || month < 1 || month > 12) {
+    return false;
+  }
+
+  uint64_t micros = 0;
+  if (skip(p, end, '.')) {
+    const char *fraction = p;
+    parseNumber(p, end, 6, micros);
+    for (ptrdiff_t i = p - fraction; i < 6; i++) {
+      micros *= 10;
+    }
+  }
+
+  int64_t days = daysFromCivil(year, month, day);
+  timestamp = ((days * 24 + hour) * 60 + minute) * 60 + second;
+  timestamp = timestamp * 1000000 + micros;
+  return true;
+}
+
+static void
+writeVarint(std::string& buffer, uint64_t value)
+{
+  while (value >= 0x80) {
+    buffer.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<char>(value));
+}
+
+static bool
+writeAll(FILE *file, const void *data, size_t size)
+{
+  return std::fwrite(data, 1, size, file) == size;
+}
+
+static bool
+padTo8(FILE *file, uint64_t& offset)
+{
+  static const char zeros[8] = {0};
+  size_t padding = (8 - offset % 8) % 8;
+  offset += padding;
+  return writeAll(file, zeros, padding);
+}
+
+int main(int argc, char *argv[])
+{
+  Options o;
+  if (o.parseArg(argc, argv)) {
+    return 1;
+  }
+
+  MappedDatasetLogFetcher fetcher(o.input, o.datasetSkip, o.keyColumn, o.keyFields);
+  if (!fetcher.prepare()) {
+    return 1;
+  }
+
+  FILE *file = std::fopen(o.output, "wb");
+  if (file == nullptr) {
+    std::cerr << "Cannot create file: " << o.output << std::endl;
+    return 1;
+  }
+
+  TraceHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, TraceHeader::MAGIC, sizeof(header.magic));
+  header.flags = o.hashes ? TraceHeader::HAS_HASHES : 0;
+  header.tickNanoseconds = 1000;
+  header.recordsOffset = sizeof(header);
+  bool ok = writeAll(file, &header, sizeof(header));
+
+  // Records are written as they are read, and the dictionary is appended after them
+  std::unordered_map<std::string, uint32_t> ids;
+  std::vector<uint64_t> keyOffsets(1, 0);
+  std::string keyBytes;
+  std::string key;
+  std::string buffer;
+  uint64_t previous = 0;
+  size_t nUnparsedTimes = 0;
+  KeyView line;
+  while (ok && fetcher.fetchLine(line)) {
+    if (line.size == 0 || (line.size == 1 && line.data[0] == '\r')) {
+      continue;
+    }
+
+    uint64_t timestamp = previous;
+    if (!parseTimestamp(carousel::findFields(line, o.timeColumn, 2), timestamp)) {
+      nUnparsedTimes++;
+    }
+    if (header.nRecords == 0) {
+      header.startTime = timestamp;
+      previous = timestamp;
+    }
+
+    KeyView field = carousel::findFields(line, o.keyColumn, o.keyFields);
+    key.assign(field.data, field.size);
+    auto id = ids.find(key);
+    if (id == ids.end()) {
+      id = ids.insert(std::make_pair(key, static_cast<uint32_t>(ids.size()))).first;
+      keyBytes.append(key);
+      keyOffsets.push_back(keyBytes.size());
+    }
+
+    // Zigzag encoding, so that out-of-order timestamps are stored compactly as well
+    int64_t delta = static_cast<int64_t>(timestamp - previous);
+    writeVarint(buffer, (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+    writeVarint(buffer, id->second);
+    previous = timestamp;
+    header.nRecords++;
+
+    if (buffer.size() >= (1 << 20)) {
+      ok = writeAll(file, buffer.data(), buffer.size());
+      header.recordsSize += buffer.size();
+      buffer.clear();
+    }
+  }
+  ok = ok && writeAll(file, buffer.data(), buffer.size());
+  header.recordsSize += buffer.size();
+  header.nKeys = ids.size();
+
+  uint64_t offset = header.recordsOffset + header.recordsSize;
+  ok = ok && padTo8(file, offset);
+  header.keyOffsetsOffset = offset;
+  ok = ok && writeAll(file, keyOffsets.data(), keyOffsets.size() * sizeof(uint64_t));
+  offset += keyOffsets.size() * sizeof(uint64_t);
+  header.keysOffset = offset;
+  ok = ok && writeAll(file, keyBytes.data(), keyBytes.size());
+  offset += keyBytes.size();
+
+  if (o.hashes) {
+    ok = ok && padTo8(file, offset);
+    header.hashesOffset = offset;
+    for (size_t i = 0; ok && i + 1 < keyOffsets.size(); i++) {
+      uint64_t hash = carousel::hashBytes(keyBytes.data() + keyOffsets[i], keyOffsets[i + 1] - keyOffsets[i]);
+      ok = writeAll(file, &hash, sizeof(hash));
+    }
+    offset += header.nKeys * sizeof(uint64_t);
+  }
+
+  ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && writeAll(file, &header, sizeof(header));
+  ok = std::fclose(file) == 0 && ok;
+  if (!ok) {
+    std::cerr << "Cannot write file: " << o.output << std::endl;
+    return 1;
+  }
+
+  if (nUnparsedTimes > 0) {
+    std::cerr << nUnparsedTimes << " lines without a valid timestamp" << std::endl;
+  }
+  std::cout << header.nRecords << " records, " << header.nKeys << " keys, " << offset << " bytes ("
+            << static_cast<double>(header.recordsSize) / std::max<uint64_t>(header.nRecords, 1)
+            << " bytes per record)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,190 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_HASH_HPP
+#define CAROUSEL_HASH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace carousel {
+
+namespace detail {
+
+// Implementation of the wyhash function derived from https://github.com/wangyi-fudan/wyhash
+// The original work was released into the public domain by Wang Yi under The Unlicense.
+
+const uint64_t WY_SECRET[4] = {
+  0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL, 0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
+
+inline void
+wyMum(uint64_t& a, uint64_t& b)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = a;
+  r *= b;
+  a = static_cast<uint64_t>(r);
+  b = static_cast<uint64_t>(r >> 64);
+#else
+  uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32);
+  uint64_t c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+  a = lo;
+  b = hi;
+#endif
+}
+
+inline uint64_t
+wyMix(uint64_t a, uint64_t b)
+{
+  wyMum(a, b);
+  return a ^ b;
+}
+
+inline uint64_t
+wyRead8(const uint8_t* p)
+{
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t
+wyRead4(const uint8_t* p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint64_t
+wyRead3(const uint8_t* p, size_t len)
+{
+  return (static_cast<uint64_t>(p[0]) << 16) | (static_cast<uint64_t>(p[len >> 1]) << 8) | p[len - 1];
+}
+
+/**
+ * \brief Finalizer of MurmurHash3, in which every input bit affects every output bit
+ */
+inline uint64_t
+fmix64(uint64_t h)
+{
+  h = (h ^ (h >> 33)) * 0xff51afd7ed558ccdULL;
+  h = (h ^ (h >> 33)) * 0xc4ceb9fe1a85ec53ULL;
+  return h ^ (h >> 33);
+}
+
+// Odd multipliers that spread one 32-bit value into eight independent in-block bit positions,
+// as in the split block bloom filter of Putze et al. and Apache Parquet
+const uint32_t BLOCK_SALTS[8] = {
+  0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+  0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+};
+
+} // namespace detail
+
+/**
+ * \brief Computes a 64-bit hash of the specified bytes
+ *
+ * A single pass over the key yields a hash whose bits are uniformly distributed, so callers may
+ * carve several independent values out of it instead of hashing the key again.
+ */
+inline uint64_t
+hashBytes(const void* data, size_t len, uint64_t seed = 0)
+{
+  using namespace detail;
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  seed ^= wyMix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+  uint64_t a = 0;
+  uint64_t b = 0;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (wyRead4(p) << 32) | wyRead4(p + ((len >> 3) << 2));
+      b = (wyRead4(p + len - 4) << 32) | wyRead4(p + len - 4 - ((len >> 3) << 2));
+    }
+    else if (len > 0) {
+      a = wyRead3(p, len);
+    }
+  }
+  else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed;
+      uint64_t see2 = seed;
+      do {
+        seed = wyMix(wyRead8(p) ^ WY_SECRET[1], wyRead8(p + 8) ^ seed);
+        see1 = wyMix(wyRead8(p + 16) ^ WY_SECRET[2], wyRead8(p + 24) ^ see1);
+        see2 = wyMix(wyRead8(p + 32) ^ WY_SECRET[3], wyRead8(p + 40) ^ see2);
+        p += 48;
+        i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = wyMix(wyRead8(p) ^ WY_SECRET[1], wyRead8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = wyRead8(p + i - 16);
+    b = wyRead8(p + i - 8);
+  }
+  a ^= WY_SECRET[1];
+  b ^= seed;
+  wyMum(a, b);
+  return wyMix(a ^ WY_SECRET[0] ^ len, b ^ WY_SECRET[1]);
+}
+
+/**
+ * \brief Computes the 64-bit hash of a logging key
+ */
+inline uint64_t
+hashKey(const std::string& key)
+{
+  return hashBytes(key.data(), key.size());
+}
+
+/**
+ * \brief Computes the 64-bit hash of a fixed-width integer logging key
+ *
+ * Integer keys are mixed directly rather than hashed as bytes, so they hash differently from
+ * their string representations. A given deployment should stick to one kind of key. A single
+ * wyMix leaves the hashes of consecutive keys correlated, which skews the load of bloom filter
+ * blocks and of partitions, so it is followed by a full finalizer.
+ */
+inline uint64_t
+hashKey(uint64_t key)
+{
+  using namespace detail;
+  return fmix64(wyMix(key ^ WY_SECRET[0], WY_SECRET[1] ^ sizeof(key)));
+}
+
+inline uint64_t
+hashKey(uint32_t key)
+{
+  using namespace detail;
+  return fmix64(wyMix(key ^ WY_SECRET[0], WY_SECRET[1] ^ sizeof(key)));
+}
+
+/**
+ * \brief Derives the two base values used for double hashing from a key's 64-bit hash
+ *
+ * Carousel partitions keys on the low bits of the same hash, so all keys seen in one phase share
+ * them. The probe sequence is therefore seeded from the high half and a remix of the whole hash,
+ * which keeps the keys of a partition spread over the entire filter.
+ */
+inline void
+deriveProbes(uint64_t hash, uint64_t& h1, uint64_t& h2)
+{
+  h1 = (hash >> 32) | (hash << 32);
+  h2 = ((hash ^ (hash >> 31)) * 0x9e3779b97f4a7c15ULL) | 1;
+}
+
+} // namespace carousel
+
+#endif // CAROUSEL_HASH_HPP
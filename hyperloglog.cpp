@@ -0,0 +1,48 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "hyperloglog.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace carousel {
+
+HyperLogLog::HyperLogLog(unsigned precision)
+  : m_precision(precision)
+{
+  if (precision < 4 || precision > 18) {
+    throw std::invalid_argument("HyperLogLog precision must be between 4 and 18");
+  }
+  m_registers.assign(size_t(1) << precision, 0);
+}
+
+double
+HyperLogLog::estimate() const
+{
+  double m = static_cast<double>(m_registers.size());
+  double sum = 0;
+  size_t nEmpty = 0;
+  for (uint8_t rank : m_registers) {
+    sum += std::ldexp(1.0, -static_cast<int>(rank));
+    nEmpty += rank == 0;
+  }
+
+  double alpha = 0.7213 / (1 + 1.079 / m);
+  double raw = alpha * m * m / sum;
+  if (raw <= 2.5 * m && nEmpty > 0) {
+    // Linear counting is more accurate while many registers are empty
+    return m * std::log(m / nEmpty);
+  }
+  // 64-bit hashes make collisions negligible, so no correction is needed for large counts
+  return raw;
+}
+
+void
+HyperLogLog::reset()
+{
+  std::fill(m_registers.begin(), m_registers.end(), 0);
+}
+
+} // namespace carousel
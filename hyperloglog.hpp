@@ -0,0 +1,72 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_HYPERLOGLOG_HPP
+#define CAROUSEL_HYPERLOGLOG_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace carousel {
+
+/**
+ * \brief HyperLogLog sketch (Flajolet et al., AofA 2007), estimating the number of distinct keys
+ *        added to it
+ *
+ * The sketch keeps 2^precision one-byte registers. The top precision bits of the 64-bit hash of a
+ * key select a register, which keeps the largest position of the first set bit among the other
+ * bits of the hashes it saw. The relative standard error of the estimate is about
+ * 1.04 / sqrt(2^precision), i.e., 1.6% for the default precision of 12, which takes 4 KiB. Small
+ * counts are estimated by linear counting over the empty registers instead.
+ */
+class HyperLogLog
+{
+public:
+  /**
+   * \brief Creates an empty sketch of 2^precision registers, with precision between 4 and 18
+   */
+  explicit
+  HyperLogLog(unsigned precision = 12);
+
+  /**
+   * \brief Adds a key to the sketch, given its 64-bit hash (see hashKey)
+   */
+  void
+  add(uint64_t hash)
+  {
+    size_t index = hash >> (64 - m_precision);
+    // The remaining bits, with a sentinel so that the rank is at most 65 - precision
+    uint64_t rest = (hash << m_precision) | (uint64_t(1) << (m_precision - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    if (rank > m_registers[index]) {
+      m_registers[index] = rank;
+    }
+  }
+
+  /**
+   * \brief Returns the estimated number of distinct keys added since the last reset
+   */
+  double
+  estimate() const;
+
+  /**
+   * \brief Removes all keys
+   */
+  void
+  reset();
+
+  size_t
+  memoryBytes() const
+  {
+    return m_registers.size();
+  }
+
+private:
+  unsigned m_precision;
+  std::vector<uint8_t> m_registers;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_HYPERLOGLOG_HPP
@@ -0,0 +1,446 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "segment-sink.hpp"
+#include "hash.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <system_error>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace carousel {
+
+namespace {
+
+const char SEGMENT_MAGIC[8] = {'C', 'R', 'S', 'L', 'S', 'E', 'G', 1};
+const size_t SEGMENT_HEADER_SIZE = 16;
+const size_t RECORD_HEADER_SIZE = 12;
+const size_t SEQUENCE_DIGITS = 20;
+const char SEGMENT_EXTENSION[] = ".seg";
+
+// Rotated segments the background thread may lag behind by before rotation blocks
+const size_t MAX_RETIRED = 2;
+
+size_t
+pageSize()
+{
+  static const size_t size = sysconf(_SC_PAGESIZE);
+  return size;
+}
+
+uint32_t
+recordChecksum(const char* key, uint32_t keyLength, const char* entry, uint32_t entryLength)
+{
+  uint64_t seed = (static_cast<uint64_t>(keyLength) << 32) | entryLength;
+  uint64_t hash = hashBytes(entry, entryLength, hashBytes(key, keyLength, seed));
+  uint32_t checksum = static_cast<uint32_t>(hash ^ (hash >> 32));
+  return checksum != 0 ? checksum : 1;
+}
+
+bool
+isSegmentName(const char* name)
+{
+  size_t length = std::strlen(name);
+  if (length != SEQUENCE_DIGITS + sizeof(SEGMENT_EXTENSION) - 1 ||
+      std::strcmp(name + SEQUENCE_DIGITS, SEGMENT_EXTENSION) != 0) {
+    return false;
+  }
+  return std::all_of(name, name + SEQUENCE_DIGITS, [] (char c) { return c >= '0' && c <= '9'; });
+}
+
+/**
+ * \brief Returns the names of the segment files in a directory, in sequence order
+ */
+std::vector<std::string>
+listSegments(const std::string& directory)
+{
+  DIR* dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    throw std::system_error(errno, std::system_category(), "cannot open " + directory);
+  }
+  std::vector<std::string> names;
+  while (struct dirent* entry = readdir(dir)) {
+    if (isSegmentName(entry->d_name)) {
+      names.push_back(entry->d_name);
+    }
+  }
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+void
+syncDirectory(const std::string& directory)
+{
+  int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd >= 0) {
+    fsync(fd);
+    ::close(fd);
+  }
+}
+
+} // namespace
+
+SegmentSink::SegmentSink(const std::string& directory,
+                         size_t segmentSize,
+                         std::chrono::milliseconds syncInterval,
+                         size_t syncBytes)
+  : m_directory(directory)
+  , m_segmentSize((std::max(segmentSize, SEGMENT_HEADER_SIZE + RECORD_HEADER_SIZE) + pageSize() - 1) &
+                  ~(pageSize() - 1))
+  , m_syncInterval(syncInterval)
+  , m_syncBytes(std::max<size_t>(syncBytes, 1))
+  , m_start(std::chrono::steady_clock::now())
+  , m_offset(SEGMENT_HEADER_SIZE)
+  , m_currentEnd(SEGMENT_HEADER_SIZE)
+  , m_bytesWritten(0)
+  , m_nRecords(0)
+  , m_bytesSynced(0)
+  , m_syncRequested(false)
+  , m_syncedEnd(0)
+{
+  if (mkdir(m_directory.c_str(), 0777) != 0 && errno != EEXIST) {
+    throw std::system_error(errno, std::system_category(), "cannot create " + m_directory);
+  }
+
+  std::vector<std::string> existing = listSegments(m_directory);
+  uint64_t sequence = existing.empty() ? 0 : std::strtoull(existing.back().c_str(), nullptr, 10) + 1;
+  m_current = createSegment(sequence);
+  m_syncedSequence = sequence;
+
+  m_thread = std::thread(&SegmentSink::thread, this);
+}
+
+SegmentSink::~SegmentSink()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_flusherWakeup.notify_one();
+  m_thread.join();
+
+  m_current.end = m_offset;
+  finalizeSegment(m_current);
+  if (m_spare.data != nullptr) {
+    munmap(m_spare.data, m_spare.size);
+    ::close(m_spare.fd);
+    unlink(segmentPath(m_spare.sequence).c_str());
+  }
+}
+
+void
+SegmentSink::append(const char* key, size_t keyLength, const char* entry, size_t entryLength)
+{
+  size_t recordSize = RECORD_HEADER_SIZE + keyLength + entryLength;
+  if (keyLength > std::numeric_limits<uint32_t>::max() ||
+      entryLength > std::numeric_limits<uint32_t>::max() ||
+      recordSize > m_segmentSize - SEGMENT_HEADER_SIZE) {
+    throw std::length_error("SegmentSink: record does not fit in a segment");
+  }
+  if (m_offset + recordSize > m_current.size) {
+    rotate();
+  }
+
+  uint32_t header[3] = {
+    static_cast<uint32_t>(keyLength),
+    static_cast<uint32_t>(entryLength),
+    recordChecksum(key, keyLength, entry, entryLength),
+  };
+  char* p = m_current.data + m_offset;
+  std::memcpy(p, header, RECORD_HEADER_SIZE);
+  std::memcpy(p + RECORD_HEADER_SIZE, key, keyLength);
+  std::memcpy(p + RECORD_HEADER_SIZE + keyLength, entry, entryLength);
+  m_offset += recordSize;
+
+  // The end of the segment is published before the byte count, so that the background thread
+  // always syncs at least as far as the bytes it reports as durable
+  m_currentEnd.store(m_offset, std::memory_order_release);
+  uint64_t written = m_bytesWritten.load(std::memory_order_relaxed) + recordSize;
+  m_bytesWritten.store(written, std::memory_order_release);
+  m_nRecords.store(m_nRecords.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+  if (written - m_lastSyncRequest >= m_syncBytes) {
+    m_lastSyncRequest = written;
+    requestSync();
+  }
+}
+
+void
+SegmentSink::sync()
+{
+  uint64_t target = m_bytesWritten.load(std::memory_order_relaxed);
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_syncRequested.store(true, std::memory_order_relaxed);
+  m_flusherWakeup.notify_one();
+  m_writerWakeup.wait(lock, [this, target] {
+    return m_error != 0 || m_bytesSynced.load(std::memory_order_relaxed) >= target;
+  });
+  if (m_error != 0) {
+    throw std::system_error(m_error, std::system_category(), "SegmentSink: cannot sync " + m_directory);
+  }
+}
+
+double
+SegmentSink::bytesPerSecond() const
+{
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_start;
+  return bytesWritten() / elapsed.count();
+}
+
+std::string
+SegmentSink::segmentPath(uint64_t sequence) const
+{
+  char name[SEQUENCE_DIGITS + sizeof(SEGMENT_EXTENSION)];
+  std::snprintf(name, sizeof(name), "%020llu%s", static_cast<unsigned long long>(sequence),
+                SEGMENT_EXTENSION);
+  return m_directory + "/" + name;
+}
+
+SegmentSink::Segment
+SegmentSink::createSegment(uint64_t sequence)
+{
+  std::string path = segmentPath(sequence);
+  Segment segment;
+  segment.fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (segment.fd < 0) {
+    throw std::system_error(errno, std::system_category(), "cannot create " + path);
+  }
+
+  // Allocating the blocks up front means that writing to the mapping cannot fail for lack of space
+  int error = posix_fallocate(segment.fd, 0, m_segmentSize);
+  void* data = MAP_FAILED;
+  if (error == 0) {
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+    data = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE, flags, segment.fd, 0);
+    if (data == MAP_FAILED) {
+      error = errno;
+    }
+  }
+  if (error != 0) {
+    ::close(segment.fd);
+    unlink(path.c_str());
+    throw std::system_error(error, std::system_category(), "cannot map " + path);
+  }
+
+  segment.data = static_cast<char*>(data);
+  segment.size = m_segmentSize;
+  segment.sequence = sequence;
+  std::memcpy(segment.data, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC));
+  std::memcpy(segment.data + sizeof(SEGMENT_MAGIC), &sequence, sizeof(sequence));
+  syncDirectory(m_directory);
+  return segment;
+}
+
+int
+SegmentSink::finalizeSegment(Segment& segment)
+{
+  int error = 0;
+  if (msync(segment.data, segment.end, MS_SYNC) != 0) {
+    error = errno;
+  }
+  munmap(segment.data, segment.size);
+  if (ftruncate(segment.fd, segment.end) != 0 && error == 0) {
+    error = errno;
+  }
+  if (fsync(segment.fd) != 0 && error == 0) {
+    error = errno;
+  }
+  ::close(segment.fd);
+  return error;
+}
+
+void
+SegmentSink::rotate()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_writerWakeup.wait(lock, [this] {
+    return m_error != 0 || (m_spare.data != nullptr && m_nRetired < MAX_RETIRED);
+  });
+  if (m_spare.data == nullptr || m_nRetired >= MAX_RETIRED) {
+    throw std::system_error(m_error, std::system_category(), "SegmentSink: cannot rotate segment");
+  }
+
+  m_current.end = m_offset;
+  m_retired.push_back(m_current);
+  m_nRetired++;
+  m_current = m_spare;
+  m_spare = Segment();
+  m_offset = SEGMENT_HEADER_SIZE;
+  m_currentEnd.store(m_offset, std::memory_order_release);
+  m_flusherWakeup.notify_one();
+}
+
+void
+SegmentSink::requestSync()
+{
+  // Notifying without the lock may miss a background thread about to wait, in which case the
+  // commit happens at the end of the sync interval instead
+  m_syncRequested.store(true, std::memory_order_relaxed);
+  m_flusherWakeup.notify_one();
+}
+
+void
+SegmentSink::thread()
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  while (true) {
+    m_flusherWakeup.wait_for(lock, m_syncInterval, [this] {
+      return m_stop || m_syncRequested.load(std::memory_order_relaxed) || !m_retired.empty() ||
+             (m_spare.data == nullptr && m_error == 0);
+    });
+
+    // Rotation needs the lock, so the current segment and its end are consistent here
+    bool stop = m_stop;
+    m_syncRequested.store(false, std::memory_order_relaxed);
+    std::vector<Segment> retired;
+    retired.swap(m_retired);
+    Segment current = m_current;
+    uint64_t target = m_bytesWritten.load(std::memory_order_acquire);
+    size_t end = m_currentEnd.load(std::memory_order_acquire);
+    bool needSpare = m_spare.data == nullptr && m_error == 0 && !stop;
+    lock.unlock();
+
+    int error = 0;
+    for (Segment& segment : retired) {
+      int segmentError = finalizeSegment(segment);
+      error = error != 0 ? error : segmentError;
+    }
+
+    if (current.sequence != m_syncedSequence) {
+      m_syncedSequence = current.sequence;
+      m_syncedEnd = 0;
+    }
+    if (end > m_syncedEnd) {
+      size_t from = m_syncedEnd & ~(pageSize() - 1);
+      if (msync(current.data + from, end - from, MS_SYNC) != 0 && error == 0) {
+        error = errno;
+      }
+      m_syncedEnd = end;
+    }
+
+    Segment spare;
+    if (needSpare) {
+      try {
+        spare = createSegment(current.sequence + 1);
+      }
+      catch (const std::system_error& e) {
+        error = error != 0 ? error : e.code().value();
+      }
+    }
+
+    lock.lock();
+    m_nRetired -= retired.size();
+    if (spare.data != nullptr) {
+      m_spare = spare;
+    }
+    if (error != 0 && m_error == 0) {
+      m_error = error;
+    }
+    m_bytesSynced.store(target, std::memory_order_relaxed);
+    m_writerWakeup.notify_all();
+    if (stop) {
+      break;
+    }
+  }
+}
+
+SegmentReader::SegmentReader(const std::string& directory)
+{
+  for (const std::string& name : listSegments(directory)) {
+    m_paths.push_back(directory + "/" + name);
+  }
+}
+
+SegmentReader::~SegmentReader()
+{
+  closeSegment();
+}
+
+bool
+SegmentReader::next(SegmentRecord& record)
+{
+  while (true) {
+    if (m_data != nullptr) {
+      if (m_offset + RECORD_HEADER_SIZE <= m_size) {
+        uint32_t header[3];
+        std::memcpy(header, m_data + m_offset, RECORD_HEADER_SIZE);
+        if (header[2] != 0) {
+          const char* key = m_data + m_offset + RECORD_HEADER_SIZE;
+          size_t recordSize = RECORD_HEADER_SIZE + header[0] + header[1];
+          if (recordSize <= m_size - m_offset &&
+              recordChecksum(key, header[0], key + header[0], header[1]) == header[2]) {
+            record.key = key;
+            record.keyLength = header[0];
+            record.entry = key + header[0];
+            record.entryLength = header[1];
+            m_offset += recordSize;
+            return true;
+          }
+          m_nDamaged++;
+        }
+      }
+      closeSegment();
+    }
+
+    if (m_nextPath == m_paths.size()) {
+      return false;
+    }
+    if (!openSegment(m_paths[m_nextPath++])) {
+      m_nDamaged++;
+    }
+  }
+}
+
+bool
+SegmentReader::openSegment(const std::string& path)
+{
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= SEGMENT_HEADER_SIZE) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  m_data = static_cast<const char*>(data);
+  m_size = st.st_size;
+  m_offset = SEGMENT_HEADER_SIZE;
+  if (std::memcmp(m_data, SEGMENT_MAGIC, sizeof(SEGMENT_MAGIC)) != 0) {
+    closeSegment();
+    return false;
+  }
+  madvise(const_cast<char*>(m_data), m_size, MADV_SEQUENTIAL);
+  return true;
+}
+
+void
+SegmentReader::closeSegment()
+{
+  if (m_data != nullptr) {
+    munmap(const_cast<char*>(m_data), m_size);
+    m_data = nullptr;
+  }
+}
+
+} // namespace carousel
@@ -0,0 +1,258 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_SEGMENT_SINK_HPP
+#define CAROUSEL_SEGMENT_SINK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace carousel {
+
+/**
+ * Segment files
+ *
+ * A segment file starts with a 16-byte header: the magic "CRSLSEG" followed by a format version
+ * byte, then the 64-bit sequence number of the segment. Records follow back to back. Each record
+ * is a 12-byte header holding the key length, the entry length and a checksum of the record, all
+ * 32-bit in host byte order, followed by the key and entry bytes. The checksum is never zero, so
+ * the zeroed space preallocated after the last record marks the end of a segment that was not
+ * closed cleanly. Segment files are named after their sequence number, zero-padded so that they
+ * sort in order, with the extension ".seg".
+ */
+
+/**
+ * \brief Durable sink appending the output of Carousel to memory-mapped segment files
+ *
+ * Records are copied into a preallocated, mapped segment, so appending a record costs a memcpy
+ * and no system call. A background thread commits appended records to disk in groups, once per
+ * sync interval or as soon as syncBytes bytes are pending, creates the next segment ahead of
+ * rotation, and finalizes rotated segments by syncing and truncating them to their contents.
+ * At most two rotated segments await finalization, so no more than four segments are mapped at
+ * once: if the disk falls behind, append blocks at the next rotation until the background thread
+ * catches up.
+ *
+ * append must not be called concurrently, which holds when SegmentSink is the sink of a
+ * Carousel. Pass it as std::ref(sink), or use BasicCarousel<std::reference_wrapper<SegmentSink>>.
+ */
+class SegmentSink
+{
+public:
+  /**
+   * \param directory Directory to write segments into, created if it does not exist
+   * \param segmentSize Size of a segment file in bytes, which bounds the size of a record
+   * \param syncInterval Maximum time between two group commits
+   * \param syncBytes Number of pending bytes that triggers a group commit before the interval ends
+   *
+   * New segments are numbered after the last segment already in the directory.
+   */
+  SegmentSink(const std::string& directory,
+              size_t segmentSize = 64 << 20,
+              std::chrono::milliseconds syncInterval = std::chrono::milliseconds(10),
+              size_t syncBytes = 1 << 20);
+
+  /**
+   * \brief Commits all records, truncates the last segment and stops the background thread
+   */
+  ~SegmentSink();
+
+  SegmentSink(const SegmentSink&) = delete; // non construction-copyable
+  SegmentSink& operator=(const SegmentSink&) = delete; // non copyable
+
+  /**
+   * \brief Appends a record
+   *
+   * The record is durable after the next group commit. Throws std::length_error if it does not
+   * fit in a segment, and std::system_error if a new segment could not be created.
+   */
+  void
+  append(const char* key, size_t keyLength, const char* entry, size_t entryLength);
+
+  void
+  append(const std::string& key, const std::string& entry)
+  {
+    append(key.data(), key.size(), entry.data(), entry.size());
+  }
+
+  void
+  operator()(const std::string& key, const std::string& entry)
+  {
+    append(key, entry);
+  }
+
+  /**
+   * \brief Blocks until every record appended so far is durable
+   *
+   * Throws std::system_error if the background thread failed to write to disk.
+   */
+  void
+  sync();
+
+  uint64_t
+  numRecords() const
+  {
+    return m_nRecords.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Returns the number of bytes appended, including record headers
+   */
+  uint64_t
+  bytesWritten() const
+  {
+    return m_bytesWritten.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Returns the number of bytes appended that are durable
+   */
+  uint64_t
+  bytesSynced() const
+  {
+    return m_bytesSynced.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Returns the rate at which bytes were appended since the sink was created
+   */
+  double
+  bytesPerSecond() const;
+
+private:
+  struct Segment
+  {
+    int fd = -1;
+    char* data = nullptr;
+    size_t size = 0;
+    uint64_t sequence = 0;
+    size_t end = 0; // end of the records, once rotated out
+  };
+
+  std::string
+  segmentPath(uint64_t sequence) const;
+
+  Segment
+  createSegment(uint64_t sequence);
+
+  int
+  finalizeSegment(Segment& segment);
+
+  void
+  rotate();
+
+  void
+  requestSync();
+
+  void
+  thread();
+
+private:
+  const std::string m_directory;
+  const size_t m_segmentSize;
+  const std::chrono::milliseconds m_syncInterval;
+  const size_t m_syncBytes;
+  const std::chrono::steady_clock::time_point m_start;
+
+  // Only accessed by the appending thread, or under m_mutex when rotating
+  Segment m_current;
+  size_t m_offset;
+  uint64_t m_lastSyncRequest = 0;
+
+  std::atomic<size_t> m_currentEnd;
+  std::atomic<uint64_t> m_bytesWritten;
+  std::atomic<uint64_t> m_nRecords;
+  std::atomic<uint64_t> m_bytesSynced;
+  std::atomic<bool> m_syncRequested;
+
+  // Only accessed by the background thread
+  uint64_t m_syncedSequence;
+  size_t m_syncedEnd;
+
+  // Guarded by m_mutex
+  std::mutex m_mutex;
+  std::condition_variable m_flusherWakeup;
+  std::condition_variable m_writerWakeup;
+  std::vector<Segment> m_retired;
+  size_t m_nRetired = 0; // including the segments being finalized
+  Segment m_spare;
+  int m_error = 0;
+  bool m_stop = false;
+
+  std::thread m_thread;
+};
+
+/**
+ * \brief Record read from a segment, pointing into the mapped segment file
+ */
+struct SegmentRecord
+{
+  const char* key;
+  size_t keyLength;
+  const char* entry;
+  size_t entryLength;
+};
+
+/**
+ * \brief Iterates over the records of all segments in a directory, in order
+ *
+ * Segments are mapped read-only one at a time. A segment whose header is invalid is skipped, and
+ * reading a segment stops at the first record whose checksum does not match, such as a record
+ * torn by a crash; both count as damaged segments.
+ */
+class SegmentReader
+{
+public:
+  explicit
+  SegmentReader(const std::string& directory);
+
+  ~SegmentReader();
+
+  SegmentReader(const SegmentReader&) = delete; // non construction-copyable
+  SegmentReader& operator=(const SegmentReader&) = delete; // non copyable
+
+  /**
+   * \brief Reads the next record
+   * \return false once all segments have been read
+   *
+   * The record points into the current segment and remains valid until the next call.
+   */
+  bool
+  next(SegmentRecord& record);
+
+  size_t
+  numSegments() const
+  {
+    return m_paths.size();
+  }
+
+  size_t
+  numDamagedSegments() const
+  {
+    return m_nDamaged;
+  }
+
+private:
+  bool
+  openSegment(const std::string& path);
+
+  void
+  closeSegment();
+
+private:
+  std::vector<std::string> m_paths;
+  size_t m_nextPath = 0;
+  const char* m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_offset = 0;
+  size_t m_nDamaged = 0;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_SEGMENT_SINK_HPP
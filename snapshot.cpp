@@ -0,0 +1,169 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#include "snapshot.hpp"
+#include "hash.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace carousel {
+
+namespace {
+
+// Version 2 changed the hash of integer keys, and so the filter bits they set
+const char SNAPSHOT_MAGIC[8] = {'C', 'R', 'S', 'L', 'S', 'N', 'P', 2};
+const size_t STATE_OFFSET = sizeof(SNAPSHOT_MAGIC);
+const size_t CHECKSUM_OFFSET = STATE_OFFSET + sizeof(SnapshotState);
+const size_t WORDS_OFFSET = CHECKSUM_OFFSET + sizeof(uint64_t);
+
+static_assert(WORDS_OFFSET % sizeof(uint64_t) == 0, "filter words must be aligned");
+
+uint64_t
+snapshotChecksum(const SnapshotState& state, const uint64_t* filterWords)
+{
+  return hashBytes(filterWords, state.nFilterWords * sizeof(uint64_t),
+                   hashBytes(&state, sizeof(state)));
+}
+
+/**
+ * \brief Writes the whole buffer, returning 0 or the error
+ */
+int
+writeAll(int fd, const void* data, size_t size)
+{
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = ::write(fd, p, size);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    p += n;
+    size -= n;
+  }
+  return 0;
+}
+
+/**
+ * \brief Returns the directory holding the file at the specified path
+ */
+std::string
+directoryOf(const std::string& path)
+{
+  size_t slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+} // namespace
+
+void
+writeSnapshot(const std::string& path, const SnapshotState& state, const uint64_t* filterWords)
+{
+  std::string temporary = path + ".tmp";
+  int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::system_category(), "cannot create " + temporary);
+  }
+
+  uint64_t checksum = snapshotChecksum(state, filterWords);
+  int error = writeAll(fd, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  if (error == 0) {
+    error = writeAll(fd, &state, sizeof(state));
+  }
+  if (error == 0) {
+    error = writeAll(fd, &checksum, sizeof(checksum));
+  }
+  if (error == 0) {
+    error = writeAll(fd, filterWords, state.nFilterWords * sizeof(uint64_t));
+  }
+  if (error == 0 && fsync(fd) != 0) {
+    error = errno;
+  }
+  if (::close(fd) != 0 && error == 0) {
+    error = errno;
+  }
+  if (error == 0 && std::rename(temporary.c_str(), path.c_str()) != 0) {
+    error = errno;
+  }
+  if (error != 0) {
+    unlink(temporary.c_str());
+    throw std::system_error(error, std::system_category(), "cannot write snapshot " + path);
+  }
+
+  // Make the rename durable
+  int dirFd = ::open(directoryOf(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd >= 0) {
+    fsync(dirFd);
+    ::close(dirFd);
+  }
+}
+
+MappedSnapshot::~MappedSnapshot()
+{
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+  }
+}
+
+SnapshotResult
+MappedSnapshot::open(const std::string& path)
+{
+  if (m_data != nullptr) {
+    munmap(m_data, m_size);
+    m_data = nullptr;
+    m_filterWords = nullptr;
+  }
+
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return errno == ENOENT ? SnapshotResult::NOT_FOUND : SnapshotResult::DAMAGED;
+  }
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= WORDS_OFFSET) {
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return SnapshotResult::DAMAGED;
+  }
+  m_data = data;
+  m_size = st.st_size;
+
+  const char* bytes = static_cast<const char*>(m_data);
+  if (std::memcmp(bytes, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC) - 1) != 0) {
+    return SnapshotResult::DAMAGED;
+  }
+  if (bytes[sizeof(SNAPSHOT_MAGIC) - 1] != SNAPSHOT_MAGIC[sizeof(SNAPSHOT_MAGIC) - 1]) {
+    return SnapshotResult::INCOMPATIBLE;
+  }
+
+  std::memcpy(&m_state, bytes + STATE_OFFSET, sizeof(m_state));
+  if (m_state.nFilterWords != (m_size - WORDS_OFFSET) / sizeof(uint64_t) ||
+      (m_size - WORDS_OFFSET) % sizeof(uint64_t) != 0) {
+    return SnapshotResult::DAMAGED;
+  }
+  uint64_t checksum;
+  std::memcpy(&checksum, bytes + CHECKSUM_OFFSET, sizeof(checksum));
+  const uint64_t* filterWords = reinterpret_cast<const uint64_t*>(bytes + WORDS_OFFSET);
+  if (checksum != snapshotChecksum(m_state, filterWords)) {
+    return SnapshotResult::DAMAGED;
+  }
+  m_filterWords = filterWords;
+  return SnapshotResult::RESTORED;
+}
+
+} // namespace carousel
@@ -0,0 +1,111 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_SNAPSHOT_HPP
+#define CAROUSEL_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace carousel {
+
+/**
+ * Snapshot files
+ *
+ * A snapshot file starts with the magic "CRSLSNP" followed by a format version byte, then the
+ * fixed-size SnapshotState, a 64-bit checksum of the state and of the filter words, and the
+ * filter words themselves, all in host byte order. The words start at a multiple of 8 bytes, so
+ * that they can be used in place from a mapping of the file.
+ */
+
+/**
+ * \brief Outcome of loading a snapshot
+ */
+enum class SnapshotResult {
+  /// The state of the snapshot was restored
+  RESTORED,
+  /// There is no snapshot at this path
+  NOT_FOUND,
+  /// The snapshot has another format version, or was taken from an instance of another memory
+  /// size, mode or filter, and was ignored
+  INCOMPATIBLE,
+  /// The snapshot could not be read, or is truncated or corrupted, and was ignored
+  DAMAGED,
+};
+
+/**
+ * \brief State of a Carousel instance saved in a snapshot, besides its filter words
+ *
+ * Phase timing is saved as durations, since clock ticks are only meaningful within one process,
+ * along with the wall clock time of the snapshot, so that the time spent before restoring it is
+ * deducted from the phase.
+ */
+struct SnapshotState
+{
+  uint64_t memorySize;
+  uint64_t original;
+  uint64_t filterTag;         ///< format of the filter words (see Bloom::formatTag)
+  uint64_t nFilterWords;
+  uint64_t k;
+  uint64_t v;
+  uint64_t nMatchingThisPhase;
+  uint64_t phaseCapacity;
+  int64_t phaseDuration;      ///< in nanoseconds
+  int64_t phaseRemaining;     ///< in nanoseconds, 0 if the phase was over
+  int64_t savedAt;            ///< in nanoseconds since the system clock epoch
+};
+
+/**
+ * \brief Writes a snapshot atomically, by writing a temporary file next to path and renaming it
+ *        once it is durable
+ *
+ * Throws std::system_error if the snapshot cannot be written.
+ */
+void
+writeSnapshot(const std::string& path, const SnapshotState& state, const uint64_t* filterWords);
+
+/**
+ * \brief Snapshot file mapped read-only into memory
+ */
+class MappedSnapshot
+{
+public:
+  MappedSnapshot() = default;
+
+  ~MappedSnapshot();
+
+  MappedSnapshot(const MappedSnapshot&) = delete; // non construction-copyable
+  MappedSnapshot& operator=(const MappedSnapshot&) = delete; // non copyable
+
+  /**
+   * \brief Maps the snapshot at the specified path and checks its version, size and checksum
+   *
+   * Returns RESTORED if the snapshot can be used, after which state and filterWords are valid
+   * until the object is destroyed.
+   */
+  SnapshotResult
+  open(const std::string& path);
+
+  const SnapshotState&
+  state() const
+  {
+    return m_state;
+  }
+
+  const uint64_t*
+  filterWords() const
+  {
+    return m_filterWords;
+  }
+
+private:
+  void* m_data = nullptr;
+  size_t m_size = 0;
+  SnapshotState m_state;
+  const uint64_t* m_filterWords = nullptr;
+};
+
+} // namespace carousel
+
+#endif // CAROUSEL_SNAPSHOT_HPP
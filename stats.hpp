@@ -0,0 +1,282 @@
+/* Scalable logging library implementing the Carousel algorithm
+ */
+
+#ifndef CAROUSEL_STATS_HPP
+#define CAROUSEL_STATS_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+
+namespace carousel {
+
+/**
+ * \brief Counter written by a single thread, which other threads may read at any time
+ *
+ * Increments are a relaxed load and store rather than an atomic read-modify-write, so they cost
+ * as much as incrementing a plain integer.
+ */
+class StatCounter
+{
+public:
+  StatCounter()
+    : m_value(0)
+  {
+  }
+
+  void
+  add(uint64_t n)
+  {
+    m_value.store(m_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+
+  void
+  increment()
+  {
+    add(1);
+  }
+
+  void
+  store(uint64_t value)
+  {
+    m_value.store(value, std::memory_order_relaxed);
+  }
+
+  uint64_t
+  load() const
+  {
+    return m_value.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<uint64_t> m_value;
+};
+
+/**
+ * \brief Snapshot of the counters of a Carousel instance
+ *
+ * Every key submitted to Carousel is counted once, as admitted, as a duplicate (a filter hit
+ * within its phase), as outside the current phase, as rejected by the sink or as skipped while
+ * the sink was full (see SinkResult). Counters are cumulated since the
+ * creation of the instance; since they are read one by one, a snapshot taken while keys are
+ * being logged may be off by the keys logged in the meantime.
+ */
+struct CarouselStats
+{
+  size_t k;
+  size_t v;
+  std::chrono::nanoseconds phaseDuration; ///< nominal duration of the current phase
+  size_t phaseCapacity;         ///< keys the current phase admits before it overflows
+  uint64_t nEstimatedKeys;      ///< distinct keys per phase duration as last estimated, or 0
+  uint64_t nPhases;             ///< phases ended, by deadline or by overflow
+  uint64_t nOverflows;          ///< phases ended early by repartitionOverflow
+  uint64_t nUnderflows;         ///< phase ends at which repartitionUnderflow decreased k
+  uint64_t nAdmitted;
+  uint64_t nDuplicates;
+  uint64_t nOutsidePhase;
+  uint64_t nRejected;           ///< keys of the phase that the sink did not accept
+  uint64_t nSkipped;            ///< keys not even hashed because the sink was full
+  uint64_t nAdmittedThisPhase;
+  uint64_t nSampledNew;         ///< sampled keys new to their phase (see falsePositiveRate)
+  uint64_t nSampledFalsePositives; ///< those of them that the filter evidenced anyway
+
+  uint64_t
+  nLogged() const
+  {
+    return nAdmitted + nDuplicates + nOutsidePhase + nRejected + nSkipped;
+  }
+
+  /**
+   * \brief Returns the measured false positive rate of the filter
+   *
+   * While sampling is enabled (see BasicCarousel::setFalsePositiveSampling), about one in 64 keys
+   * matching their phase is sampled and checked against an exact set of the sampled keys of the
+   * phase; otherwise this is zero. This is the share of the sampled keys not yet seen in their phase
+   * that the filter nevertheless evidenced, and whose entries were therefore dropped.
+   */
+  double
+  falsePositiveRate() const
+  {
+    return nSampledNew == 0 ? 0 : static_cast<double>(nSampledFalsePositives) / nSampledNew;
+  }
+};
+
+/**
+ * \brief Summary of one phase, passed to the phase callback when the phase ends
+ */
+struct PhaseSummary
+{
+  enum class End {
+    /// The phase lasted its full duration
+    DEADLINE,
+    /// The filter overflowed, and the keys were repartitioned into twice as many phases
+    BLOOM_OVERFLOW,
+  };
+
+  uint64_t phase;               ///< sequence number of the phase, from 0
+  size_t k;
+  size_t v;
+  End end;
+  std::chrono::nanoseconds duration;
+  size_t capacity;              ///< keys the phase could admit before it overflowed
+  uint64_t nAdmitted;
+  uint64_t nDuplicates;
+  uint64_t nOutsidePhase;
+  double fillRatio;             ///< share of the filter in use when the phase ended
+  double expectedFalsePositiveRate; ///< false positive rate predicted from the admitted keys
+  uint64_t nSampledNew;
+  uint64_t nSampledFalsePositives;
+};
+
+typedef std::function<void(const PhaseSummary&)> PhaseCallback;
+
+/**
+ * \brief Histogram of latencies in nanoseconds, with buckets of bounded relative width
+ *
+ * As in HdrHistogram, values are grouped by their most significant bit, and each such range is
+ * split linearly into 2^SUB_BUCKET_BITS buckets, so that percentiles are exact to within about
+ * 3%. Values above 2^MAX_EXPONENT nanoseconds are counted in the last bucket. Like StatCounter,
+ * a histogram is written by a single thread and may be read from any thread.
+ */
+class LatencyHistogram
+{
+public:
+  static const unsigned SUB_BUCKET_BITS = 5;
+  static const unsigned MAX_EXPONENT = 40;
+  static const size_t N_BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+public:
+  void
+  record(uint64_t nanoseconds)
+  {
+    m_buckets[bucketOf(nanoseconds)].increment();
+    m_sum.add(nanoseconds);
+    if (nanoseconds > m_max.load()) {
+      m_max.store(nanoseconds);
+    }
+  }
+
+  uint64_t
+  count() const
+  {
+    uint64_t n = 0;
+    for (const StatCounter& bucket : m_buckets) {
+      n += bucket.load();
+    }
+    return n;
+  }
+
+  double
+  mean() const
+  {
+    uint64_t n = count();
+    return n == 0 ? 0 : static_cast<double>(m_sum.load()) / n;
+  }
+
+  uint64_t
+  max() const
+  {
+    return m_max.load();
+  }
+
+  /**
+   * \brief Returns the upper bound of the bucket holding the specified percentile, from 0 to 1
+   */
+  uint64_t
+  percentile(double p) const
+  {
+    uint64_t n = count();
+    uint64_t rank = static_cast<uint64_t>(p * n);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < N_BUCKETS; i++) {
+      seen += m_buckets[i].load();
+      if (seen > rank) {
+        return upperBoundOf(i) < m_max.load() ? upperBoundOf(i) : m_max.load();
+      }
+    }
+    return m_max.load();
+  }
+
+  /**
+   * \brief Writes the count, mean and percentiles of the histogram on one line, in nanoseconds
+   */
+  void
+  print(std::ostream& os, const char* name) const
+  {
+    os << name << "\tcount: " << count() << "\tmean: " << static_cast<uint64_t>(mean())
+       << "\tp50: " << percentile(0.5) << "\tp90: " << percentile(0.9)
+       << "\tp99: " << percentile(0.99) << "\tp99.9: " << percentile(0.999)
+       << "\tp99.99: " << percentile(0.9999) << "\tmax: " << max() << std::endl;
+  }
+
+private:
+  static size_t
+  bucketOf(uint64_t value)
+  {
+    const uint64_t subBuckets = uint64_t(1) << SUB_BUCKET_BITS;
+    if (value < subBuckets) {
+      return value;
+    }
+    unsigned exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) {
+      return N_BUCKETS - 1;
+    }
+    unsigned shift = exponent - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) + ((value >> shift) - subBuckets);
+  }
+
+  static uint64_t
+  upperBoundOf(size_t bucket)
+  {
+    const uint64_t subBuckets = uint64_t(1) << SUB_BUCKET_BITS;
+    if (bucket < 2 * subBuckets) {
+      return bucket;
+    }
+    unsigned shift = (bucket >> SUB_BUCKET_BITS) - 1;
+    return ((subBuckets + (bucket & (subBuckets - 1)) + 1) << shift) - 1;
+  }
+
+private:
+  StatCounter m_buckets[N_BUCKETS];
+  StatCounter m_sum;
+  StatCounter m_max;
+};
+
+/**
+ * \brief Paths of Carousel::log, timed separately when latency histograms are enabled
+ */
+enum class LogPath {
+  /// The key falls outside the current phase
+  OUTSIDE_PHASE,
+  /// The key was already evidenced by the filter in this phase
+  DUPLICATE,
+  /// The entry was passed to the sink
+  ADMITTED,
+  /// The phase ended, at its deadline or by overflow, during the call
+  PHASE_TRANSITION,
+  /// Time per key of a logBatch call
+  BATCH,
+  /// The sink did not accept the entry, or was full so that the key was not even hashed
+  BACKPRESSURE,
+};
+
+const size_t N_LOG_PATHS = 6;
+
+/**
+ * \brief Returns the name of the specified path, as printed by Carousel::printLatency
+ */
+inline const char*
+logPathName(LogPath path)
+{
+  static const char* const names[N_LOG_PATHS] = {
+    "outside-phase", "duplicate", "admitted", "phase-transition", "batch", "backpressure",
+  };
+  return names[static_cast<size_t>(path)];
+}
+
+} // namespace carousel
+
+#endif // CAROUSEL_STATS_HPP
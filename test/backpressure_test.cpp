@@ -0,0 +1,95 @@
+/* Tests of Carousel with a sink reporting backpressure
+ *
+ * Carousel runs with a memory size of 100 and a collection interval of 10 ms on a virtual clock
+ * that does not advance, so that all keys fall into the first phase unless it overflows.
+ */
+
+#include "carousel.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using carousel::BackpressureLogCallback;
+using carousel::BasicCarousel;
+using carousel::ManualClock;
+using carousel::SinkResult;
+
+namespace {
+
+typedef BasicCarousel<BackpressureLogCallback, ManualClock> Instance;
+
+const size_t MEMORY_SIZE = 100;
+const std::chrono::milliseconds COLLECTION_INTERVAL(10);
+
+/**
+ * \brief A key the sink keeps refusing counts once towards the capacity of the phase, however
+ *        often it arrives
+ */
+void
+testRepeatedlyRefusedKey()
+{
+  const std::string HOT_KEY = "hot";
+  size_t nAccepted = 0;
+  Instance instance([&] (const std::string& key, const std::string&) {
+                      if (key == HOT_KEY) {
+                        return SinkResult::REJECTED;
+                      }
+                      nAccepted++;
+                      return SinkResult::ACCEPTED;
+                    },
+                    MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(),
+                    ManualClock());
+  const std::string entry;
+  for (size_t i = 0; i < 10 * MEMORY_SIZE; i++) {
+    instance.log(HOT_KEY, entry);
+    if (i % 20 == 0) {
+      instance.log(std::to_string(i), entry);
+    }
+  }
+
+  carousel::CarouselStats stats = instance.stats();
+  std::printf("repeatedly refused key: %llu refusals, %llu admitted, %llu overflows\n",
+              static_cast<unsigned long long>(stats.nRejected),
+              static_cast<unsigned long long>(stats.nAdmitted),
+              static_cast<unsigned long long>(stats.nOverflows));
+  CHECK(stats.nRejected == 10 * MEMORY_SIZE);
+  CHECK(stats.nOverflows == 0);
+  CHECK(stats.k == 0);
+  CHECK(stats.nAdmitted == 10 * MEMORY_SIZE / 20);
+  CHECK(nAccepted == stats.nAdmitted);
+}
+
+/**
+ * \brief Distinct refused keys still count towards the capacity of the phase, so that a partition
+ *        holding more keys than the sink takes overflows
+ */
+void
+testDistinctRefusedKeys()
+{
+  Instance instance([] (const std::string&, const std::string&) { return SinkResult::REJECTED; },
+                    MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(),
+                    ManualClock());
+  const std::string entry;
+  for (uint64_t key = 0; key <= MEMORY_SIZE; key++) {
+    instance.log(key, entry);
+  }
+
+  carousel::CarouselStats stats = instance.stats();
+  std::printf("distinct refused keys: %llu refusals, %llu overflows\n",
+              static_cast<unsigned long long>(stats.nRejected),
+              static_cast<unsigned long long>(stats.nOverflows));
+  CHECK(stats.nOverflows == 1);
+  CHECK(stats.k == 1);
+}
+
+} // namespace
+
+int
+main()
+{
+  testRepeatedlyRefusedKey();
+  testDistinctRefusedKeys();
+  return test::finish();
+}
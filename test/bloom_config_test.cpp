@@ -0,0 +1,98 @@
+/* Tests of the bloom filter configs sized for a false positive rate or a memory budget
+ */
+
+#include "bloom.hpp"
+#include "check.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+using carousel::Bloom;
+
+namespace {
+
+bool
+isRateRejected(double rate, Bloom::Layout layout)
+{
+  try {
+    Bloom::Config::forFalsePositiveRate(rate, layout);
+  }
+  catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+bool
+isBudgetRejected(double bitsPerKey)
+{
+  try {
+    Bloom::Config::forBitsPerKey(bitsPerKey);
+  }
+  catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+/**
+ * \brief Rates outside (0, 1) have no bloom filter, and are rejected rather than turned into an
+ *        infinite or negative size
+ */
+void
+testInvalidRates()
+{
+  const double NAN_RATE = std::numeric_limits<double>::quiet_NaN();
+  for (Bloom::Layout layout : {Bloom::Layout::STANDARD, Bloom::Layout::BLOCKED}) {
+    CHECK(isRateRejected(0, layout));
+    CHECK(isRateRejected(-0.01, layout));
+    CHECK(isRateRejected(1, layout));
+    CHECK(isRateRejected(1.5, layout));
+    CHECK(isRateRejected(NAN_RATE, layout));
+    CHECK(!isRateRejected(0.001, layout));
+  }
+}
+
+void
+testInvalidBudgets()
+{
+  CHECK(isBudgetRejected(0));
+  CHECK(isBudgetRejected(-10));
+  CHECK(isBudgetRejected(std::numeric_limits<double>::infinity()));
+  CHECK(isBudgetRejected(std::numeric_limits<double>::quiet_NaN()));
+  CHECK(!isBudgetRejected(0.5));
+}
+
+/**
+ * \brief A valid rate gives a filter reaching it
+ */
+void
+testValidRate()
+{
+  const double RATE = 0.01;
+  const size_t N_KEYS = 10000;
+  for (Bloom::Layout layout : {Bloom::Layout::STANDARD, Bloom::Layout::BLOCKED}) {
+    Bloom::Config config = Bloom::Config::forFalsePositiveRate(RATE, layout);
+    Bloom bloom(config, N_KEYS);
+    double expected = bloom.expectedFalsePositiveRate(N_KEYS);
+    std::printf("%s layout at %g: %.2f bits per key, %zu hashes, expected rate %g\n",
+                layout == Bloom::Layout::STANDARD ? "standard" : "blocked", RATE,
+                config.bitsPerKey, config.nHashes, expected);
+    CHECK(config.bitsPerKey > 0 && std::isfinite(config.bitsPerKey));
+    CHECK(config.nHashes >= 1);
+    CHECK(expected <= RATE);
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  testInvalidRates();
+  testInvalidBudgets();
+  testValidRate();
+  return test::finish();
+}
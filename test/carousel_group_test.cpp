@@ -0,0 +1,100 @@
+/* Tests of the phases of the instances of a CarouselGroup
+ *
+ * The group holds 100 instances with a memory size of 10 and a collection interval of 1 ms on a
+ * virtual clock, so that phases last 10 ms unless they overflow.
+ */
+
+#include "carousel-group.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+using carousel::BasicCarouselGroup;
+using carousel::GroupLogCallback;
+using carousel::ManualClock;
+
+namespace {
+
+typedef BasicCarouselGroup<GroupLogCallback, ManualClock> Group;
+
+const size_t N_INSTANCES = 100;
+const size_t MEMORY_SIZE = 10;
+const std::chrono::milliseconds COLLECTION_INTERVAL(1);
+const size_t N_OVERFLOWING = 9; // instances 1 to 9, one millisecond apart
+
+/**
+ * \brief Each instance starts its next phase at its own deadline, whether it was set by the first
+ *        key or moved later by an overflow
+ */
+void
+testDeadlines()
+{
+  ManualClock clock;
+  Group group([] (size_t, const std::string&, const std::string&) {}, N_INSTANCES, MEMORY_SIZE,
+              COLLECTION_INTERVAL, true, carousel::Bloom::Config(), clock);
+  const std::string entry;
+  // Starts the first phase of all instances, with deadlines at 10 ms
+  group.log(0, uint64_t(0), entry);
+
+  // Overflow instance i at i ms, moving its deadline to i + 10 ms
+  for (size_t i = 1; i <= N_OVERFLOWING; i++) {
+    clock.set(std::chrono::milliseconds(i));
+    for (uint64_t key = 0; key <= MEMORY_SIZE; key++) {
+      group.log(i, key, entry);
+    }
+    CHECK(group.stats(i).nOverflows == 1);
+  }
+
+  // Up to the second deadline of the other instances, at 20 ms
+  size_t nMismatches = 0;
+  for (size_t t = 10; t < 20; t++) {
+    clock.set(std::chrono::milliseconds(t));
+    // Any key into any instance starts the phases which have ended
+    group.log(N_INSTANCES - 1, uint64_t(0), entry);
+    for (size_t i = 0; i < N_INSTANCES; i++) {
+      bool isOverflowing = i >= 1 && i <= N_OVERFLOWING;
+      uint64_t expected = isOverflowing ? (t >= i + 10 ? 2 : 1) : 1;
+      if (group.stats(i).nPhases != expected) {
+        nMismatches++;
+      }
+    }
+  }
+  std::printf("deadlines: %zu mismatched phase counts\n", nMismatches);
+  CHECK(nMismatches == 0);
+}
+
+/**
+ * \brief Resetting an instance gives it a full phase from then on
+ */
+void
+testReset()
+{
+  ManualClock clock;
+  Group group([] (size_t, const std::string&, const std::string&) {}, N_INSTANCES, MEMORY_SIZE,
+              COLLECTION_INTERVAL, true, carousel::Bloom::Config(), clock);
+  const std::string entry;
+  group.log(0, uint64_t(0), entry);
+
+  clock.set(std::chrono::milliseconds(5));
+  group.reset(N_INSTANCES / 2);
+  clock.set(std::chrono::milliseconds(10));
+  group.log(0, uint64_t(0), entry);
+  CHECK(group.stats(0).nPhases == 1);
+  CHECK(group.stats(N_INSTANCES / 2).nPhases == 0);
+
+  clock.set(std::chrono::milliseconds(15));
+  group.log(0, uint64_t(0), entry);
+  CHECK(group.stats(N_INSTANCES / 2).nPhases == 1);
+}
+
+} // namespace
+
+int
+main()
+{
+  testDeadlines();
+  testReset();
+  return test::finish();
+}
@@ -0,0 +1,42 @@
+/* Checks shared by the tests
+ *
+ * Each test is a program running its cases in turn. CHECK reports a condition that does not hold
+ * with its location and lets the case go on, and finish() returns the exit status of the program,
+ * which is non-zero if any check failed.
+ */
+
+#ifndef CAROUSEL_TEST_CHECK_HPP
+#define CAROUSEL_TEST_CHECK_HPP
+
+#include <cstdio>
+
+namespace test {
+
+inline size_t&
+nFailures()
+{
+  static size_t n = 0;
+  return n;
+}
+
+inline int
+finish()
+{
+  if (nFailures() > 0) {
+    std::printf("%zu checks failed\n", nFailures());
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace test
+
+#define CHECK(condition)                                                                  \
+  do {                                                                                    \
+    if (!(condition)) {                                                                   \
+      std::printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);           \
+      test::nFailures()++;                                                                \
+    }                                                                                     \
+  } while (false)
+
+#endif // CAROUSEL_TEST_CHECK_HPP
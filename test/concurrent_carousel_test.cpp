@@ -0,0 +1,102 @@
+/* Tests of ConcurrentCarousel logging from several threads at once
+ *
+ * ConcurrentCarousel runs with a memory size of 1000 and a collection interval of 1 s, so that
+ * phases last 1000 s and only end by overflowing.
+ */
+
+#include "check.hpp"
+#include "concurrent-carousel.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+using carousel::AtomicBloom;
+using carousel::Bloom;
+using carousel::ConcurrentCarousel;
+
+namespace {
+
+const size_t MEMORY_SIZE = 1000;
+const std::chrono::seconds COLLECTION_INTERVAL(1);
+const size_t N_THREADS = 4;
+
+/**
+ * \brief Overflows keep narrowing the partition while threads race past the memory size, so that
+ *        only a fraction of the distinct keys is logged
+ */
+void
+testRacingOverflows(const Bloom::Config& config)
+{
+  const size_t KEYS_PER_THREAD = 8 * MEMORY_SIZE;
+  std::atomic<size_t> nLogged(0);
+  ConcurrentCarousel instance([&] (const std::string&, const std::string&) { nLogged++; },
+                              MEMORY_SIZE, COLLECTION_INTERVAL, true, config);
+  instance.reset();
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < N_THREADS; t++) {
+    threads.emplace_back([&, t] {
+      const std::string entry;
+      for (size_t i = 0; i < KEYS_PER_THREAD; i++) {
+        instance.log(std::to_string(t * KEYS_PER_THREAD + i), entry);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  std::printf("%s layout, racing overflows: %zu of %zu distinct keys logged\n",
+              config.layout == Bloom::Layout::STANDARD ? "standard" : "blocked", nLogged.load(),
+              N_THREADS * KEYS_PER_THREAD);
+  CHECK(nLogged > MEMORY_SIZE);
+  CHECK(nLogged < N_THREADS * KEYS_PER_THREAD / 2);
+}
+
+/**
+ * \brief The filter is sized and laid out from its config, and holds its keys
+ */
+void
+testFilterConfig()
+{
+  for (Bloom::Layout layout : {Bloom::Layout::STANDARD, Bloom::Layout::BLOCKED}) {
+    Bloom::Config config = Bloom::Config::forBitsPerKey(20, layout);
+    AtomicBloom bloom(config, MEMORY_SIZE);
+    CHECK(bloom.layout() == layout);
+    CHECK(bloom.size() >= 20 * MEMORY_SIZE);
+
+    bool isAllNew = true;
+    for (uint64_t key = 0; key < MEMORY_SIZE; key++) {
+      isAllNew = isAllNew && !bloom.testAndAdd(0, carousel::hashKey(key));
+    }
+    bool isAllEvidenced = true;
+    for (uint64_t key = 0; key < MEMORY_SIZE; key++) {
+      isAllEvidenced = isAllEvidenced && bloom.isEvidenced(0, carousel::hashKey(key));
+    }
+    size_t nFalsePositives = 0;
+    for (uint64_t key = MEMORY_SIZE; key < 101 * MEMORY_SIZE; key++) {
+      nFalsePositives += bloom.isEvidenced(0, carousel::hashKey(key));
+    }
+    std::printf("%s layout at 20 bits per key: %zu false positives in %zu\n",
+                layout == Bloom::Layout::STANDARD ? "standard" : "blocked", nFalsePositives,
+                100 * MEMORY_SIZE);
+    CHECK(isAllNew);
+    CHECK(isAllEvidenced);
+    CHECK(nFalsePositives < 100 * MEMORY_SIZE / 100);
+  }
+}
+
+} // namespace
+
+int
+main()
+{
+  testRacingOverflows(Bloom::Config(Bloom::Layout::STANDARD));
+  testRacingOverflows(Bloom::Config(Bloom::Layout::BLOCKED));
+  testFilterConfig();
+  return test::finish();
+}
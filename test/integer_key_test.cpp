@@ -0,0 +1,124 @@
+/* Tests of the spread of the hashes of sequential integer keys
+ *
+ * Keys such as counters or identifiers are often consecutive integers, whose hashes feed the bloom
+ * filters, the partitions of Carousel and the sketches alike, which all assume independent bits.
+ */
+
+#include "bloom.hpp"
+#include "check.hpp"
+#include "hash.hpp"
+#include "hyperloglog.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+using carousel::Bloom;
+using carousel::hashKey;
+
+namespace {
+
+const uint64_t N_KEYS = 100000;
+const uint64_t N_PROBES = 1000000;
+
+/**
+ * \brief Sequential integer keys reach the false positive rate of their filter, in both layouts
+ */
+void
+testFalsePositiveRate()
+{
+  for (Bloom::Layout layout : {Bloom::Layout::STANDARD, Bloom::Layout::BLOCKED}) {
+    Bloom bloom(Bloom::Config(layout), N_KEYS);
+    for (uint64_t key = 0; key < N_KEYS; key++) {
+      bloom.add(hashKey(key));
+    }
+    uint64_t nFalsePositives = 0;
+    for (uint64_t key = N_KEYS; key < N_KEYS + N_PROBES; key++) {
+      nFalsePositives += bloom.isEvidenced(hashKey(key));
+    }
+    double rate = static_cast<double>(nFalsePositives) / N_PROBES;
+    double expected = bloom.expectedFalsePositiveRate(N_KEYS);
+    std::printf("%s layout: false positive rate %.5f, expected %.5f\n",
+                layout == Bloom::Layout::STANDARD ? "standard" : "blocked", rate, expected);
+    CHECK(rate < 1.1 * expected);
+  }
+}
+
+/**
+ * \brief Sequential integer keys load the blocks of a blocked filter as random keys would, i.e.,
+ *        with a Poisson distribution whose variance is its mean
+ */
+void
+testBlockLoad()
+{
+  Bloom bloom(Bloom::Config(Bloom::Layout::BLOCKED), N_KEYS);
+  std::vector<uint64_t> loads(bloom.size() / 512);
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    uint64_t h1, h2;
+    carousel::deriveProbes(hashKey(key), h1, h2);
+    loads[h1 & (loads.size() - 1)]++;
+  }
+  double mean = static_cast<double>(N_KEYS) / loads.size();
+  double variance = 0;
+  for (uint64_t load : loads) {
+    variance += (load - mean) * (load - mean);
+  }
+  variance /= loads.size();
+  std::printf("block load: mean %.1f, variance %.1f\n", mean, variance);
+  CHECK(variance < 1.2 * mean);
+}
+
+/**
+ * \brief Sequential integer keys spread over the partitions of Carousel as random keys would:
+ *        neither skewed nor more even than chance
+ */
+void
+testPartitionBalance()
+{
+  const uint64_t N_PARTITIONS = 64;
+  std::vector<uint64_t> counts(N_PARTITIONS);
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    counts[hashKey(key) & (N_PARTITIONS - 1)]++;
+  }
+  double expected = static_cast<double>(N_KEYS) / N_PARTITIONS;
+  double chiSquare = 0;
+  for (uint64_t count : counts) {
+    chiSquare += (count - expected) * (count - expected) / expected;
+  }
+  // Chi-square with 63 degrees of freedom, within 3 standard deviations of its mean
+  double degrees = N_PARTITIONS - 1;
+  double spread = 3 * std::sqrt(2 * degrees);
+  std::printf("partition balance: chi-square %.1f, expected %.0f +- %.0f\n", chiSquare, degrees,
+              spread);
+  CHECK(chiSquare > degrees - spread);
+  CHECK(chiSquare < degrees + spread);
+}
+
+/**
+ * \brief The distinct count of sequential integer keys is estimated within the error of the sketch
+ */
+void
+testCardinalityEstimate()
+{
+  carousel::HyperLogLog sketch;
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    sketch.add(hashKey(key));
+  }
+  double error = sketch.estimate() / N_KEYS - 1;
+  std::printf("cardinality estimate: %.0f of %llu keys, error %.4f\n", sketch.estimate(),
+              static_cast<unsigned long long>(N_KEYS), error);
+  // Three times the standard error of 1.6% of the default precision
+  CHECK(std::abs(error) < 0.05);
+}
+
+} // namespace
+
+int
+main()
+{
+  testFalsePositiveRate();
+  testBlockLoad();
+  testPartitionBalance();
+  testCardinalityEstimate();
+  return test::finish();
+}
@@ -0,0 +1,147 @@
+/* Tests of the adaptation of Carousel phases to the state reported by the sink
+ *
+ * The coverage cases replay the scenario of `carousel_test -s -I N`: 3000 random keys, 3 per tick
+ * of one millisecond of virtual time, into a Carousel of memory size 200 assuming a collection
+ * interval of 10 ms, outputting to a Logger that records one entry every N ms. In adaptive mode,
+ * the logger state is reported every 100 ticks, with the drain rate measured over backlogged
+ * windows as in carousel_test.
+ */
+
+#include "carousel.hpp"
+#include "check.hpp"
+#include "log-fetcher.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using carousel::BasicCarousel;
+using carousel::LogCallback;
+using carousel::Logger;
+using carousel::ManualClock;
+
+namespace {
+
+typedef BasicCarousel<LogCallback, ManualClock> Instance;
+
+const size_t MEMORY_SIZE = 200;
+const std::chrono::milliseconds COLLECTION_INTERVAL(10);
+const int KEY_RANGE = 3000;
+const size_t KEYS_PER_TICK = 3;
+const int REPORT_INTERVAL = 100; // in ticks
+
+struct Result
+{
+  size_t nRecordedKeys;
+  uint64_t nRecordedEntries;
+  uint64_t nDroppedEntries;
+};
+
+Result
+simulate(bool isAdaptive, bool isOriginal, std::chrono::milliseconds sinkInterval, int nTicks)
+{
+  using namespace std::placeholders;
+
+  Logger logger(MEMORY_SIZE, sinkInterval);
+  ManualClock clock;
+  Instance instance(std::bind(&Logger::log, &logger, _1, _2), MEMORY_SIZE, COLLECTION_INTERVAL,
+                    isOriginal, carousel::Bloom::Config(), clock);
+  instance.setBatchCallback(std::bind(&Logger::logBatch, &logger, _1, _2, _3, _4));
+  carousel::RandomLogFetcher fetcher(KEY_RANGE);
+
+  std::vector<std::string> keys(KEYS_PER_TICK);
+  uint64_t lastRecorded = 0;
+  bool wasBacklogged = false;
+  for (int tick = 0; tick < nTicks; tick++) {
+    std::chrono::milliseconds now(tick);
+    size_t nFetched = fetcher.fetchBatch(keys.data(), keys.size());
+    instance.logBatch(keys.data(), keys.data(), nFetched);
+    logger.drainUntil(now);
+
+    if (isAdaptive && tick % REPORT_INTERVAL == 0) {
+      uint64_t nRecorded = logger.numRecordedEntries();
+      size_t queueDepth = logger.queueDepth();
+      double drainRate = 0;
+      if (wasBacklogged && queueDepth > 0) {
+        drainRate = (nRecorded - lastRecorded) / (REPORT_INTERVAL / 1000.0);
+      }
+      instance.reportSinkState(drainRate, queueDepth);
+      lastRecorded = nRecorded;
+      wasBacklogged = queueDepth > 0;
+    }
+    clock.set(now + std::chrono::milliseconds(1));
+  }
+  return Result{logger.numRecordedKeys(), logger.numRecordedEntries(), logger.numDroppedEntries()};
+}
+
+/**
+ * \brief With a sink slower than Carousel assumes, adaptive phases cover at least as many keys as
+ *        fixed ones, while keeping the sink as busy and dropping fewer entries
+ */
+void
+testSlowSink(bool isOriginal, std::chrono::milliseconds sinkInterval)
+{
+  const int SHORT_RUN = 50000;
+  const int LONG_RUN = 200000;
+  Result fixedShort = simulate(false, isOriginal, sinkInterval, SHORT_RUN);
+  Result adaptiveShort = simulate(true, isOriginal, sinkInterval, SHORT_RUN);
+  Result fixedLong = simulate(false, isOriginal, sinkInterval, LONG_RUN);
+  Result adaptiveLong = simulate(true, isOriginal, sinkInterval, LONG_RUN);
+  std::printf("%s, sink interval %d ms: keys after %d s %zu fixed, %zu adaptive; entries after %d s "
+              "%llu fixed, %llu adaptive; dropped %llu fixed, %llu adaptive\n",
+              isOriginal ? "original" : "enhanced", static_cast<int>(sinkInterval.count()),
+              SHORT_RUN / 1000, fixedShort.nRecordedKeys, adaptiveShort.nRecordedKeys,
+              LONG_RUN / 1000, static_cast<unsigned long long>(fixedLong.nRecordedEntries),
+              static_cast<unsigned long long>(adaptiveLong.nRecordedEntries),
+              static_cast<unsigned long long>(fixedLong.nDroppedEntries),
+              static_cast<unsigned long long>(adaptiveLong.nDroppedEntries));
+
+  CHECK(adaptiveShort.nRecordedKeys >= fixedShort.nRecordedKeys);
+  CHECK(adaptiveShort.nRecordedEntries >= fixedShort.nRecordedEntries);
+  CHECK(adaptiveLong.nRecordedEntries >= fixedLong.nRecordedEntries);
+  CHECK(adaptiveLong.nDroppedEntries < fixedLong.nDroppedEntries);
+}
+
+/**
+ * \brief Each report is smoothed into the drain rate once, however many phases start after it
+ */
+void
+testReportAppliedOnce()
+{
+  ManualClock clock;
+  Instance instance([] (const std::string&, const std::string&) {}, MEMORY_SIZE,
+                    COLLECTION_INTERVAL, true, carousel::Bloom::Config(), clock);
+  const std::string entry;
+  auto runPhases = [&] (int nPhases) {
+    for (int i = 0; i < nPhases; i++) {
+      instance.log(uint64_t(0), entry);
+      clock.advance(instance.stats().phaseDuration);
+    }
+    instance.log(uint64_t(0), entry);
+  };
+
+  instance.reportSinkState(50, MEMORY_SIZE);
+  runPhases(4);
+  // memorySize entries at 50 entries per second
+  CHECK(instance.stats().phaseDuration == std::chrono::seconds(4));
+
+  instance.reportSinkState(100, MEMORY_SIZE);
+  runPhases(20);
+  // Smoothed once from 50 towards 100, to 62.5 entries per second, and not further
+  CHECK(instance.stats().phaseDuration == std::chrono::milliseconds(3200));
+}
+
+} // namespace
+
+int
+main()
+{
+  testSlowSink(true, std::chrono::milliseconds(20));
+  testSlowSink(true, std::chrono::milliseconds(30));
+  testSlowSink(false, std::chrono::milliseconds(20));
+  testSlowSink(false, std::chrono::milliseconds(30));
+  testReportAppliedOnce();
+  return test::finish();
+}
@@ -0,0 +1,170 @@
+/* Tests of saving and restoring Carousel snapshots
+ *
+ * Carousel runs with a memory size of 1000 and a collection interval of 1 s on a virtual clock, so
+ * that phases last 1000 s unless they overflow.
+ */
+
+#include "carousel.hpp"
+#include "check.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+using carousel::BasicCarousel;
+using carousel::ManualClock;
+using carousel::MappedSnapshot;
+using carousel::SnapshotResult;
+using carousel::SnapshotState;
+
+namespace {
+
+typedef BasicCarousel<carousel::LogCallback, ManualClock> Instance;
+
+const size_t MEMORY_SIZE = 1000;
+const std::chrono::seconds COLLECTION_INTERVAL(1);
+const char SNAPSHOT_PATH[] = "snapshot_test.snap";
+
+void
+ignore(const std::string&, const std::string&)
+{
+}
+
+/**
+ * \brief Rewrites the snapshot at SNAPSHOT_PATH with another phase number, and a checksum
+ *        matching it
+ */
+void
+rewriteWithPhase(uint64_t v)
+{
+  MappedSnapshot snapshot;
+  CHECK(snapshot.open(SNAPSHOT_PATH) == SnapshotResult::RESTORED);
+  SnapshotState state = snapshot.state();
+  state.v = v;
+  carousel::writeSnapshot(SNAPSHOT_PATH, state, snapshot.filterWords());
+}
+
+/**
+ * \brief In original mode, a snapshot whose phase is not one of the 2^k partitions is damaged,
+ *        while in enhanced mode the phase grows without bound
+ */
+void
+testPhaseOutOfRange()
+{
+  for (bool isOriginal : {true, false}) {
+    ManualClock clock;
+    Instance source(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, isOriginal,
+                    carousel::Bloom::Config(), clock);
+    const std::string entry;
+    // Overflow twice, to k = 2
+    for (uint64_t key = 0; source.stats().k < 2; key++) {
+      source.log(key, entry);
+    }
+    source.saveSnapshot(SNAPSHOT_PATH);
+
+    rewriteWithPhase(3);
+    Instance inRange(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, isOriginal,
+                     carousel::Bloom::Config(), clock);
+    CHECK(inRange.restoreSnapshot(SNAPSHOT_PATH) == SnapshotResult::RESTORED);
+    CHECK(inRange.stats().v == 3);
+
+    rewriteWithPhase(4);
+    Instance outOfRange(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, isOriginal,
+                        carousel::Bloom::Config(), clock);
+    SnapshotResult expected = isOriginal ? SnapshotResult::DAMAGED : SnapshotResult::RESTORED;
+    CHECK(outOfRange.restoreSnapshot(SNAPSHOT_PATH) == expected);
+    CHECK(outOfRange.stats().v == (isOriginal ? 0 : 4));
+  }
+}
+
+/**
+ * \brief Keys logged before the snapshot are not counted as false positives after restoring it,
+ *        and sampling resumes with the next phase
+ */
+void
+testSamplingAfterRestore()
+{
+  const uint64_t N_KEYS = MEMORY_SIZE / 2;
+  const std::string entry;
+  ManualClock clock;
+  Instance source(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(), clock);
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    source.log(key, entry);
+  }
+  source.saveSnapshot(SNAPSHOT_PATH);
+
+  Instance restored(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(),
+                    clock);
+  restored.setFalsePositiveSampling(true);
+  CHECK(restored.restoreSnapshot(SNAPSHOT_PATH) == SnapshotResult::RESTORED);
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    restored.log(key, entry);
+  }
+  carousel::CarouselStats stats = restored.stats();
+  CHECK(stats.nDuplicates == N_KEYS);
+  CHECK(stats.nSampledNew == 0);
+  CHECK(stats.nSampledFalsePositives == 0);
+
+  clock.advance(restored.stats().phaseDuration);
+  for (uint64_t key = 0; key < N_KEYS; key++) {
+    restored.log(key, entry);
+  }
+  stats = restored.stats();
+  std::printf("sampling after restore: %llu sampled in the next phase, %llu false positives\n",
+              static_cast<unsigned long long>(stats.nSampledNew),
+              static_cast<unsigned long long>(stats.nSampledFalsePositives));
+  CHECK(stats.nPhases == 1);
+  CHECK(stats.nSampledNew > 0);
+}
+
+/**
+ * \brief A phase restored halfway through keeps its start, so that its summary reports the full
+ *        duration when it ends
+ */
+void
+testHalfElapsedPhase()
+{
+  const std::string entry;
+  ManualClock sourceClock;
+  Instance source(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(),
+                  sourceClock);
+  source.log(uint64_t(0), entry);
+  std::chrono::nanoseconds phaseDuration = source.stats().phaseDuration;
+  sourceClock.advance(phaseDuration / 2);
+  source.log(uint64_t(1), entry);
+  source.saveSnapshot(SNAPSHOT_PATH);
+
+  // Far enough from the clock origin that the restored start is not clamped to it
+  ManualClock clock;
+  clock.set(4 * phaseDuration);
+  Instance restored(ignore, MEMORY_SIZE, COLLECTION_INTERVAL, true, carousel::Bloom::Config(),
+                    clock);
+  CHECK(restored.restoreSnapshot(SNAPSHOT_PATH) == SnapshotResult::RESTORED);
+  std::chrono::nanoseconds reported(0);
+  restored.setPhaseCallback([&] (const carousel::PhaseSummary& p) { reported = p.duration; });
+
+  clock.advance(phaseDuration / 2);
+  restored.log(uint64_t(2), entry);
+  std::printf("half elapsed phase: reported duration %lld ms of %lld ms\n",
+              static_cast<long long>(reported.count() / 1000000),
+              static_cast<long long>(phaseDuration.count() / 1000000));
+  CHECK(restored.stats().nPhases == 1);
+  // The time spent saving and restoring counts towards the phase, whose deadline is therefore
+  // slightly before the key ending it
+  CHECK(reported >= phaseDuration);
+  CHECK(reported <= phaseDuration + std::chrono::seconds(1));
+}
+
+} // namespace
+
+int
+main()
+{
+  testPhaseOutOfRange();
+  testSamplingAfterRestore();
+  testHalfElapsedPhase();
+  unlink(SNAPSHOT_PATH);
+  return test::finish();
+}